@@ -0,0 +1,173 @@
+
+#include <cstring>
+#include <numeric>
+
+#include "io/buffer.h"
+#include "io/serialize.h"
+#include "util/bits.h"
+#include "bench.h"
+
+// measures the conversion of numeric arrays to and from their wire order. first, values holding the
+// largest array a value may have are written and read through the serializer, against writing each
+// element alone as arrays were written before they were converted in bulk. then, the byte swap under
+// it is run on large spans, bulk (with the simd shuffles the cpu has) against an element by element loop.
+//
+// usage: bench_arrays [iterations]
+
+using namespace obsr;
+
+// the size of an array is written in one byte, of which the largest value is reserved
+static constexpr size_t max_array_size = UINT8_MAX - 1;
+static constexpr size_t span_size = 64 * 1024;
+
+// keeps results alive, so that the work making them is not optimized out
+static volatile uint64_t s_sink = 0;
+
+template<typename t_>
+static double time_per_iteration(size_t iterations, t_ func) {
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        func();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) /
+           static_cast<double>(iterations);
+}
+
+template<typename t_>
+static value make_array_value(std::span<const t_> values) {
+    if constexpr (std::is_same_v<t_, int32_t>) {
+        return value::make_int32_array(values);
+    } else if constexpr (std::is_same_v<t_, int64_t>) {
+        return value::make_int64_array(values);
+    } else if constexpr (std::is_same_v<t_, float>) {
+        return value::make_float_array(values);
+    } else {
+        return value::make_double_array(values);
+    }
+}
+
+template<typename t_>
+static bool write_each(io::basic_serializer<io::linear_buffer>& serializer, std::span<const t_> values) {
+    if (!serializer.write_size(values.size())) {
+        return false;
+    }
+
+    for (const auto value : values) {
+        bool written;
+        if constexpr (std::is_same_v<t_, int32_t>) {
+            written = serializer.write32(static_cast<uint32_t>(value));
+        } else if constexpr (std::is_same_v<t_, int64_t>) {
+            written = serializer.write64(static_cast<uint64_t>(value));
+        } else if constexpr (std::is_same_v<t_, float>) {
+            written = serializer.writef32(value);
+        } else {
+            written = serializer.writef64(value);
+        }
+
+        if (!written) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+template<typename t_>
+static void measure_value(const char* name, size_t iterations) {
+    std::vector<t_> values(max_array_size);
+    std::iota(values.begin(), values.end(), static_cast<t_>(1));
+    const auto array_value = make_array_value<t_>(values);
+
+    io::linear_buffer buffer(1 + 1 + max_array_size * sizeof(t_));
+    io::basic_serializer<io::linear_buffer> serializer(&buffer);
+
+    const auto each = time_per_iteration(iterations, [&]()->void {
+        buffer.reset();
+        if (!write_each<t_>(serializer, values)) {
+            throw std::runtime_error("failed to write array");
+        }
+        s_sink = s_sink + buffer.pos();
+    });
+
+    const auto write = time_per_iteration(iterations, [&]()->void {
+        buffer.reset();
+        if (!serializer.write_value_type(array_value.get_type()) || !serializer.write_value(array_value)) {
+            throw std::runtime_error("failed to write value");
+        }
+        s_sink = s_sink + buffer.pos();
+    });
+
+    io::readonly_buffer_view view;
+    io::basic_deserializer<io::readonly_buffer_view> deserializer(&view);
+
+    const auto read = time_per_iteration(iterations, [&]()->void {
+        view.reset(buffer.data(), buffer.pos());
+        const auto read_value = deserializer.read_typed_value();
+        if (!read_value || read_value->get_type() != array_value.get_type()) {
+            throw std::runtime_error("failed to read value");
+        }
+    });
+
+    printf("%-7s %8lu %17.1f %13.1f %13.1f\n", name, values.size(), each, write, read);
+}
+
+template<typename t_>
+static void swap_each(const t_* src, t_* dst, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        t_ value;
+        if constexpr (sizeof(t_) == sizeof(uint32_t)) {
+            value = __builtin_bswap32(src[i]);
+        } else {
+            value = __builtin_bswap64(src[i]);
+        }
+
+        // passing each value through a register keeps the compiler from vectorizing the loop on its own
+        asm("" : "+r"(value));
+        dst[i] = value;
+    }
+}
+
+template<typename t_>
+static void measure_span(const char* name, size_t iterations) {
+    std::vector<t_> src(span_size);
+    std::vector<t_> dst(span_size);
+    std::iota(src.begin(), src.end(), 1);
+
+    const auto each = time_per_iteration(iterations, [&]()->void {
+        swap_each(src.data(), dst.data(), src.size());
+        s_sink = s_sink + dst[0];
+    });
+    const auto bulk = time_per_iteration(iterations, [&]()->void {
+        if constexpr (sizeof(t_) == sizeof(uint32_t)) {
+            bits::swap_copy32(src.data(), dst.data(), src.size());
+        } else {
+            bits::swap_copy64(src.data(), dst.data(), src.size());
+        }
+        s_sink = s_sink + dst[0];
+    });
+
+    printf("%-12s %8lu %12.2f %12.2f %9.1fx\n", name, src.size(), each / 1000.0, bulk / 1000.0, each / bulk);
+}
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    const auto iterations = static_cast<size_t>(argc > 1 ? std::stoul(argv[1]) : 100000);
+
+    printf("%-7s %8s %17s %13s %13s\n", "type", "elements", "ns/write each", "ns/write", "ns/read");
+    measure_value<int32_t>("int32", iterations);
+    measure_value<int64_t>("int64", iterations);
+    measure_value<float>("float", iterations);
+    measure_value<double>("double", iterations);
+
+    printf("\n");
+
+    // spans are far larger than values, so fewer of them are converted
+    const auto span_iterations = std::max<size_t>(1, iterations / 100);
+    printf("%-12s %8s %12s %12s %10s\n", "function", "elements", "us each", "us bulk", "speedup");
+    measure_span<uint32_t>("swap_copy32", span_iterations);
+    measure_span<uint64_t>("swap_copy64", span_iterations);
+
+    return 0;
+}
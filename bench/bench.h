@@ -0,0 +1,160 @@
+#pragma once
+
+#include <unistd.h>
+#include <sys/wait.h>
+#include <ctime>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <memory>
+
+#include "os/socket.h"
+
+// helpers shared by the benchmarks
+namespace obsr::bench {
+
+// cpu time used by all the threads of this process
+inline std::chrono::nanoseconds process_cpu_time() {
+    timespec time{};
+    ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return std::chrono::seconds(time.tv_sec) + std::chrono::nanoseconds(time.tv_nsec);
+}
+
+struct latency_summary {
+    double p50_us;
+    double p99_us;
+    double max_us;
+};
+
+inline latency_summary summarize(std::vector<std::chrono::nanoseconds>& samples) {
+    if (samples.empty()) {
+        return {0, 0, 0};
+    }
+
+    std::sort(samples.begin(), samples.end());
+    const auto at = [&samples](double fraction)->double {
+        const auto index = std::min(samples.size() - 1, static_cast<size_t>(fraction * samples.size()));
+        return static_cast<double>(samples[index].count()) / 1000.0;
+    };
+
+    return {at(0.5), at(0.99), static_cast<double>(samples.back().count()) / 1000.0};
+}
+
+// another process of this benchmark, which writes its results to its standard output
+struct child {
+    pid_t pid;
+    FILE* output;
+};
+
+// each process holds a single obsr instance, so benchmarks with several nodes run them as
+// separate processes: the benchmark runs itself again, with the given arguments.
+inline child spawn_self(const std::vector<std::string>& args) {
+    std::vector<std::string> arguments = {"/proc/self/exe"};
+    arguments.insert(arguments.end(), args.begin(), args.end());
+
+    // prepared before forking, since only exec may follow it
+    std::vector<char*> argv;
+    for (auto& argument : arguments) {
+        argv.push_back(argument.data());
+    }
+    argv.push_back(nullptr);
+
+    int fds[2];
+    if (::pipe(fds)) {
+        throw std::runtime_error("pipe failed");
+    }
+
+    const auto pid = ::fork();
+    if (pid < 0) {
+        throw std::runtime_error("fork failed");
+    }
+
+    if (pid == 0) {
+        ::dup2(fds[1], STDOUT_FILENO);
+        ::close(fds[0]);
+        ::close(fds[1]);
+        ::execv(argv[0], argv.data());
+        ::_exit(127);
+    }
+
+    ::close(fds[1]);
+    return {pid, ::fdopen(fds[0], "r")};
+}
+
+// reads a line the child wrote, without the line break. returns an empty string once it exited.
+inline std::string read_line(child& child) {
+    char line[256];
+    if (::fgets(line, sizeof(line), child.output) == nullptr) {
+        return {};
+    }
+
+    std::string result(line);
+    if (!result.empty() && result.back() == '\n') {
+        result.pop_back();
+    }
+
+    return result;
+}
+
+inline void wait_for(child& child) {
+    ::fclose(child.output);
+    ::waitpid(child.pid, nullptr, 0);
+}
+
+// the two ends of a connection, both blocking
+struct socket_pair {
+    std::unique_ptr<os::socket> server;
+    // closed first, so that the port of the server is not held in time-wait and can be bound again
+    std::unique_ptr<os::socket> client;
+};
+
+// connects over tcp to the port on the loopback interface, or over a unix domain socket at a path made
+// from the port
+inline socket_pair connect_pair(os::socket_domain domain, uint16_t port) {
+    const auto local_path = "/tmp/obsr-bench-" + std::to_string(port) + ".sock";
+
+    os::server_socket server_socket(domain);
+    if (domain == os::socket_domain::local) {
+        server_socket.bind_local(local_path);
+    } else {
+        server_socket.setoption<os::sockopt_reuseport>(true);
+        server_socket.bind("127.0.0.1", port);
+    }
+    server_socket.listen(1);
+
+    auto client = std::make_unique<os::socket>(domain);
+    if (domain == os::socket_domain::local) {
+        client->connect_local(local_path);
+    } else {
+        client->connect("127.0.0.1", port);
+    }
+
+    std::unique_ptr<os::socket> server;
+    while (!(server = server_socket.accept())) {
+    }
+    server->configure_blocking(true);
+
+    return {std::move(server), std::move(client)};
+}
+
+inline void read_exact(os::socket& socket, uint8_t* buffer, size_t size) {
+    while (size > 0) {
+        const auto read = socket.read(buffer, size);
+        buffer += read;
+        size -= read;
+    }
+}
+
+inline void write_exact(os::socket& socket, const uint8_t* buffer, size_t size) {
+    while (size > 0) {
+        const auto written = socket.write(buffer, size);
+        buffer += written;
+        size -= written;
+    }
+}
+
+}
@@ -0,0 +1,161 @@
+
+#include <obsr.h>
+
+#include <cstring>
+#include <thread>
+#include <atomic>
+
+#include "bench.h"
+
+// measures the cpu time of a server sending updates to its clients, against the amount of clients.
+// the server changes every entry once in each round, and rounds are spaced by the interval the server
+// sends changes in, so that no change is merged with the next. each client runs in a process of its own,
+// and connects over tcp. reported is the cpu time of the server process per update, and per update sent
+// to each client, after taking out the cpu time the server uses while idle.
+//
+// usage: bench_fanout [port]
+
+static constexpr size_t client_counts[] = {1, 10, 50};
+// storage holds up to 256 entries
+static constexpr size_t entry_count = 200;
+static constexpr size_t round_count = 10;
+// a bit more than the interval the server sends changes in
+static constexpr auto round_interval = std::chrono::milliseconds(210);
+
+static const char* const data_path = "/bench/data";
+static const char* const done_path = "/bench/done";
+
+static std::string entry_path(size_t index) {
+    return std::string(data_path) + "/e" + std::to_string(index);
+}
+
+// waits until the entry has a value which matches the predicate
+static void wait_for_value(obsr::entry entry, const std::function<bool(const obsr::value&)>& predicate) {
+    while (true) {
+        const auto values = obsr::get_values({&entry, 1});
+        if (values[0] && predicate(values[0].value())) {
+            break;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+static int client_main(uint16_t port, int32_t initial_value) {
+    obsr::start_client("127.0.0.1", port);
+
+    // all the entries were received, so that only the rounds are counted
+    for (size_t i = 0; i < entry_count; i++) {
+        wait_for_value(obsr::get_entry(entry_path(i)), [initial_value](const obsr::value& value)->bool {
+            return value.get_int32_or(initial_value - 1) == initial_value;
+        });
+    }
+
+    std::atomic<uint64_t> changes(0);
+    const auto listener = obsr::listen_object(obsr::get_object(data_path), [&changes](const obsr::event& event)->void {
+        // a value received again is not a change
+        if (event.get_type() == obsr::event_type::value_changed &&
+            event.get_value().get_int32_or(0) != event.get_old_value().get_int32_or(0)) {
+            changes.fetch_add(1);
+        }
+    });
+
+    printf("ready\n");
+    fflush(stdout);
+
+    wait_for_value(obsr::get_entry(done_path), [](const obsr::value& value)->bool {
+        return value.get_boolean_or(false);
+    });
+
+    obsr::delete_listener(listener);
+    printf("%lu\n", changes.load());
+    fflush(stdout);
+
+    obsr::stop_network();
+    return 0;
+}
+
+static void set_entries(const std::vector<obsr::entry>& entries, int32_t value) {
+    for (const auto entry : entries) {
+        obsr::set_value(entry, obsr::value::make_int32(value));
+    }
+}
+
+// entries are kept between runs, so the rounds carry on counting from the last run
+static int32_t s_round = 0;
+
+static void run_rounds(const std::vector<obsr::entry>& entries) {
+    for (size_t i = 0; i < round_count; i++) {
+        s_round++;
+        set_entries(entries, s_round);
+
+        std::this_thread::sleep_for(round_interval);
+    }
+}
+
+static void run(uint16_t port, size_t client_count) {
+    obsr::start_server(port);
+
+    std::vector<obsr::entry> entries;
+    for (size_t i = 0; i < entry_count; i++) {
+        entries.push_back(obsr::get_entry(entry_path(i)));
+    }
+    set_entries(entries, s_round);
+
+    const auto done = obsr::get_entry(done_path);
+    obsr::set_value(done, obsr::value::make_boolean(false));
+
+    std::vector<obsr::bench::child> clients;
+    for (size_t i = 0; i < client_count; i++) {
+        clients.push_back(obsr::bench::spawn_self({"client", std::to_string(port), std::to_string(s_round)}));
+    }
+    for (auto& client : clients) {
+        if (obsr::bench::read_line(client) != "ready") {
+            throw std::runtime_error("client failed to start");
+        }
+    }
+
+    // the server is not idle while it has no changes to send, so its cost is measured over the same time
+    const auto idle_start = obsr::bench::process_cpu_time();
+    std::this_thread::sleep_for(round_interval * round_count);
+    const auto idle_cpu = obsr::bench::process_cpu_time() - idle_start;
+
+    const auto start = obsr::bench::process_cpu_time();
+    run_rounds(entries);
+    const auto cpu = obsr::bench::process_cpu_time() - start;
+
+    obsr::set_value(done, obsr::value::make_boolean(true));
+
+    uint64_t received = 0;
+    for (auto& client : clients) {
+        received += std::stoul(obsr::bench::read_line(client));
+        obsr::bench::wait_for(client);
+    }
+
+    obsr::stop_network();
+
+    const auto updates = entry_count * round_count;
+    const auto update_cpu = static_cast<double>((cpu - idle_cpu).count()) / static_cast<double>(updates);
+    printf("%7lu %10lu %14.0f %21.0f %12.1f\n",
+           client_count,
+           updates,
+           update_cpu,
+           update_cpu / static_cast<double>(client_count),
+           100.0 * static_cast<double>(received) / static_cast<double>(updates * client_count));
+}
+
+int main(int argc, char** argv) {
+    if (argc > 3 && strcmp(argv[1], "client") == 0) {
+        return client_main(static_cast<uint16_t>(std::stoul(argv[2])), static_cast<int32_t>(std::stol(argv[3])));
+    }
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    const auto port = static_cast<uint16_t>(argc > 1 ? std::stoul(argv[1]) : 27610);
+
+    printf("%7s %10s %14s %21s %12s\n", "clients", "updates", "ns/update", "ns/update/client", "received %");
+    for (const auto client_count : client_counts) {
+        run(port, client_count);
+    }
+
+    return 0;
+}
@@ -0,0 +1,175 @@
+
+#include <cstring>
+#include <cmath>
+#include <thread>
+#include <atomic>
+
+#include "events/events.h"
+#include "net/io.h"
+#include "net/serialize.h"
+#include "bench.h"
+
+// measures the bytes on the wire per entry update, with full frames and with compact frames. updates of
+// scalar values are written through the io of one end of a tcp connection, as the server writes them to
+// its clients, and the other end counts the bytes it receives. the other end announces that it reads
+// compact frames, as newer peers do, or stays silent as a peer reading only full frames would. the
+// announcement of each end and a marker sent at the end are counted too, which over the amount of
+// updates sent is well below a byte per update.
+//
+// usage: bench_frame_size [port]
+
+using namespace obsr;
+
+static constexpr size_t entry_count = 200;
+static constexpr size_t round_count = 50;
+// entries are sent out on an interval, with the time they were changed at
+static constexpr auto round_interval = std::chrono::milliseconds(20);
+static constexpr uint8_t marker_byte = 0xa5;
+static constexpr size_t marker_size = 16;
+
+static value make_value(value_type type, size_t round, size_t index) {
+    switch (type) {
+        case value_type::boolean:
+            return value::make_boolean((round + index) % 2 == 0);
+        case value_type::integer32:
+            return value::make_int32(static_cast<int32_t>(round * 10 + index));
+        case value_type::floating_point64:
+            return value::make_double(std::sin(static_cast<double>(round + index) / 10.0));
+        default:
+            throw std::runtime_error("unsupported type");
+    }
+}
+
+static void announce_compact_frames(os::socket& socket) {
+    const uint8_t announcement[] = {net::message_header::compact_frame_version, 0};
+    net::message_header header {
+            net::message_header::message_magic,
+            net::message_header::full_frame_version,
+            0,
+            static_cast<uint8_t>(net::message_type::frame_version),
+            sizeof(announcement)
+    };
+    net::header_convert_net(header);
+
+    bench::write_exact(socket, reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+    bench::write_exact(socket, announcement, sizeof(announcement));
+}
+
+// reads until the marker was received, returning the amount of bytes read
+static uint64_t read_until_marker(os::socket& socket) {
+    uint64_t received = 0;
+    size_t marker_run = 0;
+
+    uint8_t buffer[16 * 1024];
+    while (marker_run < marker_size) {
+        const auto read = socket.read(buffer, sizeof(buffer));
+        for (size_t i = 0; i < read; i++) {
+            marker_run = buffer[i] == marker_byte ? marker_run + 1 : 0;
+        }
+        received += read;
+    }
+
+    return received;
+}
+
+static double measure(value_type type, bool compact, uint16_t port) {
+    auto pair = bench::connect_pair(os::socket_domain::inet, port);
+
+    auto looper = std::make_shared<events::looper>();
+    std::atomic<bool> run_looper(true);
+    std::thread looper_thread([&]()->void {
+        while (run_looper.load()) {
+            looper->loop();
+        }
+    });
+
+    net::socket_io io;
+    std::atomic<bool> drained(false);
+    io.on_drain([&drained]()->void {
+        drained.store(true);
+    });
+    looper->request_execute([&](events::looper&)->void {
+        io.start(looper.get(), std::shared_ptr<os::socket>(std::move(pair.server)), true);
+    }, events::looper::execute_type::sync);
+
+    if (compact) {
+        announce_compact_frames(*pair.client);
+    }
+
+    std::atomic<uint64_t> received(0);
+    std::thread reader_thread([&]()->void {
+        received.store(read_until_marker(*pair.client));
+    });
+
+    // the connection must have switched to compact frames before any update is written
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    std::vector<net::encoded_message> messages;
+    net::message_serializer serializer;
+    const auto start_time = std::chrono::milliseconds(1700000000000);
+    for (size_t round = 0; round < round_count; round++) {
+        const auto send_time = start_time + round * round_interval;
+        for (size_t i = 0; i < entry_count; i++) {
+            const auto id = storage::make_entry_id(i, 1);
+            auto message = serializer.encode(net::out_message::entry_update(send_time, id, make_value(type, round, i)));
+            messages.push_back(message.value());
+        }
+    }
+
+    uint8_t marker[marker_size];
+    memset(marker, marker_byte, sizeof(marker));
+    messages.push_back({net::message_type::handshake_finished, io::shared_buffer(marker, sizeof(marker))});
+
+    // the write queue is bounded, so updates are written in as many goes as it takes
+    size_t written = 0;
+    while (written < messages.size()) {
+        drained.store(false);
+        looper->request_execute([&](events::looper&)->void {
+            while (written < messages.size() &&
+                   io.write(static_cast<uint8_t>(messages[written].type), messages[written].payload)) {
+                written++;
+            }
+        }, events::looper::execute_type::sync);
+
+        while (written < messages.size() && !drained.load()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    reader_thread.join();
+
+    looper->request_execute([&io](events::looper&)->void {
+        io.stop();
+    }, events::looper::execute_type::sync);
+    run_looper.store(false);
+    looper->signal_run();
+    looper_thread.join();
+
+    return static_cast<double>(received.load()) / static_cast<double>(entry_count * round_count);
+}
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    const auto port = static_cast<uint16_t>(argc > 1 ? std::stoul(argv[1]) : 27614);
+
+    printf("%-8s %8s %17s %20s %8s\n", "type", "updates", "bytes/update full", "bytes/update compact", "saved %");
+
+    const std::pair<value_type, const char*> types[] = {
+            {value_type::boolean, "boolean"},
+            {value_type::integer32, "int32"},
+            {value_type::floating_point64, "double"}
+    };
+    for (const auto& [type, name] : types) {
+        const auto full = measure(type, false, port);
+        const auto compact = measure(type, true, port);
+
+        printf("%-8s %8lu %17.1f %20.1f %8.1f\n",
+               name,
+               entry_count * round_count,
+               full,
+               compact,
+               100.0 * (full - compact) / full);
+    }
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+
+#include <atomic>
+
+#include "storage/listener_storage.h"
+#include "storage/storage.h"
+#include "bench.h"
+
+// measures the cost of applying updates received from the network to storage. updates are applied in
+// rounds, each changing the value of every entry once, with and without a listener on all the entries.
+// storage holds at most 256 entries (the size of its handle table), which bounds the largest run.
+//
+// usage: bench_ingest [updates per run]
+
+using namespace obsr;
+
+static constexpr size_t entry_counts[] = {16, 64, 256};
+
+static double measure(size_t entry_count, size_t update_count, bool with_listener) {
+    auto clock = std::make_shared<obsr::clock>();
+    auto listener_storage = std::make_shared<storage::listener_storage>(clock);
+    storage::storage storage(listener_storage, clock);
+
+    std::vector<storage::entry_id> ids;
+    for (size_t i = 0; i < entry_count; i++) {
+        const auto id = storage::make_entry_id(i, 1);
+        storage.on_entry_created(id, "/bench/e" + std::to_string(i), value::make_int32(0), std::chrono::milliseconds(1));
+        ids.push_back(id);
+    }
+
+    std::atomic<uint64_t> events(0);
+    if (with_listener) {
+        storage.listen("/bench", [&events](const event&)->void {
+            events.fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+
+    const auto rounds = std::max<size_t>(1, update_count / entry_count);
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < rounds; round++) {
+        const auto value = value::make_int32(static_cast<int32_t>(round + 1));
+        const auto timestamp = std::chrono::milliseconds(round + 2);
+
+        for (const auto id : ids) {
+            storage.on_entry_updated(id, value, timestamp);
+        }
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) /
+           static_cast<double>(rounds * entry_count);
+}
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    const auto update_count = static_cast<size_t>(argc > 1 ? std::stoul(argv[1]) : 2000000);
+
+    printf("%7s %20s %19s\n", "entries", "ns/update", "ns/update listened");
+    for (const auto entry_count : entry_counts) {
+        const auto alone = measure(entry_count, update_count, false);
+        const auto listened = measure(entry_count, update_count, true);
+
+        printf("%7lu %20.1f %19.1f\n", entry_count, alone, listened);
+    }
+
+    return 0;
+}
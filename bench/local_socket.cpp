@@ -0,0 +1,104 @@
+
+#include <cstring>
+#include <thread>
+
+#include "bench.h"
+
+// compares unix domain sockets, which clients on the same host may connect over, with tcp over the
+// loopback interface. measured are the round trip of a small message, echoed back by a thread on the other
+// end, and the rate of streaming large writes in one direction. tcp sockets do not delay small writes,
+// as in the library.
+//
+// usage: bench_local_socket [port]
+
+using namespace obsr;
+
+static constexpr size_t message_size = 8;
+static constexpr size_t warmup_round_trips = 1000;
+static constexpr size_t round_trips = 100000;
+static constexpr size_t stream_write_size = 64 * 1024;
+static constexpr size_t stream_size = 1024 * 1024 * 1024;
+
+static bench::socket_pair connect(os::socket_domain domain, uint16_t port) {
+    auto pair = bench::connect_pair(domain, port);
+    if (domain == os::socket_domain::inet) {
+        pair.client->setoption<os::sockopt_nodelay>(true);
+        pair.server->setoption<os::sockopt_nodelay>(true);
+    }
+
+    return pair;
+}
+
+static bench::latency_summary measure_round_trip(os::socket_domain domain, uint16_t port) {
+    auto pair = connect(domain, port);
+
+    std::thread echo_thread([&pair]()->void {
+        uint8_t message[message_size];
+        for (size_t i = 0; i < warmup_round_trips + round_trips; i++) {
+            bench::read_exact(*pair.server, message, sizeof(message));
+            bench::write_exact(*pair.server, message, sizeof(message));
+        }
+    });
+
+    uint8_t message[message_size];
+    memset(message, 0, sizeof(message));
+
+    std::vector<std::chrono::nanoseconds> samples;
+    samples.reserve(round_trips);
+    for (size_t i = 0; i < warmup_round_trips + round_trips; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        bench::write_exact(*pair.client, message, sizeof(message));
+        bench::read_exact(*pair.client, message, sizeof(message));
+        const auto end = std::chrono::steady_clock::now();
+
+        if (i >= warmup_round_trips) {
+            samples.push_back(end - start);
+        }
+    }
+
+    echo_thread.join();
+    return bench::summarize(samples);
+}
+
+// returns the rate in megabytes per second
+static double measure_stream(os::socket_domain domain, uint16_t port) {
+    auto pair = connect(domain, port);
+
+    std::thread read_thread([&pair]()->void {
+        std::vector<uint8_t> buffer(stream_write_size);
+        size_t remaining = stream_size;
+        while (remaining > 0) {
+            remaining -= pair.server->read(buffer.data(), std::min(remaining, buffer.size()));
+        }
+    });
+
+    std::vector<uint8_t> buffer(stream_write_size, 0xab);
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t written = 0; written < stream_size; written += buffer.size()) {
+        bench::write_exact(*pair.client, buffer.data(), buffer.size());
+    }
+    read_thread.join();
+    const auto end = std::chrono::steady_clock::now();
+
+    return static_cast<double>(stream_size) / (1024.0 * 1024.0) / std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    const auto port = static_cast<uint16_t>(argc > 1 ? std::stoul(argv[1]) : 27612);
+
+    printf("%-6s %12s %12s %12s %12s\n", "socket", "rtt p50 us", "rtt p99 us", "rtt max us", "stream MB/s");
+
+    const std::pair<os::socket_domain, const char*> domains[] = {
+            {os::socket_domain::local, "unix"},
+            {os::socket_domain::inet, "tcp"}
+    };
+    for (const auto& [domain, name] : domains) {
+        const auto round_trip = measure_round_trip(domain, port);
+        const auto stream = measure_stream(domain, port);
+
+        printf("%-6s %12.1f %12.1f %12.1f %12.0f\n", name, round_trip.p50_us, round_trip.p99_us, round_trip.max_us, stream);
+    }
+
+    return 0;
+}
@@ -0,0 +1,139 @@
+
+#include <sys/socket.h>
+#include <fcntl.h>
+
+#include <cstring>
+#include <thread>
+#include <atomic>
+
+#include "events/events.h"
+#include "bench.h"
+
+// measures the cost of the looper handling updates from many connections, with each poller.
+// a thread writes small updates, one per write, to each connection in turn as fast as it can, and
+// the looper reads them from its own thread. reported are the updates handled per second, the cpu
+// time of the looper thread per update, and how many updates each iteration of the loop handled.
+//
+// usage: bench_poller [seconds per run]
+
+using namespace obsr;
+
+static constexpr size_t update_size = 32;
+static constexpr size_t connection_counts[] = {1, 10, 100};
+
+struct run_result {
+    uint64_t updates;
+    uint64_t loops;
+    std::chrono::nanoseconds looper_cpu;
+};
+
+static run_result run(events::poller_type type, size_t connection_count, std::chrono::milliseconds duration) {
+    auto looper = std::make_shared<events::looper>(type);
+
+    std::vector<int> write_ends;
+    std::atomic<uint64_t> received_bytes(0);
+
+    for (size_t i = 0; i < connection_count; i++) {
+        int fds[2];
+        if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, fds)) {
+            throw std::runtime_error("socketpair failed");
+        }
+
+        // the writer blocks when the looper falls behind, rather than spin
+        ::fcntl(fds[1], F_SETFL, ::fcntl(fds[1], F_GETFL) & ~O_NONBLOCK);
+        write_ends.push_back(fds[1]);
+
+        auto resource = std::make_shared<os::resource>(fds[0]);
+        looper->add(resource, events::event_in | events::event_edge,
+                    [fd = fds[0], &received_bytes](events::looper&, obsr::handle, events::event_types)->void {
+            uint8_t buffer[16 * 1024];
+            ssize_t result;
+            while ((result = ::read(fd, buffer, sizeof(buffer))) > 0) {
+                received_bytes.fetch_add(result, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    std::atomic<bool> run_looper(true);
+    uint64_t loops = 0;
+    std::chrono::nanoseconds looper_cpu(0);
+    std::thread looper_thread([&]()->void {
+        timespec start{};
+        ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+
+        while (run_looper.load()) {
+            looper->loop();
+            loops++;
+        }
+
+        timespec end{};
+        ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+        looper_cpu = std::chrono::seconds(end.tv_sec - start.tv_sec) +
+                     std::chrono::nanoseconds(end.tv_nsec - start.tv_nsec);
+    });
+
+    // the first loop registers the connections
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    uint8_t update[update_size];
+    memset(update, 0xab, sizeof(update));
+
+    uint64_t sent = 0;
+    const auto end = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < end) {
+        // checking the time is costly next to a write, so do it once per round
+        for (const auto fd : write_ends) {
+            if (::write(fd, update, sizeof(update)) != sizeof(update)) {
+                throw std::runtime_error("write failed");
+            }
+        }
+
+        sent += write_ends.size();
+    }
+
+    while (received_bytes.load() < sent * update_size) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    run_looper.store(false);
+    looper->signal_run();
+    looper_thread.join();
+
+    for (const auto fd : write_ends) {
+        ::close(fd);
+    }
+
+    return {sent, loops, looper_cpu};
+}
+
+int main(int argc, char** argv) {
+    const auto duration = std::chrono::milliseconds(argc > 1 ? static_cast<long>(std::stod(argv[1]) * 1000) : 2000);
+
+    printf("%-9s %11s %14s %16s %16s\n", "poller", "connections", "updates/s", "looper ns/update", "updates/loop");
+
+    const std::pair<events::poller_type, const char*> pollers[] = {
+            {events::poller_type::epoll, "epoll"},
+            {events::poller_type::io_uring, "io_uring"}
+    };
+    for (const auto& [type, name] : pollers) {
+        for (const auto connection_count : connection_counts) {
+            run_result result{};
+            try {
+                result = run(type, connection_count, duration);
+            } catch (const std::exception& e) {
+                printf("%-9s %11lu  failed: %s\n", name, connection_count, e.what());
+                continue;
+            }
+
+            const auto seconds = std::chrono::duration<double>(duration).count();
+            printf("%-9s %11lu %14.0f %16.1f %16.1f\n",
+                   name,
+                   connection_count,
+                   static_cast<double>(result.updates) / seconds,
+                   static_cast<double>(result.looper_cpu.count()) / static_cast<double>(result.updates),
+                   static_cast<double>(result.updates) / static_cast<double>(result.loops));
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,165 @@
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+
+#include <obsr.h>
+
+#include <cerrno>
+#include <thread>
+
+#include "bench.h"
+
+// measures how a server copes with more clients connecting at once than it admits. all the connections
+// are opened together, in several waves, with the connections of each wave closed before the next one,
+// as when the clients of a server reconnect after a network outage.
+// a connection is admitted once the server sends it its first bytes, which it does as soon as it starts
+// handling it, and refused once the server closes it. reported for each wave are the amounts of connections
+// admitted and refused, the time until all of them were answered, and the time each admitted connection
+// waited to be admitted.
+//
+// usage: bench_reconnect_storm [port]
+
+static constexpr size_t io_thread_counts[] = {1, 4};
+static constexpr size_t max_clients = 256;
+static constexpr size_t connection_count = 300;
+static constexpr size_t wave_count = 3;
+// connections not answered by then are counted as such
+static constexpr auto answer_timeout = std::chrono::seconds(5);
+// time for the server to notice the connections of a wave were closed
+static constexpr auto wave_interval = std::chrono::milliseconds(500);
+
+struct connection {
+    int fd;
+    std::chrono::steady_clock::time_point start;
+};
+
+static sockaddr_in server_address(uint16_t port) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    return address;
+}
+
+// the server starts listening from a thread of its own, some time after being started
+static void wait_for_server(uint16_t port) {
+    auto address = server_address(port);
+
+    while (true) {
+        const auto fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        const auto result = ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        ::close(fd);
+
+        if (result == 0) {
+            break;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+static void run_wave(uint16_t port, size_t io_threads, size_t wave) {
+    auto address = server_address(port);
+
+    std::vector<connection> connections;
+    std::vector<pollfd> fds;
+    const auto start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < connection_count; i++) {
+        const auto fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        if (fd < 0) {
+            throw std::runtime_error("socket failed");
+        }
+
+        const auto result = ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        if (result != 0 && errno != EINPROGRESS) {
+            throw std::runtime_error("connect failed");
+        }
+
+        connections.push_back({fd, std::chrono::steady_clock::now()});
+        fds.push_back({fd, POLLIN, 0});
+    }
+
+    size_t admitted = 0;
+    size_t refused = 0;
+    std::vector<std::chrono::nanoseconds> admit_times;
+    auto last_answer = start;
+
+    while (admitted + refused < connection_count) {
+        const auto remaining = answer_timeout - (std::chrono::steady_clock::now() - start);
+        if (remaining <= std::chrono::nanoseconds(0)) {
+            break;
+        }
+
+        if (::poll(fds.data(), fds.size(), static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(remaining).count()) + 1) < 0) {
+            throw std::runtime_error("poll failed");
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < fds.size(); i++) {
+            if (fds[i].revents == 0) {
+                continue;
+            }
+
+            auto& connection = connections[i];
+            uint8_t buffer[64];
+            const auto result = ::read(connection.fd, buffer, sizeof(buffer));
+            if (result > 0) {
+                admitted++;
+                admit_times.push_back(now - connection.start);
+            } else if (result == 0 || errno != EAGAIN) {
+                refused++;
+            } else {
+                continue;
+            }
+
+            // answered, no need to poll it anymore
+            fds[i].fd = -1;
+            last_answer = now;
+        }
+    }
+
+    const auto summary = obsr::bench::summarize(admit_times);
+    printf("%10lu %5lu %9lu %8lu %10lu %16.1f %13.1f %13.1f\n",
+           io_threads,
+           wave,
+           admitted,
+           refused,
+           connection_count - admitted - refused,
+           std::chrono::duration<double, std::milli>(last_answer - start).count(),
+           summary.p50_us / 1000.0,
+           summary.p99_us / 1000.0);
+
+    for (const auto& connection : connections) {
+        ::close(connection.fd);
+    }
+}
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    const auto port = static_cast<uint16_t>(argc > 1 ? std::stoul(argv[1]) : 27611);
+
+    printf("%10s %5s %9s %8s %10s %16s %13s %13s\n",
+           "io threads", "wave", "admitted", "refused", "no answer", "all answered ms", "admit p50 ms", "admit p99 ms");
+    for (const auto io_threads : io_thread_counts) {
+        obsr::server_options options;
+        options.io_threads = io_threads;
+        options.max_clients = max_clients;
+        // all the connections are opened before any is accepted
+        options.listen_backlog = connection_count;
+        obsr::start_server(port, options);
+        wait_for_server(port);
+
+        for (size_t wave = 1; wave <= wave_count; wave++) {
+            std::this_thread::sleep_for(wave_interval);
+            run_wave(port, io_threads, wave);
+        }
+
+        obsr::stop_network();
+    }
+
+    return 0;
+}
@@ -0,0 +1,114 @@
+
+#include <obsr_types.h>
+
+#include <cstring>
+#include <thread>
+
+#include "internal_except.h"
+#include "bench.h"
+
+// measures the round trip over loopback tcp with different socket options. each request is sent as two
+// small writes, a header and then its body, as messages are when they do not fit in a single batch, and is
+// answered with a single write. with nagle's algorithm, the body is held back until the header is acked,
+// which the other end delays. options are applied to both ends as the library applies them, with quick
+// acks renewed after each read.
+//
+// usage: bench_socket_options [port]
+
+using namespace obsr;
+
+static constexpr size_t header_size = 4;
+static constexpr size_t body_size = 8;
+static constexpr size_t response_size = 8;
+static constexpr size_t warmup_round_trips = 10;
+static constexpr size_t max_round_trips = 20000;
+// with delayed acks, each round trip takes tens of milliseconds
+static constexpr auto max_duration = std::chrono::seconds(3);
+
+static void configure(os::socket& socket, const socket_options& options) {
+    socket.setoption<os::sockopt_nodelay>(options.no_delay);
+
+    if (options.busy_poll_us > 0) {
+        try {
+            socket.setoption<os::sockopt_busypoll>(static_cast<int>(options.busy_poll_us));
+        } catch (const io_exception&) {
+            // requires privileges above the system limit, runs without it
+        }
+    }
+}
+
+static void read_message(os::socket& socket, const socket_options& options, uint8_t* buffer, size_t size) {
+    bench::read_exact(socket, buffer, size);
+    if (options.quick_ack) {
+        socket.setoption<os::sockopt_quickack>(true);
+    }
+}
+
+static std::pair<size_t, bench::latency_summary> measure(const socket_options& options, uint16_t port) {
+    auto pair = bench::connect_pair(os::socket_domain::inet, port);
+    configure(*pair.client, options);
+    configure(*pair.server, options);
+
+    std::thread responder_thread([&pair, &options]()->void {
+        uint8_t request[header_size + body_size];
+        uint8_t response[response_size];
+        memset(response, 0, sizeof(response));
+
+        try {
+            while (true) {
+                read_message(*pair.server, options, request, sizeof(request));
+                bench::write_exact(*pair.server, response, sizeof(response));
+            }
+        } catch (const eof_exception&) {
+            // the client is done
+        }
+    });
+
+    uint8_t header[header_size];
+    uint8_t body[body_size];
+    uint8_t response[response_size];
+    memset(header, 0, sizeof(header));
+    memset(body, 0, sizeof(body));
+
+    std::vector<std::chrono::nanoseconds> samples;
+    const auto end = std::chrono::steady_clock::now() + max_duration;
+    for (size_t i = 0; i < warmup_round_trips + max_round_trips && std::chrono::steady_clock::now() < end; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        bench::write_exact(*pair.client, header, sizeof(header));
+        bench::write_exact(*pair.client, body, sizeof(body));
+        read_message(*pair.client, options, response, sizeof(response));
+        const auto round_trip = std::chrono::steady_clock::now() - start;
+
+        if (i >= warmup_round_trips) {
+            samples.push_back(round_trip);
+        }
+    }
+
+    pair.client.reset();
+    responder_thread.join();
+
+    const auto count = samples.size();
+    return {count, bench::summarize(samples)};
+}
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    const auto port = static_cast<uint16_t>(argc > 1 ? std::stoul(argv[1]) : 27613);
+
+    socket_options nagle;
+    nagle.no_delay = false;
+
+    printf("%-12s %12s %12s %12s %12s\n", "options", "round trips", "p50 us", "p99 us", "max us");
+
+    const std::pair<socket_options, const char*> runs[] = {
+            {nagle, "nagle"},
+            {socket_options(), "default"},
+            {socket_options::low_latency(), "low_latency"}
+    };
+    for (const auto& [options, name] : runs) {
+        const auto [count, summary] = measure(options, port);
+        printf("%-12s %12lu %12.1f %12.1f %12.1f\n", name, count, summary.p50_us, summary.p99_us, summary.max_us);
+    }
+
+    return 0;
+}
@@ -4,6 +4,10 @@
 #include <functional>
 #include <chrono>
 #include <ostream>
+#include <span>
+#include <utility>
+#include <vector>
+#include <optional>
 
 #include "obsr_types.h"
 
@@ -210,6 +214,22 @@ void delete_entry(entry entry);
  */
 uint32_t probe(entry entry);
 
+/**
+ * Sets a flag on an entry. Flags are local to this node and are not synchronized over the network.
+ *
+ * @param entry entry
+ * @param flag flag to set
+ */
+void set_entry_flag(entry entry, entry_flag flag);
+
+/**
+ * Clears a flag from an entry.
+ *
+ * @param entry entry
+ * @param flag flag to clear
+ */
+void clear_entry_flag(entry entry, entry_flag flag);
+
 /**
  * Gets the value associated with a given entry.
  *
@@ -220,6 +240,31 @@ uint32_t probe(entry entry);
  */
 obsr::value get_value(entry entry);
 
+/**
+ * Gets the values associated with several entries at once. The values are read together, so they
+ * are consistent with each other: no change made in between (locally or by a remote node) is seen
+ * for only some of them.
+ *
+ * Unlike get_value, no exception is thrown for entries which don't exist or have no value.
+ *
+ * @param entries entries to get the values of
+ * @return for each entry, in the same order, its value or nothing if it has no value.
+ */
+std::vector<std::optional<obsr::value>> get_values(std::span<const entry> entries);
+
+/**
+ * Takes a consistent, point-in-time copy of the values of all entries under an object, including those
+ * of its children.
+ *
+ * Values share their data (such as that of arrays and strings) and it is never changed once set, so taking
+ * a snapshot does not copy the data, and later changes to the entries do not affect the snapshot.
+ * The result may be passed to set_values to restore the entries to the values in the snapshot.
+ *
+ * @param obj object to take a snapshot of
+ * @return the entries under the object which have a value, with their values.
+ */
+std::vector<std::pair<entry, obsr::value>> snapshot(object obj);
+
 /**
  * Sets the value associated with a given entry.
  *
@@ -233,6 +278,20 @@ obsr::value get_value(entry entry);
  */
 void set_value(entry entry, const obsr::value& value);
 
+/**
+ * Sets the values of several entries at once, as a transaction. Either all values are set, or none are
+ * if any of them cannot be (for example, if the type of the value does not match that of the entry).
+ *
+ * Entries which do not exist are created. An entry may appear more than once, in which case its last value
+ * is the one kept.
+ *
+ * The events generated are the same as calling set_value for each entry, but are delivered one after another,
+ * with no other event between them. Remote nodes apply the values together, so they never see only some of them.
+ *
+ * @param values pairs of entry and value to set
+ */
+void set_values(std::span<const std::pair<entry, obsr::value>> values);
+
 /**
  * Clears the value associated with a given entry. Effectively setting the value to an empty value.
  *
@@ -278,23 +337,149 @@ void delete_listener(listener listener);
  * data among each other.
  *
  * @param bind_port port to bind server to.
+ * @param options configuration of the server connection handling.
  */
-void start_server(uint16_t bind_port);
+void start_server(uint16_t bind_port, const server_options& options = {});
 
 /**
  * Starts network services as a client node, automatically connecting to a remote server (if it is online)
  * and synchronizing data with it and other clients connected to the server.
  *
- * @param address server ip address
+ * Pass "shm" as the address to connect to a server running on the same host over shared memory (see
+ * server_options::shared_memory), or "unix:<path>" to connect over the unix domain socket the server listens on at path (see
+ * server_options::local_path), instead of tcp. The port is not used for unix domain sockets.
+ *
+ * @param address server ip address, "shm" or "unix:<path>"
  * @param server_port server port
+ * @param options configuration of the connection to the server.
+ */
+void start_client(std::string_view address, uint16_t server_port, const client_options& options = {});
+
+/**
+ * Starts receiving the entries at or under the given path from the server, in addition to any
+ * other subscriptions. Only valid while running as a client.
+ *
+ * @param path path of an object or entry.
+ */
+void subscribe(std::string_view path);
+
+/**
+ * Stops receiving updates to entries at or under the given path, unless covered by another subscription.
+ * Entries already received are kept as is. Only valid while running as a client.
+ *
+ * @param path path previously passed to subscribe, or in client_options::subscriptions.
  */
-void start_client(std::string_view address, uint16_t server_port);
+void unsubscribe(std::string_view path);
+
+/**
+ * Gets counters of the running network services, such as how well messages compress
+ * (see socket_options::compression). Only valid while network services are running.
+ *
+ * @return counters since the network services were started.
+ */
+network_stats get_network_stats();
 
 /**
  * Stops any active network services.
  */
 void stop_network();
 
+/**
+ * Saves the entries which have a value, with their values and times of update, to a snapshot file.
+ * The file is replaced at once, so it is never seen partially written.
+ *
+ * Entries are read together, as with get_values, and the file is written after. Changes logged next to the file
+ * are then removed, as the snapshot has all of them, unless they are being logged by start_persistence at the moment.
+ *
+ * @param path path of the file
+ */
+void save_snapshot(std::string_view path);
+
+/**
+ * Loads the entries saved in a snapshot file by save_snapshot. This is meant to be done at startup, before
+ * network services start, so that the last known state is available right away.
+ *
+ * Entries are loaded as if received from a remote node: they are not sent to a server, and values which are newer
+ * there replace them once connected. When running as a server, they are sent to clients.
+ * Entries which changed locally after the snapshot was taken keep their values.
+ *
+ * Changes logged next to the snapshot, when saved with persistence_options::log_changes, are replayed after it.
+ *
+ * If the file is malformed, obsr::invalid_snapshot_exception is thrown and nothing is loaded. If a log is malformed,
+ * obsr::invalid_change_log_exception is thrown, naming the log, after the snapshot was loaded.
+ *
+ * @param path path of the file
+ * @return false if there is neither a snapshot nor a log at the path, true otherwise.
+ */
+bool load_snapshot(std::string_view path);
+
+/**
+ * Loads the snapshot file at the path, if there is one, and then keeps it up to date: each interval in which entries
+ * changed, they are saved to it. They are saved a last time once stopped, or when the program exits.
+ *
+ * Saving is done in the background, from the thread which also handles network services.
+ *
+ * @param path path of the file
+ * @param save_interval time between checks for changes
+ */
+void start_persistence(std::string_view path, std::chrono::milliseconds save_interval = std::chrono::seconds(5));
+
+/**
+ * Same as start_persistence with an interval, but configured by the given options.
+ *
+ * With persistence_options::log_changes, each change to an entry is also appended to a log next to the snapshot
+ * file (at its path, with ".log" added). Changes are copied aside when made, and written to the log in the
+ * background, together with the other changes made in the same persistence_options::log_sync_interval.
+ * A crash thus loses at most the changes of the last interval, and the call making a change never waits for the disk.
+ *
+ * The log is replayed after the snapshot is loaded, here or by load_snapshot. Once it grows beyond
+ * persistence_options::log_compact_size, it is compacted into the snapshot in the background: a new log is
+ * started, and the old one is removed once the snapshot is saved.
+ *
+ * @param path path of the snapshot file
+ * @param options configuration of how entries are saved
+ */
+void start_persistence(std::string_view path, const persistence_options& options);
+
+/**
+ * Stops saving entries to the file given to start_persistence, after saving them a last time.
+ */
+void stop_persistence();
+
+/**
+ * Starts recording the events delivered to listeners (see listen_object and listen_entry) to a file, with the
+ * times they were made at. Events are recorded whether there are listeners or not, so the file holds every change
+ * made to entries, whether locally or by remote nodes. It may be fed back with replay_recording.
+ *
+ * Events are written to the file in the background, so that recording does not delay changes or their delivery.
+ * Should the writing fall behind by too much, events are dropped.
+ *
+ * @param path path of the file, which is replaced if there is one already
+ */
+void start_recording(std::string_view path);
+
+/**
+ * Stops recording events, once all those recorded so far are written to the file.
+ */
+void stop_recording();
+
+/**
+ * Applies the events of a file written by start_recording, in the order they were recorded. Changes are made as if
+ * locally, so they generate events and are sent to remote nodes when network services are running.
+ *
+ * Events are spaced by the time between them when recorded, divided by the speed: 1 replays them as they happened,
+ * 2 twice as fast and so on. With a speed of 0, they are applied as fast as possible. This call returns once all of them
+ * were applied.
+ *
+ * If the file is malformed, obsr::invalid_recording_exception is thrown. A file which was not fully written, such
+ * as if the program recording it crashed, is replayed up to where it ends.
+ *
+ * @param path path of the file
+ * @param speed speed to replay events at, relative to the one they were recorded at
+ * @return the amount of events applied
+ */
+size_t replay_recording(std::string_view path, double speed = 1.0);
+
 }
 
 // these are textual and should not be used to store in file or send
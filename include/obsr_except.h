@@ -127,6 +127,60 @@ private:
     std::string m_name;
 };
 
+class invalid_snapshot_exception : public exception {
+public:
+    explicit invalid_snapshot_exception(std::string path)
+        : m_path(std::move(path))
+    {}
+
+    [[nodiscard]] const std::string& get_path() const {
+        return m_path;
+    }
+
+    [[nodiscard]] const char* what() const noexcept override {
+        return "snapshot file is malformed or of an unknown version";
+    }
+
+private:
+    std::string m_path;
+};
+
+class invalid_change_log_exception : public exception {
+public:
+    explicit invalid_change_log_exception(std::string path)
+        : m_path(std::move(path))
+    {}
+
+    [[nodiscard]] const std::string& get_path() const {
+        return m_path;
+    }
+
+    [[nodiscard]] const char* what() const noexcept override {
+        return "change log file is malformed or of an unknown version";
+    }
+
+private:
+    std::string m_path;
+};
+
+class invalid_recording_exception : public exception {
+public:
+    explicit invalid_recording_exception(std::string path)
+        : m_path(std::move(path))
+    {}
+
+    [[nodiscard]] const std::string& get_path() const {
+        return m_path;
+    }
+
+    [[nodiscard]] const char* what() const noexcept override {
+        return "recording file is malformed or of an unknown version";
+    }
+
+private:
+    std::string m_path;
+};
+
 class entry_does_not_exist_exception : public exception {
 public:
     explicit entry_does_not_exist_exception(obsr::entry entry)
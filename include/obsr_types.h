@@ -4,6 +4,7 @@
 #include <cstddef>
 #include <functional>
 #include <string>
+#include <vector>
 #include <chrono>
 #include <cassert>
 #include <span>
@@ -21,7 +22,9 @@ constexpr handle empty_handle = static_cast<handle>(-1);
 constexpr uint32_t entry_not_exists = static_cast<uint32_t>(-1);
 
 enum class entry_flag : uint8_t {
-
+    // updates to the entry may be lost, in exchange for being delivered to clients over multicast
+    // (when enabled by the server), instead of over each client's connection.
+    best_effort = (1 << 0)
 };
 
 enum class value_type : uint8_t {
@@ -236,7 +239,7 @@ public:
     }
 
     inline void set_float_array(std::span<const float> value) {
-        m_type = value_type::integer64_array;
+        m_type = value_type::floating_point32_array;
 
         auto data = create_array(value);
         m_value.floating_point32_array.arr = data.get();
@@ -257,7 +260,7 @@ public:
     }
 
     inline void set_double_array(std::span<const double> value) {
-        m_type = value_type::integer64_array;
+        m_type = value_type::floating_point64_array;
 
         auto data = create_array(value);
         m_value.floating_point64_array.arr = data.get();
@@ -483,4 +486,95 @@ private:
 
 using listener_callback = std::function<void(const event&)>;
 
+// options of tcp connections. ignored for connections over shared memory or unix domain sockets.
+struct socket_options {
+    // send small messages immediately instead of holding them back to be coalesced (nagle's
+    // algorithm). messages are batched before being written anyway, so this is on by default.
+    bool no_delay = true;
+    // acknowledge received data immediately, instead of delaying acks in the hope of
+    // sending them together with data.
+    bool quick_ack = false;
+    // sizes of the kernel send and receive buffers, in bytes. 0 keeps the system default.
+    int send_buffer_size = 0;
+    int receive_buffer_size = 0;
+    // time to busy poll the device for new data when waiting on the socket, in microseconds.
+    // 0 disables. values above net.core.busy_read require CAP_NET_ADMIN, and are ignored without it.
+    uint32_t busy_poll_us = 0;
+    // compress batches of messages sent to peers which support it, trading cpu time for bandwidth.
+    // only takes effect if the library was built with zlib.
+    bool compression = false;
+    // batches smaller than this, in bytes, are sent uncompressed.
+    size_t compression_threshold = 128;
+
+    // trades cpu time for lower latency of each update.
+    static inline socket_options low_latency() {
+        socket_options options;
+        options.no_delay = true;
+        options.quick_ack = true;
+        options.busy_poll_us = 50;
+        return options;
+    }
+};
+
+struct server_options {
+    // amount of threads handling client connections. with more than one thread,
+    // clients are split between dedicated threads.
+    size_t io_threads = 1;
+    // amount of pending connections the system may queue before they are accepted.
+    size_t listen_backlog = 128;
+    // connections beyond this amount are closed as soon as they are accepted. each io thread handles up to about
+    // 250 clients, and the amount is lowered to what the io threads can handle if above it.
+    size_t max_clients = 256;
+    // allow clients on the same host to connect over shared memory instead of tcp. any local user which can
+    // reach the listener may connect, so this is off unless asked for.
+    bool shared_memory = false;
+    // if not empty, clients on the same host may also connect over a unix domain socket at this path.
+    std::string local_path;
+    // if not empty, updates to entries flagged as best effort are sent once to this multicast group
+    // instead of to each client. clients learn of the group when connecting.
+    std::string multicast_group;
+    // udp port of the multicast group. if 0, the bind port is used.
+    uint16_t multicast_port = 0;
+    // applied to each tcp connection with a client.
+    socket_options sockets;
+    // amount of recent changes remembered, so that clients which reconnect are sent only what changed
+    // while they were away. clients which were away for longer are sent everything.
+    size_t session_log_size = 4096;
+};
+
+struct client_options {
+    // applied to the tcp connection with the server.
+    socket_options sockets;
+    // paths of the objects or entries to receive from the server, along with anything under them.
+    // by default, everything is received.
+    std::vector<std::string> subscriptions = {"/"};
+};
+
+struct persistence_options {
+    // time between checks for changes, after which the snapshot is saved if entries changed.
+    // not used when changes are logged, in which case the snapshot is saved as the log grows.
+    std::chrono::milliseconds save_interval = std::chrono::seconds(5);
+    // append each change to a log next to the snapshot file, so that changes are kept soon after they
+    // are made, without saving all the entries each time.
+    bool log_changes = false;
+    // changes are written to the log together, once in each interval, and synced to the disk along.
+    // a crash loses at most the changes made in the last interval.
+    std::chrono::milliseconds log_sync_interval = std::chrono::milliseconds(100);
+    // once the log grows beyond this size, in bytes, it is compacted into the snapshot.
+    size_t log_compact_size = 4 * 1024 * 1024;
+};
+
+// counters of the running network services, since they were started.
+struct network_stats {
+    // batches of messages sent compressed, and their size before and after compression.
+    uint64_t compressed_batches = 0;
+    uint64_t bytes_before_compression = 0;
+    uint64_t bytes_after_compression = 0;
+    // cpu time spent compressing them.
+    std::chrono::nanoseconds compress_time{0};
+    // compressed batches received, and the cpu time spent decompressing them.
+    uint64_t decompressed_batches = 0;
+    std::chrono::nanoseconds decompress_time{0};
+};
+
 }
@@ -7,6 +7,7 @@
 #include "events.h"
 #include "util/time.h"
 #include "os/poller.h"
+#include "os/uring_poller.h"
 
 namespace obsr::events {
 
@@ -14,12 +15,28 @@ namespace obsr::events {
 
 static constexpr auto initial_poll_timeout = std::chrono::milliseconds(1000);
 static constexpr auto min_poll_timeout = std::chrono::milliseconds(100);
-static constexpr size_t max_events_for_process = 20;
+static constexpr size_t initial_events_batch = 32;
+static constexpr size_t max_requests_for_process = 1024;
+
+static std::unique_ptr<poller> create_poller(poller_type type) {
+    switch (type) {
+        case poller_type::epoll:
+            return std::make_unique<os::resource_poller>();
+        case poller_type::io_uring:
+            return std::make_unique<os::uring_poller>();
+        default:
+            throw illegal_argument_exception("unsupported poller type");
+    }
+}
 
 polled_events::polled_events(event_data* data)
     : m_data(data)
 {}
 
+size_t polled_events::count() const {
+    return m_data->count();
+}
+
 polled_events::iterator polled_events::begin() const {
     return {m_data, 0};
 }
@@ -28,24 +45,37 @@ polled_events::iterator polled_events::end() const {
     return {m_data, m_data->count()};
 }
 
-looper::looper(std::unique_ptr<poller>&& poller)
+looper::looper(std::unique_ptr<poller>&& poller, size_t max_events_batch)
     : m_mutex()
-    , m_loop_finish()
     , m_poller(std::move(poller))
     , m_handles()
     , m_fd_map()
+    , m_removed()
+    , m_notified()
     , m_updates()
     , m_execute_requests()
+    , m_execute_signaled(false)
     , m_run_signal(std::make_shared<os::signal>())
     , m_timer_handles()
-    , m_timeout(initial_poll_timeout) {
+    , m_timeout(initial_poll_timeout)
+    , m_events_batch(std::min(initial_events_batch, max_events_batch))
+    , m_max_events_batch(max_events_batch)
+    , m_thread_id() {
+    if (max_events_batch < 1) {
+        throw illegal_argument_exception("events batch must not be empty");
+    }
+
     add(m_run_signal, event_in, [this](looper& looper, obsr::handle handle, event_types events)->void {
         m_run_signal->clear();
     });
 }
 
+looper::looper(poller_type type, size_t max_events_batch)
+    : looper(create_poller(type), max_events_batch)
+{}
+
 looper::looper()
-    : looper(std::make_unique<os::resource_poller>())
+    : looper(poller_type::epoll)
 {}
 
 void looper::signal_run() {
@@ -66,13 +96,16 @@ obsr::handle looper::add(std::shared_ptr<os::resource> resource, event_types eve
     auto data = m_handles[handle];
     data->handle = handle;
     data->resource = std::move(resource);
-    data->events = 0;
+    data->events = events;
+    data->registered_events = 0;
+    data->notified_events = 0;
+    data->removed = false;
     data->callback = std::move(callback);
 
     m_fd_map.emplace(descriptor, data);
-    m_updates.push_back({handle, update_type::add, events});
+    m_updates.push_back({handle, update_type::add});
 
-    signal_run();
+    wakeup();
 
     return handle;
 }
@@ -85,8 +118,12 @@ void looper::remove(obsr::handle handle) {
     }
 
     auto data = m_handles.release(handle);
+    data->removed = true;
     m_fd_map.erase(data->resource->get_descriptor());
-    m_poller->remove(*data->resource);
+
+    auto& resource = *data->resource;
+    m_removed.push_back(std::move(data));
+    m_poller->remove(resource);
 
     signal_run();
 }
@@ -98,23 +135,48 @@ void looper::request_updates(obsr::handle handle, event_types events, events_upd
         throw no_such_handle_exception(handle);
     }
 
-    update_type update_type;
+    auto data = m_handles[handle];
+
+    event_types new_events;
     switch (type) {
         case events_update_type::override:
-            update_type = update_type::new_events;
+            new_events = events;
             break;
         case events_update_type::append:
-            update_type = update_type::new_events_add;
+            new_events = data->events | events;
             break;
         case events_update_type::remove:
-            update_type = update_type::new_events_remove;
+            new_events = data->events & ~events;
             break;
         default:
             throw std::runtime_error("unsupported event type");
     }
 
-    m_updates.push_back({handle, update_type, events});
-    signal_run();
+    if (new_events == data->events) {
+        // nothing changes, so there is no need to touch the poller
+        return;
+    }
+
+    data->events = new_events;
+    m_updates.push_back({handle, update_type::new_events});
+
+    wakeup();
+}
+
+void looper::notify(obsr::handle handle, event_types events) {
+    std::unique_lock lock(m_mutex);
+
+    if (!m_handles.has(handle)) {
+        throw no_such_handle_exception(handle);
+    }
+
+    auto data = m_handles[handle];
+    if (data->notified_events == 0) {
+        m_notified.push_back(handle);
+    }
+    data->notified_events |= events;
+
+    wakeup();
 }
 
 obsr::handle looper::create_timer(std::chrono::milliseconds timeout, timer_callback callback) {
@@ -151,37 +213,82 @@ void looper::stop_timer(obsr::handle handle) {
 }
 
 void looper::request_execute(generic_callback callback, execute_type type) {
-    std::unique_lock lock(m_mutex);
+    if (type == execute_type::sync && is_looper_thread()) {
+        // waiting for ourselves will never finish, just run it
+        callback(*this);
+        return;
+    }
 
+    std::promise<void> done;
+    std::future<void> done_future;
     execute_request request{};
     request.callback = std::move(callback);
-    m_execute_requests.push_back(request);
+    request.done = nullptr;
+    if (type == execute_type::sync) {
+        done_future = done.get_future();
+        request.done = &done;
+    }
 
-    signal_run();
+    m_execute_requests.push(std::move(request));
+
+    // the loop clears the flag before draining requests, so only the first request
+    // since then needs to wake it up.
+    if (!is_looper_thread() && !m_execute_signaled.exchange(true)) {
+        signal_run();
+    }
 
     if (type == execute_type::sync) {
-        // this is kind of a cheat since we wait for everything in the loop
-        // to run
-        m_loop_finish.wait(lock, [&]()->bool {
-            return m_execute_requests.empty();
-        });
+        // only waits for this request, and rethrows any error from it
+        done_future.get();
     }
 }
 
+size_t looper::get_free_resources() {
+    std::unique_lock lock(m_mutex);
+
+    return max_resources - m_handles.size();
+}
+
 void looper::loop() {
     std::unique_lock lock(m_mutex);
 
+    m_thread_id.store(std::this_thread::get_id());
+
+    // events of the previous poll are done, so nothing can point to these anymore
+    m_removed.clear();
     process_updates();
 
+    // work queued from inside the loop does not signal it, so don't wait for it
+    auto timeout = m_timeout;
+    if (!m_notified.empty() || !m_execute_requests.empty()) {
+        timeout = std::chrono::milliseconds(0);
+    }
+
+    const auto batch = m_events_batch;
     lock.unlock();
-    auto result = m_poller->poll(max_events_for_process, m_timeout);
+    auto result = m_poller->poll(batch, timeout);
     lock.lock();
 
+    if (result.count() >= batch && m_events_batch < m_max_events_batch) {
+        // more events may have been waiting, allow more of them to be handled in one go
+        m_events_batch = std::min(m_events_batch * 2, m_max_events_batch);
+    }
+
     process_events(lock, result);
+    process_notified(lock);
     process_timers(lock);
     execute_requests(lock);
+}
 
-    m_loop_finish.notify_all();
+bool looper::is_looper_thread() const {
+    return m_thread_id.load() == std::this_thread::get_id();
+}
+
+void looper::wakeup() {
+    // when called from the loop itself, the work is picked up before polling again
+    if (!is_looper_thread()) {
+        signal_run();
+    }
 }
 
 void looper::process_updates() {
@@ -202,50 +309,67 @@ void looper::process_update(update& update) {
 
     switch (update.type) {
         case update_type::add:
-            data->events = update.events;
-            m_poller->add(*data->resource, data->events);
+            m_poller->add(*data->resource, data->events, data);
+            data->registered_events = data->events;
             break;
         case update_type::new_events:
-            data->events = update.events;
-            m_poller->set(*data->resource, data->events);
-            break;
-        case update_type::new_events_add:
-            data->events |= update.events;
-            m_poller->set(*data->resource, data->events);
-            break;
-        case update_type::new_events_remove:
-            data->events &= ~update.events;
-            m_poller->set(*data->resource, data->events);
+            if (data->registered_events == data->events) {
+                // several updates may cancel each other out
+                break;
+            }
+
+            m_poller->set(*data->resource, data->events, data);
+            data->registered_events = data->events;
             break;
     }
 }
 
 void looper::process_events(std::unique_lock<std::mutex>& lock, polled_events& events) {
-    for (auto [fd, revents] : events) {
-        auto it = m_fd_map.find(fd);
-        if (it == m_fd_map.end()) {
+    for (auto [context, revents] : events) {
+        auto data = static_cast<resource_data*>(context);
+        if (data->removed) {
             continue;
         }
 
-        auto data = it->second;
+        invoke_callback(lock, data, revents);
+    }
+}
+
+void looper::process_notified(std::unique_lock<std::mutex>& lock) {
+    // notifications made by the callbacks are handled in the next loop
+    std::deque<obsr::handle> notified;
+    notified.swap(m_notified);
 
-        auto adjusted_flags = (data->events & revents);
-        if (adjusted_flags == 0) {
+    for (auto handle : notified) {
+        if (!m_handles.has(handle)) {
             continue;
         }
 
-        lock.unlock();
-        try {
-            data->callback(*this, data->handle, adjusted_flags);
-        } catch (const std::exception& e) {
-            TRACE_ERROR(LOG_MODULE, "Error in io callback: what=%s", e.what());
-        } catch (...) {
-            TRACE_ERROR(LOG_MODULE, "Error in io callback: unknown");
-        }
-        lock.lock();
+        auto data = m_handles[handle];
+        const auto events = data->notified_events;
+        data->notified_events = 0;
+
+        invoke_callback(lock, data, events);
     }
 }
 
+void looper::invoke_callback(std::unique_lock<std::mutex>& lock, resource_data* data, event_types events) {
+    auto adjusted_flags = (data->events & events);
+    if (adjusted_flags == 0) {
+        return;
+    }
+
+    lock.unlock();
+    try {
+        data->callback(*this, data->handle, adjusted_flags);
+    } catch (const std::exception& e) {
+        TRACE_ERROR(LOG_MODULE, "Error in io callback: what=%s", e.what());
+    } catch (...) {
+        TRACE_ERROR(LOG_MODULE, "Error in io callback: unknown");
+    }
+    lock.lock();
+}
+
 void looper::process_timers(std::unique_lock<std::mutex>& lock) {
     std::vector<obsr::handle> to_remove;
     const auto now = time_now();
@@ -279,20 +403,38 @@ void looper::process_timers(std::unique_lock<std::mutex>& lock) {
 }
 
 void looper::execute_requests(std::unique_lock<std::mutex>& lock) {
-    while (!m_execute_requests.empty()) {
-        auto& request = m_execute_requests.front();
+    m_execute_signaled.store(false);
 
-        lock.unlock();
-        try {
-            request.callback(*this);
-        } catch (const std::exception& e) {
-            TRACE_ERROR(LOG_MODULE, "Error in request callback: what=%s", e.what());
-        } catch (...) {
-            TRACE_ERROR(LOG_MODULE, "Error in request callback: unknown");
+    lock.unlock();
+    // requests made by the callbacks may be picked up as well, so limit how many
+    // run in a single loop.
+    for (size_t i = 0; i < max_requests_for_process; ++i) {
+        auto request_opt = m_execute_requests.pop();
+        if (!request_opt) {
+            break;
         }
-        lock.lock();
 
-        m_execute_requests.pop_front();
+        execute_request_callback(request_opt.value());
+    }
+    lock.lock();
+}
+
+void looper::execute_request_callback(execute_request& request) {
+    try {
+        request.callback(*this);
+        if (request.done != nullptr) {
+            request.done->set_value();
+        }
+    } catch (const std::exception& e) {
+        TRACE_ERROR(LOG_MODULE, "Error in request callback: what=%s", e.what());
+        if (request.done != nullptr) {
+            request.done->set_exception(std::current_exception());
+        }
+    } catch (...) {
+        TRACE_ERROR(LOG_MODULE, "Error in request callback: unknown");
+        if (request.done != nullptr) {
+            request.done->set_exception(std::current_exception());
+        }
     }
 }
 
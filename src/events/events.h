@@ -7,12 +7,14 @@
 #include <thread>
 #include <atomic>
 #include <deque>
-#include <condition_variable>
+#include <vector>
+#include <future>
 
 #include "obsr_types.h"
 #include "os/io.h"
 #include "util/handles.h"
 #include "os/signal.h"
+#include "util/mpsc_queue.h"
 
 namespace obsr::events {
 
@@ -22,7 +24,11 @@ enum event_type : event_types {
     event_in = (0x1 << 0),
     event_out = (0x1 << 1),
     event_error = (0x1 << 2),
-    event_hung = (0x1 << 3)
+    event_hung = (0x1 << 3),
+    // not an event, but a mode of registration. events are only reported
+    // when the state of the resource changes (edge-triggered), so callbacks must
+    // consume all the available data.
+    event_edge = (0x1 << 4)
 };
 
 class event_data {
@@ -31,7 +37,8 @@ public:
 
     virtual size_t count() const = 0;
 
-    virtual os::descriptor get_descriptor(size_t index) const = 0;
+    // the context given to the poller when the resource was registered
+    virtual void* get_context(size_t index) const = 0;
     virtual event_types get_events(size_t index) const = 0;
 };
 
@@ -41,7 +48,7 @@ public:
     public:
         using iterator_category = std::forward_iterator_tag;
         using difference_type   = std::ptrdiff_t;
-        using value_type        = std::pair<os::descriptor, event_types>;
+        using value_type        = std::pair<void*, event_types>;
 
         iterator(event_data* data, size_t index)
             : m_data(data)
@@ -49,9 +56,9 @@ public:
         {}
 
         value_type operator*() const {
-            auto descriptor = m_data->get_descriptor(m_index);
+            auto context = m_data->get_context(m_index);
             auto events = m_data->get_events(m_index);
-            return {descriptor, events};
+            return {context, events};
         }
 
         iterator& operator++() {
@@ -73,6 +80,8 @@ public:
 
     explicit polled_events(event_data* data);
 
+    size_t count() const;
+
     iterator begin() const;
     iterator end() const;
 
@@ -84,13 +93,18 @@ class poller {
 public:
     virtual ~poller() = default;
 
-    virtual void add(os::resource& resource, event_types events) = 0;
-    virtual void set(os::resource& resource, event_types events) = 0;
+    virtual void add(os::resource& resource, event_types events, void* context) = 0;
+    virtual void set(os::resource& resource, event_types events, void* context) = 0;
     virtual void remove(os::resource& resource) = 0;
 
     virtual polled_events poll(size_t max_events, std::chrono::milliseconds timeout) = 0;
 };
 
+enum class poller_type {
+    epoll,
+    io_uring
+};
+
 class looper final {
 public:
     using generic_callback = std::function<void(looper&)>;
@@ -107,7 +121,12 @@ public:
         sync
     };
 
-    explicit looper(std::unique_ptr<poller>&& poller);
+    static constexpr size_t default_max_events_batch = 1024;
+    // the looper uses one of these for itself
+    static constexpr size_t max_resources = 256;
+
+    explicit looper(std::unique_ptr<poller>&& poller, size_t max_events_batch = default_max_events_batch);
+    explicit looper(poller_type type, size_t max_events_batch = default_max_events_batch);
     looper();
 
     void signal_run();
@@ -117,19 +136,29 @@ public:
     // for crashing.
     void remove(obsr::handle handle);
     void request_updates(obsr::handle handle, event_types events, events_update_type type = events_update_type::override);
+    // invokes the callback of the resource from the loop with the given events, as if they were polled.
+    // multiple calls before the callback is invoked are merged.
+    void notify(obsr::handle handle, event_types events);
 
     obsr::handle create_timer(std::chrono::milliseconds timeout, timer_callback callback);
     void stop_timer(obsr::handle handle);
 
     void request_execute(generic_callback callback, execute_type type = execute_type::async);
 
+    // amount of resources which may still be added
+    size_t get_free_resources();
+
     void loop();
 
 private:
     struct resource_data {
         obsr::handle handle;
         std::shared_ptr<obsr::os::resource> resource;
+        // events requested by the user and events currently registered in the poller
         event_types events;
+        event_types registered_events;
+        event_types notified_events;
+        bool removed;
         io_callback callback;
     };
     struct timer_data {
@@ -139,35 +168,47 @@ private:
     };
     enum class update_type {
         add,
-        new_events,
-        new_events_add,
-        new_events_remove,
+        new_events
     };
     struct update {
         obsr::handle handle;
         update_type type;
-        event_types events;
     };
     struct execute_request {
         generic_callback callback;
+        // set for sync requests, owned by the waiting caller
+        std::promise<void>* done;
     };
 
+    bool is_looper_thread() const;
+    void wakeup();
+
     void process_updates();
     void process_update(update& update);
     void process_events(std::unique_lock<std::mutex>& lock, polled_events& events);
+    void process_notified(std::unique_lock<std::mutex>& lock);
+    void invoke_callback(std::unique_lock<std::mutex>& lock, resource_data* data, event_types events);
     void process_timers(std::unique_lock<std::mutex>& lock);
     void execute_requests(std::unique_lock<std::mutex>& lock);
+    void execute_request_callback(execute_request& request);
 
     std::mutex m_mutex;
-    std::condition_variable m_loop_finish;
     std::unique_ptr<poller> m_poller;
-    handle_table<resource_data, 256> m_handles;
+    handle_table<resource_data, max_resources> m_handles;
     std::unordered_map<os::descriptor, resource_data*> m_fd_map;
+    // removed resources are kept until the next loop, as events already polled may point to them
+    std::vector<std::unique_ptr<resource_data>> m_removed;
+    std::deque<obsr::handle> m_notified;
     std::deque<update> m_updates;
-    std::deque<execute_request> m_execute_requests;
+    // may be pushed from any thread without taking the mutex, drained by the loop
+    mpsc_queue<execute_request> m_execute_requests;
+    std::atomic<bool> m_execute_signaled;
     std::shared_ptr<os::signal> m_run_signal;
     handle_table<timer_data, 16> m_timer_handles;
     std::chrono::milliseconds m_timeout;
+    size_t m_events_batch;
+    size_t m_max_events_batch;
+    std::atomic<std::thread::id> m_thread_id;
 };
 
 class looper_thread final {
@@ -48,7 +48,10 @@ instance::instance()
     , m_storage(std::make_shared<storage::storage>(m_listener_storage, m_clock))
     , m_looper(std::make_shared<events::looper>())
     , m_looper_thread(m_looper)
+    , m_persistence(m_storage)
+    , m_recorder(m_listener_storage)
     , m_net_interface()
+    , m_net_client()
     , m_objects()
     , m_object_paths()
     , m_root(m_objects.allocate_new("", "")) {
@@ -56,6 +59,22 @@ instance::instance()
 
 instance::~instance() {
     stop_network();
+
+    if (m_persistence.is_running()) {
+        try {
+            m_persistence.stop();
+        } catch (const std::exception& e) {
+            TRACE_ERROR(LOG_MODULE, "error while stopping persistence: what=%s", e.what());
+        }
+    }
+
+    if (m_recorder.is_running()) {
+        try {
+            m_recorder.stop();
+        } catch (const std::exception& e) {
+            TRACE_ERROR(LOG_MODULE, "error while stopping recording: what=%s", e.what());
+        }
+    }
 }
 
 std::chrono::milliseconds instance::time() {
@@ -203,6 +222,18 @@ uint32_t instance::probe(entry entry) {
     return m_storage->probe(entry);
 }
 
+void instance::set_entry_flag(entry entry, entry_flag flag) {
+    std::unique_lock guard(m_mutex);
+
+    m_storage->add_entry_flags(entry, static_cast<uint16_t>(flag));
+}
+
+void instance::clear_entry_flag(entry entry, entry_flag flag) {
+    std::unique_lock guard(m_mutex);
+
+    m_storage->remove_entry_flags(entry, static_cast<uint16_t>(flag));
+}
+
 obsr::value instance::get_value(entry entry) {
     std::unique_lock guard(m_mutex);
 
@@ -214,12 +245,34 @@ obsr::value instance::get_value(entry entry) {
     return std::move(opt.value());
 }
 
+std::vector<std::optional<obsr::value>> instance::get_values(std::span<const entry> entries) {
+    return m_storage->get_entry_values(entries);
+}
+
+std::vector<std::pair<entry, obsr::value>> instance::snapshot(object obj) {
+    std::string path;
+    {
+        std::unique_lock guard(m_mutex);
+
+        auto data = m_objects[obj];
+        path = data->path;
+    }
+
+    return m_storage->get_entry_values_under(path);
+}
+
 void instance::set_value(entry entry, const obsr::value& value) {
     std::unique_lock guard(m_mutex);
 
     m_storage->set_entry_value(entry, value);
 }
 
+void instance::set_values(std::span<const std::pair<entry, obsr::value>> values) {
+    std::unique_lock guard(m_mutex);
+
+    m_storage->set_entry_values(values);
+}
+
 void instance::clear_value(entry entry) {
     std::unique_lock guard(m_mutex);
 
@@ -245,7 +298,7 @@ void instance::delete_listener(listener listener) {
     m_storage->remove_listener(listener);
 }
 
-void instance::start_server(uint16_t bind_port) {
+void instance::start_server(uint16_t bind_port, const server_options& options) {
     std::unique_lock guard(m_mutex);
 
     if (m_net_interface) {
@@ -255,6 +308,7 @@ void instance::start_server(uint16_t bind_port) {
     auto network_server = std::make_shared<net::network_server>(m_clock);
     try {
         network_server->configure_bind(bind_port);
+        network_server->configure_options(options);
         start_net(network_server);
     } catch (const std::exception& e) {
         TRACE_ERROR(LOG_MODULE, "error while starting network server: what=%s", e.what());
@@ -265,7 +319,7 @@ void instance::start_server(uint16_t bind_port) {
     m_net_interface = network_server;
 }
 
-void instance::start_client(std::string_view address, uint16_t server_port) {
+void instance::start_client(std::string_view address, uint16_t server_port, const client_options& options) {
     std::unique_lock guard(m_mutex);
 
     if (m_net_interface) {
@@ -274,7 +328,8 @@ void instance::start_client(std::string_view address, uint16_t server_port) {
 
     auto network_client = std::make_shared<net::network_client>(m_clock);
     try {
-        network_client->configure_target({std::string(address), server_port});
+        network_client->configure_target(net::make_connection_info(address, server_port));
+        network_client->configure_options(options);
         start_net(network_client);
     } catch (const std::exception& e) {
         TRACE_ERROR(LOG_MODULE, "error while starting network client: what=%s", e.what());
@@ -283,6 +338,37 @@ void instance::start_client(std::string_view address, uint16_t server_port) {
     }
 
     m_net_interface = network_client;
+    m_net_client = network_client;
+}
+
+void instance::subscribe(std::string_view path) {
+    std::unique_lock guard(m_mutex);
+
+    if (!m_net_client) {
+        throw illegal_state_exception("not running as a client");
+    }
+
+    m_net_client->subscribe(path);
+}
+
+void instance::unsubscribe(std::string_view path) {
+    std::unique_lock guard(m_mutex);
+
+    if (!m_net_client) {
+        throw illegal_state_exception("not running as a client");
+    }
+
+    m_net_client->unsubscribe(path);
+}
+
+network_stats instance::get_network_stats() {
+    std::unique_lock guard(m_mutex);
+
+    if (!m_net_interface) {
+        throw illegal_state_exception("network not running");
+    }
+
+    return m_net_interface->get_stats();
 }
 
 void instance::stop_network() {
@@ -291,9 +377,38 @@ void instance::stop_network() {
     if (m_net_interface) {
         stop_net(m_net_interface);
         m_net_interface.reset();
+        m_net_client.reset();
     }
 }
 
+void instance::save_snapshot(std::string_view path) {
+    m_persistence.save(std::string(path));
+}
+
+bool instance::load_snapshot(std::string_view path) {
+    return m_persistence.load(std::string(path));
+}
+
+void instance::start_persistence(std::string_view path, const persistence_options& options) {
+    m_persistence.start(m_looper.get(), path, options);
+}
+
+void instance::stop_persistence() {
+    m_persistence.stop();
+}
+
+void instance::start_recording(std::string_view path) {
+    m_recorder.start(path);
+}
+
+void instance::stop_recording() {
+    m_recorder.stop();
+}
+
+size_t instance::replay_recording(std::string_view path, double speed) {
+    return storage::replay_recording(*m_storage, std::string(path), speed);
+}
+
 void instance::start_net(const std::shared_ptr<net::network_interface>& network_interface) {
     network_interface->attach_storage(m_storage);
     network_interface->start(m_looper.get());
@@ -5,6 +5,8 @@
 
 #include "obsr_internal.h"
 #include "storage/storage.h"
+#include "storage/persistence.h"
+#include "storage/recording.h"
 #include "net/client.h"
 #include "net/server.h"
 #include "util/time.h"
@@ -46,18 +48,35 @@ public:
     void delete_entry(entry entry);
 
     uint32_t probe(entry entry);
+    void set_entry_flag(entry entry, entry_flag flag);
+    void clear_entry_flag(entry entry, entry_flag flag);
     obsr::value get_value(entry entry);
+    std::vector<std::optional<obsr::value>> get_values(std::span<const entry> entries);
+    std::vector<std::pair<entry, obsr::value>> snapshot(object obj);
     void set_value(entry entry, const obsr::value& value);
+    void set_values(std::span<const std::pair<entry, obsr::value>> values);
     void clear_value(entry entry);
 
     listener listen_object(object obj, const listener_callback& callback);
     listener listen_entry(entry entry, const listener_callback& callback);
     void delete_listener(listener listener);
 
-    void start_server(uint16_t bind_port);
-    void start_client(std::string_view address, uint16_t server_port);
+    void start_server(uint16_t bind_port, const server_options& options);
+    void start_client(std::string_view address, uint16_t server_port, const client_options& options);
+    void subscribe(std::string_view path);
+    void unsubscribe(std::string_view path);
+    network_stats get_network_stats();
     void stop_network();
 
+    void save_snapshot(std::string_view path);
+    bool load_snapshot(std::string_view path);
+    void start_persistence(std::string_view path, const persistence_options& options);
+    void stop_persistence();
+
+    void start_recording(std::string_view path);
+    void stop_recording();
+    size_t replay_recording(std::string_view path, double speed);
+
 private:
     void start_net(const std::shared_ptr<net::network_interface>& network_interface);
     void stop_net(const std::shared_ptr<net::network_interface>& network_interface);
@@ -72,8 +91,12 @@ private:
 
     std::shared_ptr<events::looper> m_looper;
     events::looper_thread m_looper_thread;
+    storage::persistence m_persistence;
+    storage::recorder m_recorder;
 
     std::shared_ptr<net::network_interface> m_net_interface;
+    // same as the network interface, when running as a client
+    std::shared_ptr<net::network_client> m_net_client;
 
     handle_table<object_data, 256> m_objects;
     std::map<std::string, object, std::less<>> m_object_paths;
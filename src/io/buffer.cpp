@@ -1,11 +1,41 @@
 
 #include <cstring>
+#include <algorithm>
 
 #include "buffer.h"
 
 
 namespace obsr::io {
 
+shared_buffer::shared_buffer()
+    : m_data()
+    , m_size(0)
+{}
+
+shared_buffer::shared_buffer(const uint8_t* buffer, size_t size)
+    : m_data()
+    , m_size(size) {
+    if (buffer != nullptr && size > 0) {
+        auto data = std::shared_ptr<uint8_t[]>(new uint8_t[size]);
+        memcpy(data.get(), buffer, size);
+        m_data = std::move(data);
+    } else {
+        m_size = 0;
+    }
+}
+
+const uint8_t* shared_buffer::data() const {
+    return m_data.get();
+}
+
+size_t shared_buffer::size() const {
+    return m_size;
+}
+
+bool shared_buffer::empty() const {
+    return m_size < 1;
+}
+
 readonly_buffer_view::readonly_buffer_view()
     : m_buffer(nullptr)
     , m_read_pos(0)
@@ -18,18 +48,6 @@ void readonly_buffer_view::reset(const uint8_t* buffer, size_t size) {
     m_size = size;
 }
 
-bool readonly_buffer_view::read(uint8_t* buffer, size_t size) {
-    const auto space_to_max = (m_size - m_read_pos);
-    if (size > space_to_max) {
-        return false;
-    }
-
-    memcpy(buffer, m_buffer + m_read_pos, size);
-    m_read_pos += size;
-
-    return true;
-}
-
 linear_buffer::linear_buffer(size_t size)
     : m_buffer(new uint8_t[size])
     , m_write_pos(0)
@@ -56,18 +74,6 @@ void linear_buffer::reset() {
     m_write_pos = 0;
 }
 
-bool linear_buffer::write(const uint8_t* buffer, size_t size) {
-    const auto space_to_max = (m_size - m_write_pos);
-    if (size > space_to_max) {
-        return false;
-    }
-
-    memcpy(m_buffer + m_write_pos, buffer, size);
-    m_write_pos += size;
-
-    return true;
-}
-
 
 circular_buffer::circular_buffer(size_t size)
     : m_buffer(new uint8_t[size])
@@ -168,6 +174,18 @@ void circular_buffer::seek_read(size_t offset) {
     m_read_pos %= m_size;
 }
 
+size_t circular_buffer::peek(uint8_t* buffer, size_t size) {
+    size = std::min(size, read_available());
+
+    const auto read_pos = m_read_pos;
+    if (!read(buffer, size)) {
+        return 0;
+    }
+    m_read_pos = read_pos;
+
+    return size;
+}
+
 bool circular_buffer::read(uint8_t* buffer, size_t size) {
     if (size > m_size) {
         return false;
@@ -234,24 +252,25 @@ bool circular_buffer::write(const uint8_t* buffer, size_t size) {
 
 bool circular_buffer::read_from(obsr::os::readable& readable) {
     if (m_write_pos >= m_read_pos) {
-        auto space = (m_size - m_write_pos);
-        auto read = readable.read(m_buffer + m_write_pos, space);
-        if (read < space) {
+        const auto space = (m_size - m_write_pos);
+        if (space > 0) {
+            const auto read = readable.read(m_buffer + m_write_pos, space);
             m_write_pos += read;
-            return true;
+            if (read < space) {
+                return true;
+            }
         }
 
-        space = (m_read_pos - 1);
-        if (space >= 1) {
-            read = readable.read(m_buffer, space);
-            m_write_pos = read;
-            return true;
-        } else {
-            m_write_pos = space;
+        // wrap around to the start. one byte is kept free so that a full buffer
+        // does not look empty.
+        if (m_read_pos <= 1) {
             return false;
         }
+
+        m_write_pos = readable.read(m_buffer, m_read_pos - 1);
+        return true;
     } else {
-        const auto space = (m_read_pos - m_write_pos);
+        const auto space = (m_read_pos - m_write_pos - 1);
         if (space >= 1) {
             auto read = readable.read(m_buffer + m_write_pos, space);
             m_write_pos += read;
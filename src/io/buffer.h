@@ -2,8 +2,10 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
 
 #include <optional>
+#include <memory>
 
 #include "os/io.h"
 
@@ -19,15 +21,62 @@ class writable_buffer {
 public:
     virtual ~writable_buffer() = default;
     virtual bool write(const uint8_t* buffer, size_t size) = 0;
+    // returns memory for the next size bytes, to be filled in directly by the caller,
+    // or nullptr if the buffer does not support it or has no room
+    virtual uint8_t* claim(size_t) {
+        return nullptr;
+    }
+};
+
+// immutable, reference counted block of bytes. copies share the same memory, allowing
+// the same serialized data to be queued in multiple places without copying it.
+class shared_buffer {
+public:
+    shared_buffer();
+    shared_buffer(const uint8_t* buffer, size_t size);
+
+    const uint8_t* data() const;
+    size_t size() const;
+    bool empty() const;
+
+private:
+    std::shared_ptr<const uint8_t[]> m_data;
+    size_t m_size;
 };
 
-class readonly_buffer_view : public readable_buffer {
+// concrete buffers are final, so that calls made through their own type may be inlined
+class readonly_buffer_view final : public readable_buffer {
 public:
     readonly_buffer_view();
 
     void reset(const uint8_t* buffer, size_t size);
 
-    bool read(uint8_t* buffer, size_t size) override;
+    inline bool read(uint8_t* buffer, size_t size) override {
+        const auto data = consume(size);
+        if (data == nullptr) {
+            return false;
+        }
+
+        memcpy(buffer, data, size);
+        return true;
+    }
+
+    // returns the next size bytes without copying them, or nullptr if there are not enough
+    inline const uint8_t* consume(size_t size) {
+        const auto space_to_max = (m_size - m_read_pos);
+        if (size > space_to_max) {
+            return nullptr;
+        }
+
+        const auto data = m_buffer + m_read_pos;
+        m_read_pos += size;
+
+        return data;
+    }
+
+    inline size_t remaining() const {
+        return m_size - m_read_pos;
+    }
 
 private:
     const uint8_t* m_buffer;
@@ -35,7 +84,7 @@ private:
     size_t m_size;
 };
 
-class linear_buffer : public writable_buffer {
+class linear_buffer final : public writable_buffer {
 public:
     explicit linear_buffer(size_t size);
     ~linear_buffer() override;
@@ -45,7 +94,28 @@ public:
     size_t size() const;
 
     void reset();
-    bool write(const uint8_t* buffer, size_t size) override;
+
+    inline bool write(const uint8_t* buffer, size_t size) override {
+        const auto data = claim(size);
+        if (data == nullptr) {
+            return false;
+        }
+
+        memcpy(data, buffer, size);
+        return true;
+    }
+
+    inline uint8_t* claim(size_t size) override {
+        const auto space_to_max = (m_size - m_write_pos);
+        if (size > space_to_max) {
+            return nullptr;
+        }
+
+        const auto data = m_buffer + m_write_pos;
+        m_write_pos += size;
+
+        return data;
+    }
 
 private:
     uint8_t* m_buffer;
@@ -53,7 +123,7 @@ private:
     size_t m_size;
 };
 
-class circular_buffer : public readable_buffer, public writable_buffer {
+class circular_buffer final : public readable_buffer, public writable_buffer {
 public:
     explicit circular_buffer(size_t size);
     ~circular_buffer() override;
@@ -69,6 +139,8 @@ public:
     bool find_and_seek_read(uint8_t byte);
     void seek_read(size_t offset);
 
+    // copies up to size bytes without consuming them. returns the amount copied.
+    size_t peek(uint8_t* buffer, size_t size);
     bool read(uint8_t* buffer, size_t size) override;
     bool write(const uint8_t* buffer, size_t size) override;
 
@@ -0,0 +1,160 @@
+
+#ifdef OBSR_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "internal_except.h"
+
+#include "compress.h"
+
+namespace obsr::io {
+
+#ifdef OBSR_HAVE_ZLIB
+// raw deflate, without the zlib header and checksum which tcp makes redundant
+static constexpr int window_bits = -15;
+static constexpr int memory_level = 8;
+// every block ends with an empty stored block from the sync flush, which is not sent
+static constexpr uint8_t flush_marker[] = {0x00, 0x00, 0xff, 0xff};
+
+struct deflater::state {
+    z_stream stream;
+};
+
+struct inflater::state {
+    z_stream stream;
+};
+#else
+struct deflater::state {};
+struct inflater::state {};
+#endif
+
+bool compression_supported() {
+#ifdef OBSR_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+void compression_stats::add_to(network_stats& stats) const {
+    stats.compressed_batches += compressed_batches.load(std::memory_order_relaxed);
+    stats.bytes_before_compression += bytes_before_compression.load(std::memory_order_relaxed);
+    stats.bytes_after_compression += bytes_after_compression.load(std::memory_order_relaxed);
+    stats.compress_time += std::chrono::nanoseconds(compress_time_ns.load(std::memory_order_relaxed));
+    stats.decompressed_batches += decompressed_batches.load(std::memory_order_relaxed);
+    stats.decompress_time += std::chrono::nanoseconds(decompress_time_ns.load(std::memory_order_relaxed));
+}
+
+deflater::deflater()
+    : m_state() {
+#ifdef OBSR_HAVE_ZLIB
+    m_state = std::make_unique<state>();
+    m_state->stream = {};
+    if (deflateInit2(&m_state->stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                     window_bits, memory_level, Z_DEFAULT_STRATEGY) != Z_OK) {
+        throw illegal_state_exception("failed to initialize compression");
+    }
+#endif
+}
+
+deflater::~deflater() {
+#ifdef OBSR_HAVE_ZLIB
+    deflateEnd(&m_state->stream);
+#endif
+}
+
+void deflater::reset() {
+#ifdef OBSR_HAVE_ZLIB
+    deflateReset(&m_state->stream);
+#endif
+}
+
+size_t deflater::bound(size_t size) {
+#ifdef OBSR_HAVE_ZLIB
+    // stored blocks are the worst case, at 5 bytes per up to 64k, followed by the flush
+    return size + 5 * (size / 0xffff + 1) + sizeof(flush_marker) + 2;
+#else
+    return size;
+#endif
+}
+
+size_t deflater::compress(const uint8_t* data, size_t size, uint8_t* out, size_t out_size) {
+#ifdef OBSR_HAVE_ZLIB
+    auto& stream = m_state->stream;
+    stream.next_in = const_cast<uint8_t*>(data);
+    stream.avail_in = size;
+    stream.next_out = out;
+    stream.avail_out = out_size;
+
+    const auto result = deflate(&stream, Z_SYNC_FLUSH);
+    // filling the output entirely may leave part of the block pending
+    if (result != Z_OK || stream.avail_in != 0 || stream.avail_out == 0) {
+        return 0;
+    }
+
+    const auto written = out_size - stream.avail_out;
+    if (written < sizeof(flush_marker)) {
+        return 0;
+    }
+
+    return written - sizeof(flush_marker);
+#else
+    return 0;
+#endif
+}
+
+inflater::inflater()
+    : m_state() {
+#ifdef OBSR_HAVE_ZLIB
+    m_state = std::make_unique<state>();
+    m_state->stream = {};
+    if (inflateInit2(&m_state->stream, window_bits) != Z_OK) {
+        throw illegal_state_exception("failed to initialize decompression");
+    }
+#endif
+}
+
+inflater::~inflater() {
+#ifdef OBSR_HAVE_ZLIB
+    inflateEnd(&m_state->stream);
+#endif
+}
+
+void inflater::reset() {
+#ifdef OBSR_HAVE_ZLIB
+    inflateReset(&m_state->stream);
+#endif
+}
+
+size_t inflater::decompress(const uint8_t* data, size_t size, uint8_t* out, size_t out_size) {
+#ifdef OBSR_HAVE_ZLIB
+    auto& stream = m_state->stream;
+    stream.next_out = out;
+    stream.avail_out = out_size;
+
+    const std::pair<const uint8_t*, size_t> inputs[] = {
+            {data, size},
+            {flush_marker, sizeof(flush_marker)}
+    };
+    for (auto [input, input_size] : inputs) {
+        stream.next_in = const_cast<uint8_t*>(input);
+        stream.avail_in = input_size;
+
+        const auto result = inflate(&stream, Z_SYNC_FLUSH);
+        if ((result != Z_OK && result != Z_BUF_ERROR) || stream.avail_in != 0) {
+            return 0;
+        }
+    }
+
+    if (stream.avail_out == 0) {
+        // there may be more, which did not fit
+        return 0;
+    }
+
+    return out_size - stream.avail_out;
+#else
+    return 0;
+#endif
+}
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+
+#include "obsr_types.h"
+
+namespace obsr::io {
+
+// whether the library was built with a compression codec
+bool compression_supported();
+
+// counters shared by the connections of a network service. updated from any io thread.
+struct compression_stats {
+    std::atomic<uint64_t> compressed_batches = 0;
+    std::atomic<uint64_t> bytes_before_compression = 0;
+    std::atomic<uint64_t> bytes_after_compression = 0;
+    std::atomic<uint64_t> compress_time_ns = 0;
+    std::atomic<uint64_t> decompressed_batches = 0;
+    std::atomic<uint64_t> decompress_time_ns = 0;
+
+    void add_to(network_stats& stats) const;
+};
+
+// one direction of a compressed stream. each block is compressed with the history of the
+// ones before it, so blocks must be decompressed in the order they were compressed.
+class deflater {
+public:
+    deflater();
+    ~deflater();
+
+    // starts a new stream, for a new connection
+    void reset();
+
+    // the most compressing size bytes may produce
+    static size_t bound(size_t size);
+    // returns the size of the compressed block, or 0 if it did not fit. the stream
+    // cannot be used further after a failure.
+    size_t compress(const uint8_t* data, size_t size, uint8_t* out, size_t out_size);
+
+private:
+    struct state;
+    std::unique_ptr<state> m_state;
+};
+
+class inflater {
+public:
+    inflater();
+    ~inflater();
+
+    void reset();
+
+    // returns the size of the decompressed block, or 0 if it is corrupt or does not fit
+    size_t decompress(const uint8_t* data, size_t size, uint8_t* out, size_t out_size);
+
+private:
+    struct state;
+    std::unique_ptr<state> m_state;
+};
+
+}
@@ -1,4 +1,6 @@
 
+#include <algorithm>
+
 #include "debug.h"
 #include "util/bits.h"
 #include "serialize.h"
@@ -8,6 +10,18 @@ namespace obsr::io {
 
 #define LOG_MODULE "serialization"
 
+static bool is_array_type(value_type type) {
+    switch (type) {
+        case value_type::integer32_array:
+        case value_type::integer64_array:
+        case value_type::floating_point32_array:
+        case value_type::floating_point64_array:
+            return true;
+        default:
+            return false;
+    }
+}
+
 static bool is_within_size_limits(size_t size) {
     if (size >= UINT8_MAX) {
         TRACE_ERROR(LOG_MODULE, "requested buffer/array too big: %lu", size);
@@ -17,8 +31,17 @@ static bool is_within_size_limits(size_t size) {
     return true;
 }
 
-template<typename t_>
-bool read(readable_buffer* buf, t_& value_out) {
+uint8_t encode_value_type(value_type type) {
+    auto byte = static_cast<uint8_t>(type);
+    if (array_wire_order == byte_order::little_endian && is_array_type(type)) {
+        byte |= little_endian_type_flag;
+    }
+
+    return byte;
+}
+
+template<typename buffer_, typename t_>
+static bool read(buffer_* buf, t_& value_out) {
     t_ value;
     bool res = buf->read(reinterpret_cast<uint8_t*>(&value), sizeof(t_));
     if (!res) {
@@ -29,18 +52,20 @@ bool read(readable_buffer* buf, t_& value_out) {
     return true;
 }
 
-template<typename t_>
-bool write(writable_buffer* buf, const t_& value) {
+template<typename buffer_, typename t_>
+static bool write(buffer_* buf, const t_& value) {
     return buf->write(reinterpret_cast<const uint8_t*>(&value), sizeof(t_));
 }
 
-deserializer::deserializer(readable_buffer* buffer)
+template<typename buffer_>
+basic_deserializer<buffer_>::basic_deserializer(buffer_* buffer)
     : m_buffer(buffer)
     , m_data()
     , m_data_size(0)
 {}
 
-std::optional<uint8_t> deserializer::read8() {
+template<typename buffer_>
+std::optional<uint8_t> basic_deserializer<buffer_>::read8() {
     uint8_t value;
     if (!read(m_buffer, value)) {
         return {};
@@ -49,7 +74,8 @@ std::optional<uint8_t> deserializer::read8() {
     return {value};
 }
 
-std::optional<uint16_t> deserializer::read16() {
+template<typename buffer_>
+std::optional<uint16_t> basic_deserializer<buffer_>::read16() {
     uint16_t value;
     if (!read(m_buffer, value)) {
         return {};
@@ -59,7 +85,8 @@ std::optional<uint16_t> deserializer::read16() {
     return {value};
 }
 
-std::optional<uint32_t> deserializer::read32() {
+template<typename buffer_>
+std::optional<uint32_t> basic_deserializer<buffer_>::read32() {
     uint32_t value;
     if (!read(m_buffer, value)) {
         return {};
@@ -69,7 +96,8 @@ std::optional<uint32_t> deserializer::read32() {
     return {value};
 }
 
-std::optional<uint64_t> deserializer::read64() {
+template<typename buffer_>
+std::optional<uint64_t> basic_deserializer<buffer_>::read64() {
     uint64_t value;
     if (!read(m_buffer, value)) {
         return {};
@@ -79,7 +107,28 @@ std::optional<uint64_t> deserializer::read64() {
     return {value};
 }
 
-std::optional<float> deserializer::readf32() {
+template<typename buffer_>
+std::optional<uint32_t> basic_deserializer<buffer_>::read_varint() {
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        const auto byte_opt = read8();
+        if (!byte_opt) {
+            return {};
+        }
+
+        const auto byte = byte_opt.value();
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return {value};
+        }
+    }
+
+    TRACE_ERROR(LOG_MODULE, "varint too long");
+    return {};
+}
+
+template<typename buffer_>
+std::optional<float> basic_deserializer<buffer_>::readf32() {
     auto opt = read32();
     if (!opt) {
         return opt;
@@ -93,7 +142,8 @@ std::optional<float> deserializer::readf32() {
     return {mem.f};
 }
 
-std::optional<double> deserializer::readf64() {
+template<typename buffer_>
+std::optional<double> basic_deserializer<buffer_>::readf64() {
     auto opt = read64();
     if (!opt) {
         return opt;
@@ -101,33 +151,46 @@ std::optional<double> deserializer::readf64() {
 
     union {
         double d;
-        uint32_t i;
+        uint64_t i;
     } mem{};
     mem.i = opt.value();
     return {mem.d};
 }
 
-std::optional<size_t> deserializer::read_size() {
+template<typename buffer_>
+std::optional<size_t> basic_deserializer<buffer_>::read_size() {
     return read8();
 }
 
-std::optional<std::span<uint8_t>> deserializer::read_raw() {
+template<typename buffer_>
+std::optional<std::span<const uint8_t>> basic_deserializer<buffer_>::read_raw() {
     const auto size_opt = read_size();
     if (!size_opt) {
         return {};
     }
 
     const auto size = size_opt.value();
-    expand_buffer(size);
+    if constexpr (requires(buffer_& buffer) { buffer.consume(size); }) {
+        // no need to copy out of a buffer which stays in place
+        const auto data = m_buffer->consume(size);
+        if (data == nullptr) {
+            return {};
+        }
 
-    if (!m_buffer->read(m_data.get(), size)) {
-        return {};
-    }
+        return {{data, size}};
+    } else {
+        expand_buffer(size);
+
+        if (!m_buffer->read(m_data.get(), size)) {
+            return {};
+        }
 
-    return {{m_data.get(), size}};
+        return {{m_data.get(), size}};
+    }
 }
 
-std::optional<std::string_view> deserializer::read_str() {
+template<typename buffer_>
+std::optional<std::string_view> basic_deserializer<buffer_>::read_str() {
     const auto value_opt = read_raw();
     if (!value_opt) {
         return {};
@@ -138,95 +201,68 @@ std::optional<std::string_view> deserializer::read_str() {
     return {{reinterpret_cast<const char*>(value.data()), value.size()}};
 }
 
-std::optional<std::span<int32_t>> deserializer::read_arr_i32() {
+template<typename buffer_>
+std::optional<std::span<int32_t>> basic_deserializer<buffer_>::read_arr_i32(byte_order order) {
     const auto size_opt = read_size();
     if (!size_opt) {
         return {};
     }
 
     const auto size = size_opt.value();
-    expand_buffer(size * sizeof(int32_t));
-
-    auto arr = reinterpret_cast<int32_t*>(m_data.get());
-    for (int i = 0; i < size; ++i) {
-        const auto value_opt = read32();
-        if (!value_opt) {
-            return {};
-        }
-
-        arr[i] = static_cast<int32_t>(value_opt.value());
+    if (!read_array(size, sizeof(int32_t), order)) {
+        return {};
     }
 
-    return {{arr, size}};
+    return {{reinterpret_cast<int32_t*>(m_data.get()), size}};
 }
 
-std::optional<std::span<int64_t>> deserializer::read_arr_i64() {
+template<typename buffer_>
+std::optional<std::span<int64_t>> basic_deserializer<buffer_>::read_arr_i64(byte_order order) {
     const auto size_opt = read_size();
     if (!size_opt) {
         return {};
     }
 
     const auto size = size_opt.value();
-    expand_buffer(size * sizeof(int64_t));
-
-    auto arr = reinterpret_cast<int64_t*>(m_data.get());
-    for (int i = 0; i < size; ++i) {
-        const auto value_opt = read64();
-        if (!value_opt) {
-            return {};
-        }
-
-        arr[i] = static_cast<int64_t >(value_opt.value());
+    if (!read_array(size, sizeof(int64_t), order)) {
+        return {};
     }
 
-    return {{arr, size}};
+    return {{reinterpret_cast<int64_t*>(m_data.get()), size}};
 }
 
-std::optional<std::span<float>> deserializer::read_arr_f32() {
+template<typename buffer_>
+std::optional<std::span<float>> basic_deserializer<buffer_>::read_arr_f32(byte_order order) {
     const auto size_opt = read_size();
     if (!size_opt) {
         return {};
     }
 
     const auto size = size_opt.value();
-    expand_buffer(size * sizeof(float));
-
-    auto arr = reinterpret_cast<float*>(m_data.get());
-    for (int i = 0; i < size; ++i) {
-        const auto value_opt = readf32();
-        if (!value_opt) {
-            return {};
-        }
-
-        arr[i] = value_opt.value();
+    if (!read_array(size, sizeof(float), order)) {
+        return {};
     }
 
-    return {{arr, size}};
+    return {{reinterpret_cast<float*>(m_data.get()), size}};
 }
 
-std::optional<std::span<double>> deserializer::read_arr_f64() {
+template<typename buffer_>
+std::optional<std::span<double>> basic_deserializer<buffer_>::read_arr_f64(byte_order order) {
     const auto size_opt = read_size();
     if (!size_opt) {
         return {};
     }
 
     const auto size = size_opt.value();
-    expand_buffer(size * sizeof(double));
-
-    auto arr = reinterpret_cast<double*>(m_data.get());
-    for (int i = 0; i < size; ++i) {
-        const auto value_opt = readf64();
-        if (!value_opt) {
-            return {};
-        }
-
-        arr[i] = value_opt.value();
+    if (!read_array(size, sizeof(double), order)) {
+        return {};
     }
 
-    return {{arr, size}};
+    return {{reinterpret_cast<double*>(m_data.get()), size}};
 }
 
-std::optional<obsr::value> deserializer::read_value(value_type type) {
+template<typename buffer_>
+std::optional<obsr::value> basic_deserializer<buffer_>::read_value(value_type type, byte_order order) {
     switch (type) {
         case value_type::raw: {
             const auto value_opt = read_raw();
@@ -285,7 +321,7 @@ std::optional<obsr::value> deserializer::read_value(value_type type) {
             return value::make_double(static_cast<double>(value_opt.value()));
         }
         case value_type::integer32_array: {
-            const auto value_opt = read_arr_i32();
+            const auto value_opt = read_arr_i32(order);
             if (!value_opt) {
                 return {};
             }
@@ -294,7 +330,7 @@ std::optional<obsr::value> deserializer::read_value(value_type type) {
             return value::make_int32_array(value);
         }
         case value_type::integer64_array: {
-            const auto value_opt = read_arr_i64();
+            const auto value_opt = read_arr_i64(order);
             if (!value_opt) {
                 return {};
             }
@@ -303,7 +339,7 @@ std::optional<obsr::value> deserializer::read_value(value_type type) {
             return value::make_int64_array(value);
         }
         case value_type::floating_point32_array: {
-            const auto value_opt = read_arr_f32();
+            const auto value_opt = read_arr_f32(order);
             if (!value_opt) {
                 return {};
             }
@@ -312,7 +348,7 @@ std::optional<obsr::value> deserializer::read_value(value_type type) {
             return value::make_float_array(value);
         }
         case value_type::floating_point64_array: {
-            const auto value_opt = read_arr_f64();
+            const auto value_opt = read_arr_f64(order);
             if (!value_opt) {
                 return {};
             }
@@ -327,7 +363,20 @@ std::optional<obsr::value> deserializer::read_value(value_type type) {
     }
 }
 
-void deserializer::expand_buffer(size_t size) {
+template<typename buffer_>
+std::optional<obsr::value> basic_deserializer<buffer_>::read_typed_value() {
+    const auto type_opt = read8();
+    if (!type_opt) {
+        return {};
+    }
+
+    const auto type_byte = type_opt.value();
+    const auto order = (type_byte & little_endian_type_flag) != 0 ? byte_order::little_endian : byte_order::big_endian;
+    return read_value(static_cast<value_type>(type_byte & ~little_endian_type_flag), order);
+}
+
+template<typename buffer_>
+void basic_deserializer<buffer_>::expand_buffer(size_t size) {
     if (m_data && m_data_size >= size) {
         return;
     }
@@ -336,30 +385,72 @@ void deserializer::expand_buffer(size_t size) {
     m_data_size = size;
 }
 
-serializer::serializer(writable_buffer* buffer)
+template<typename buffer_>
+bool basic_deserializer<buffer_>::read_array(size_t count, size_t value_size, byte_order order) {
+    const auto size = count * value_size;
+    expand_buffer(size);
+
+    auto data = m_data.get();
+    if (!m_buffer->read(data, size)) {
+        return false;
+    }
+
+    // converted in place, all at once
+    if (value_size == sizeof(uint32_t)) {
+        if (order == byte_order::big_endian) {
+            obsr::bits::net_copy32(data, data, count);
+        } else {
+            obsr::bits::le_copy32(data, data, count);
+        }
+    } else {
+        if (order == byte_order::big_endian) {
+            obsr::bits::net_copy64(data, data, count);
+        } else {
+            obsr::bits::le_copy64(data, data, count);
+        }
+    }
+
+    return true;
+}
+
+template<typename buffer_>
+basic_serializer<buffer_>::basic_serializer(buffer_* buffer)
     : m_buffer(buffer)
 {}
 
-bool serializer::write8(uint8_t value) {
+template<typename buffer_>
+bool basic_serializer<buffer_>::write8(uint8_t value) {
     return write(m_buffer, value);
 }
 
-bool serializer::write16(uint16_t value) {
+template<typename buffer_>
+bool basic_serializer<buffer_>::write16(uint16_t value) {
     value = obsr::bits::net16(value);
     return write(m_buffer, value);
 }
 
-bool serializer::write32(uint32_t value) {
+template<typename buffer_>
+bool basic_serializer<buffer_>::write32(uint32_t value) {
     value = obsr::bits::net32(value);
     return write(m_buffer, value);
 }
 
-bool serializer::write64(uint64_t value) {
+template<typename buffer_>
+bool basic_serializer<buffer_>::write64(uint64_t value) {
     value = obsr::bits::net64(value);
     return write(m_buffer, value);
 }
 
-bool serializer::writef32(float value) {
+template<typename buffer_>
+bool basic_serializer<buffer_>::write_varint(uint32_t value) {
+    uint8_t data[obsr::bits::max_varint_size];
+    const auto size = obsr::bits::encode_varint(value, data);
+
+    return m_buffer->write(data, size);
+}
+
+template<typename buffer_>
+bool basic_serializer<buffer_>::writef32(float value) {
     union {
         float f;
         uint32_t i;
@@ -369,7 +460,8 @@ bool serializer::writef32(float value) {
     return write32(mem.i);
 }
 
-bool serializer::writef64(double value) {
+template<typename buffer_>
+bool basic_serializer<buffer_>::writef64(double value) {
     union {
         double d;
         uint64_t i;
@@ -379,7 +471,8 @@ bool serializer::writef64(double value) {
     return write64(mem.i);
 }
 
-bool serializer::write_size(size_t value) {
+template<typename buffer_>
+bool basic_serializer<buffer_>::write_size(size_t value) {
     if (!is_within_size_limits(value)) {
         return false;
     }
@@ -387,7 +480,8 @@ bool serializer::write_size(size_t value) {
     return write8(value);
 }
 
-bool serializer::write_raw(const uint8_t* ptr, size_t size) {
+template<typename buffer_>
+bool basic_serializer<buffer_>::write_raw(const uint8_t* ptr, size_t size) {
     if (!write_size(size)) {
         return false;
     }
@@ -395,67 +489,54 @@ bool serializer::write_raw(const uint8_t* ptr, size_t size) {
     return m_buffer->write(ptr, size);
 }
 
-bool serializer::write_str(std::string_view str) {
+template<typename buffer_>
+bool basic_serializer<buffer_>::write_str(std::string_view str) {
     return write_raw(reinterpret_cast<const uint8_t*>(str.data()), str.size());
 }
 
-bool serializer::write_arr_i32(std::span<const int32_t> arr) {
+template<typename buffer_>
+bool basic_serializer<buffer_>::write_arr_i32(std::span<const int32_t> arr) {
     if (!write_size(arr.size())) {
         return false;
     }
 
-    for (auto value : arr) {
-        if (!write32(static_cast<uint32_t>(value))) {
-            return false;
-        }
-    }
-
-    return true;
+    return write_array(arr.data(), arr.size(), sizeof(int32_t));
 }
 
-bool serializer::write_arr_i64(std::span<const int64_t> arr) {
+template<typename buffer_>
+bool basic_serializer<buffer_>::write_arr_i64(std::span<const int64_t> arr) {
     if (!write_size(arr.size())) {
         return false;
     }
 
-    for (auto value : arr) {
-        if (!write64(static_cast<uint64_t>(value))) {
-            return false;
-        }
-    }
-
-    return true;
+    return write_array(arr.data(), arr.size(), sizeof(int64_t));
 }
 
-bool serializer::write_arr_f32(std::span<const float> arr) {
+template<typename buffer_>
+bool basic_serializer<buffer_>::write_arr_f32(std::span<const float> arr) {
     if (!write_size(arr.size())) {
         return false;
     }
 
-    for (auto value : arr) {
-        if (!writef32(value)) {
-            return false;
-        }
-    }
-
-    return true;
+    return write_array(arr.data(), arr.size(), sizeof(float));
 }
 
-bool serializer::write_arr_f64(std::span<const double> arr) {
+template<typename buffer_>
+bool basic_serializer<buffer_>::write_arr_f64(std::span<const double> arr) {
     if (!write_size(arr.size())) {
         return false;
     }
 
-    for (auto value : arr) {
-        if (!writef64(value)) {
-            return false;
-        }
-    }
+    return write_array(arr.data(), arr.size(), sizeof(double));
+}
 
-    return true;
+template<typename buffer_>
+bool basic_serializer<buffer_>::write_value_type(value_type type) {
+    return write8(encode_value_type(type));
 }
 
-bool serializer::write_value(const value& value) {
+template<typename buffer_>
+bool basic_serializer<buffer_>::write_value(const value& value) {
     switch (value.get_type()) {
         case value_type::raw: {
             auto arr = value.get_raw();
@@ -503,4 +584,53 @@ bool serializer::write_value(const value& value) {
     }
 }
 
+template<typename buffer_>
+bool basic_serializer<buffer_>::write_array(const void* data, size_t count, size_t value_size) {
+    const auto convert = [value_size](const void* src, void* dst, size_t count)->void {
+        if (value_size == sizeof(uint32_t)) {
+            if (array_wire_order == byte_order::big_endian) {
+                obsr::bits::net_copy32(src, dst, count);
+            } else {
+                obsr::bits::le_copy32(src, dst, count);
+            }
+        } else {
+            if (array_wire_order == byte_order::big_endian) {
+                obsr::bits::net_copy64(src, dst, count);
+            } else {
+                obsr::bits::le_copy64(src, dst, count);
+            }
+        }
+    };
+
+    // converted straight into the buffer where possible
+    auto out = m_buffer->claim(count * value_size);
+    if (out != nullptr) {
+        convert(data, out, count);
+        return true;
+    }
+
+    uint8_t chunk[256];
+    const auto per_chunk = sizeof(chunk) / value_size;
+    auto src = static_cast<const uint8_t*>(data);
+    while (count > 0) {
+        const auto amount = std::min(count, per_chunk);
+        convert(src, chunk, amount);
+        if (!m_buffer->write(chunk, amount * value_size)) {
+            return false;
+        }
+
+        src += amount * value_size;
+        count -= amount;
+    }
+
+    return true;
+}
+
+template class basic_deserializer<readable_buffer>;
+template class basic_deserializer<readonly_buffer_view>;
+template class basic_deserializer<circular_buffer>;
+template class basic_serializer<writable_buffer>;
+template class basic_serializer<linear_buffer>;
+template class basic_serializer<circular_buffer>;
+
 }
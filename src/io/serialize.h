@@ -4,45 +4,118 @@
 #include <string>
 
 #include "obsr_types.h"
+#include "util/bits.h"
 #include "buffer.h"
 
 namespace obsr::io {
 
-class deserializer {
+enum class byte_order {
+    big_endian,
+    little_endian
+};
+
+// set in the byte of the value type, if the arrays of the value are in little endian order
+static constexpr uint8_t little_endian_type_flag = 0x80;
+
+// order arrays are sent in. big endian is understood by all versions, little endian needs
+// no conversion on most hosts but only by peers which know of little_endian_type_flag.
+#ifdef OBSR_WIRE_LITTLE_ENDIAN
+static constexpr byte_order array_wire_order = byte_order::little_endian;
+#else
+static constexpr byte_order array_wire_order = byte_order::big_endian;
+#endif
+
+// reads and writes fields over a buffer of the given type. with one of the concrete buffers,
+// calls into the buffer are direct and may be inlined. with readable_buffer or writable_buffer,
+// any buffer may be used, through virtual calls.
+template<typename buffer_>
+class basic_deserializer {
 public:
-    explicit deserializer(readable_buffer* buffer);
+    explicit basic_deserializer(buffer_* buffer);
 
     std::optional<uint8_t> read8();
     std::optional<uint16_t> read16();
     std::optional<uint32_t> read32();
     std::optional<uint64_t> read64();
+    // variable length, 7 bits per byte, least significant first
+    std::optional<uint32_t> read_varint();
     std::optional<float> readf32();
     std::optional<double> readf64();
     std::optional<size_t> read_size();
-    std::optional<std::span<uint8_t>> read_raw();
+    // with buffers which can lend out their memory, the result points into the buffer
+    std::optional<std::span<const uint8_t>> read_raw();
     std::optional<std::string_view> read_str();
-    std::optional<std::span<int32_t>> read_arr_i32();
-    std::optional<std::span<int64_t>> read_arr_i64();
-    std::optional<std::span<float>> read_arr_f32();
-    std::optional<std::span<double>> read_arr_f64();
-    std::optional<obsr::value> read_value(value_type type);
+    std::optional<std::span<int32_t>> read_arr_i32(byte_order order = byte_order::big_endian);
+    std::optional<std::span<int64_t>> read_arr_i64(byte_order order = byte_order::big_endian);
+    std::optional<std::span<float>> read_arr_f32(byte_order order = byte_order::big_endian);
+    std::optional<std::span<double>> read_arr_f64(byte_order order = byte_order::big_endian);
+    std::optional<obsr::value> read_value(value_type type, byte_order order = byte_order::big_endian);
+    // the type, as written by write_value_type, followed by the value
+    std::optional<obsr::value> read_typed_value();
 
 private:
     void expand_buffer(size_t size);
+    // reads count values of the given size into the data buffer, in host order
+    bool read_array(size_t count, size_t value_size, byte_order order);
 
-    readable_buffer* m_buffer;
-    std::unique_ptr<uint8_t> m_data;
+    buffer_* m_buffer;
+    std::unique_ptr<uint8_t[]> m_data;
     size_t m_data_size;
 };
 
-class serializer {
+// fields of bounded size, composed in place and then written to a buffer at once, so its
+// bounds are checked a single time. the capacity must cover the largest the fields may be.
+template<size_t capacity_>
+class fixed_fields {
+public:
+    fixed_fields()
+        : m_data()
+        , m_size(0)
+    {}
+
+    inline const uint8_t* data() const {
+        return m_data;
+    }
+
+    inline size_t size() const {
+        return m_size;
+    }
+
+    inline void put8(uint8_t value) {
+        m_data[m_size++] = value;
+    }
+
+    inline void put64(uint64_t value) {
+        value = obsr::bits::net64(value);
+        memcpy(m_data + m_size, &value, sizeof(value));
+        m_size += sizeof(value);
+    }
+
+    inline void put_varint(uint32_t value) {
+        m_size += obsr::bits::encode_varint(value, m_data + m_size);
+    }
+
+private:
+    uint8_t m_data[capacity_];
+    size_t m_size;
+};
+
+// the byte of the value type as written by write_value_type
+uint8_t encode_value_type(value_type type);
+
+// most bytes a varint of a 32 bit value takes
+static constexpr size_t max_varint32_size = 5;
+
+template<typename buffer_>
+class basic_serializer {
 public:
-    explicit serializer(writable_buffer* buffer);
+    explicit basic_serializer(buffer_* buffer);
 
     bool write8(uint8_t value);
     bool write16(uint16_t value);
     bool write32(uint32_t value);
     bool write64(uint64_t value);
+    bool write_varint(uint32_t value);
     bool writef32(float value);
     bool writef64(double value);
     bool write_size(size_t value);
@@ -52,10 +125,29 @@ public:
     bool write_arr_i64(std::span<const int64_t> arr);
     bool write_arr_f32(std::span<const float> arr);
     bool write_arr_f64(std::span<const double> arr);
+    // written before the value, marking how its arrays are encoded
+    bool write_value_type(value_type type);
     bool write_value(const value& value);
 
+    template<size_t capacity_>
+    inline bool write_fields(const fixed_fields<capacity_>& fields) {
+        return m_buffer->write(fields.data(), fields.size());
+    }
+
 private:
-    writable_buffer* m_buffer;
+    bool write_array(const void* data, size_t count, size_t value_size);
+
+    buffer_* m_buffer;
 };
 
+using deserializer = basic_deserializer<readable_buffer>;
+using serializer = basic_serializer<writable_buffer>;
+
+extern template class basic_deserializer<readable_buffer>;
+extern template class basic_deserializer<readonly_buffer_view>;
+extern template class basic_deserializer<circular_buffer>;
+extern template class basic_serializer<writable_buffer>;
+extern template class basic_serializer<linear_buffer>;
+extern template class basic_serializer<circular_buffer>;
+
 }
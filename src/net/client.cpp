@@ -21,102 +21,51 @@ network_client::network_client(clock_ref& clock)
     , m_storage(nullptr)
     , m_clock(clock)
     , m_conn_info({"", 0})
+    , m_subscriptions()
+    , m_session(0)
+    , m_session_sequence()
+    , m_handshake_sequence(0)
+    , m_transaction_depth(0)
+    , m_transaction_changes()
+    , m_transaction_sequence()
     , m_looper(nullptr)
     , m_update_timer_handle(empty_handle)
     , m_io()
+    , m_compression_stats()
+    , m_multicast()
     , m_parser()
     , m_message_queue() {
+    m_io.attach_stats(&m_compression_stats);
     m_io.on_connect([this]()->void {
         std::unique_lock lock(m_mutex);
-
-        TRACE_DEBUG(LOG_MODULE, "connected to server, starting first time sync");
-        m_message_queue.clear();
-
-        const auto now = m_clock->now();
-        m_message_queue.enqueue(out_message::time_sync_request(now), message_queue::flag_immediate);
-        m_state = state::in_handshake_time_sync;
+        on_connected();
     });
     m_io.on_close([this]()->void {
         std::unique_lock lock(m_mutex);
 
         m_connect_retry_timer.stop();
         m_clock_sync_timer.stop();
+        m_multicast.stop();
 
         m_state = state::opening;
         m_connect_retry_timer.start();
     });
     m_io.on_message([this](const message_header& header, const uint8_t* buffer, size_t size)->void {
         std::unique_lock lock(m_mutex);
+        handle_message(header, buffer, size);
+    });
+    m_multicast.on_message([this](const message_header& header, const uint8_t* buffer, size_t size)->void {
+        std::unique_lock lock(m_mutex);
 
-        auto type = static_cast<message_type>(header.type);
-        m_parser.set_data(type, buffer, size);
-        m_parser.process();
-
-        if (m_parser.is_errored()) {
-            TRACE_ERROR(LOG_MODULE, "failed to parse incoming data, parser error=%d", m_parser.error_code());
-            return;
-        } else if (!m_parser.is_finished()) {
-            TRACE_ERROR(LOG_MODULE, "failed to parse incoming data, parser did not finish");
+        // only updates are sent over multicast, and they are of no use before the handshake is done
+        if (m_state != state::in_use || static_cast<message_type>(header.type) != message_type::entry_update) {
             return;
         }
 
-        auto parse_data = m_parser.data();
-        switch (type) {
-            case message_type::entry_update:
-                TRACE_DEBUG(LOG_MODULE, "ENTRY UPDATE from server: id=%d", parse_data.id);
-                invoke_sharedptr_nolock<storage::storage, storage::entry_id, const obsr::value&, std::chrono::milliseconds>(
-                        m_storage,
-                        &storage::storage::on_entry_updated,
-                        parse_data.id,
-                        parse_data.value,
-                        parse_data.send_time);
-                break;
-            case message_type::entry_delete:
-                TRACE_DEBUG(LOG_MODULE, "ENTRY DELETE from server: id=%d", parse_data.id);
-                invoke_sharedptr_nolock<storage::storage, storage::entry_id, std::chrono::milliseconds>(
-                        m_storage,
-                        &storage::storage::on_entry_deleted,
-                        parse_data.id,
-                        parse_data.send_time);
-                break;
-            case message_type::entry_id_assign:
-                TRACE_DEBUG(LOG_MODULE, "ENTRY ASSIGN from server: id=%d, name=%s", parse_data.id, parse_data.name.c_str());
-                invoke_sharedptr_nolock<storage::storage, storage::entry_id, std::string_view>(
-                        m_storage,
-                        &storage::storage::on_entry_id_assigned,
-                        parse_data.id,
-                        parse_data.name);
-                break;
-            case message_type::handshake_finished:
-                TRACE_DEBUG(LOG_MODULE, "server declared handshake is finished");
-                m_state = state::in_use;
-                m_clock_sync_timer.start();
-                break;
-            case message_type::time_sync_response: {
-                if (m_clock->sync(parse_data.time_value, parse_data.send_time)) {
-                    m_storage->on_clock_resync();
-                }
-
-                const auto time = m_clock->now();
-                TRACE_DEBUG(LOG_MODULE, "received time sync response from server: %lu", time.count());
-
-                if (m_state == state::in_handshake_time_sync) {
-                    TRACE_DEBUG(LOG_MODULE, "transitioning to handshake wait");
-                    m_message_queue.enqueue(out_message::handshake_ready());
-                    m_state = state::in_handshake;
-                } else {
-                    m_clock_sync_timer.start();
-                }
-                break;
-            }
-            case message_type::entry_create:
-            case message_type::no_type:
-            default:
-                break;
-        }
+        handle_message(header, buffer, size);
     });
-    m_message_queue.attach([this](uint8_t type, const uint8_t* buffer, size_t size)->bool {
-        return m_io.write(type, buffer, size);
+    m_message_queue.attach([this](uint8_t type, const io::shared_buffer& payload)->bool {
+        return m_io.write(type, payload);
     });
 }
 
@@ -130,6 +79,49 @@ void network_client::configure_target(connection_info info) {
     m_conn_info = std::move(info);
 }
 
+void network_client::configure_options(const client_options& options) {
+    std::unique_lock lock(m_mutex);
+
+    if (m_state != state::idle) {
+        throw illegal_state_exception("client running, cannot reconfigure");
+    }
+
+    m_io.configure(options.sockets);
+    m_subscriptions.clear();
+    m_subscriptions.insert(options.subscriptions.begin(), options.subscriptions.end());
+}
+
+void network_client::subscribe(std::string_view path) {
+    std::unique_lock lock(m_mutex);
+
+    if (!m_subscriptions.emplace(path).second) {
+        return;
+    }
+
+    // we cannot tell if the entries under the path reached us before a disconnect, so the next
+    // connection starts over
+    m_session_sequence.reset();
+
+    // before that, all subscriptions are sent together with the handshake
+    if (m_state == state::in_handshake || m_state == state::in_use) {
+        m_message_queue.enqueue(out_message::subscribe(path));
+    }
+}
+
+void network_client::unsubscribe(std::string_view path) {
+    std::unique_lock lock(m_mutex);
+
+    auto it = m_subscriptions.find(path);
+    if (it == m_subscriptions.end()) {
+        return;
+    }
+
+    m_subscriptions.erase(it);
+    if (m_state == state::in_handshake || m_state == state::in_use) {
+        m_message_queue.enqueue(out_message::unsubscribe(path));
+    }
+}
+
 void network_client::attach_storage(std::shared_ptr<storage::storage> storage) {
     std::unique_lock lock(m_mutex);
 
@@ -151,11 +143,13 @@ void network_client::start(events::looper* looper) {
         throw illegal_state_exception("cannot start without attached storage");
     }
 
-    if (m_conn_info.port == 0) {
+    if (m_conn_info.transport == transport_type::local ? m_conn_info.path.empty() : m_conn_info.port == 0) {
         throw illegal_state_exception("cannot start without target info");
     }
 
     m_storage->clear_net_ids();
+    m_session = 0;
+    m_session_sequence.reset();
     m_connect_retry_timer.stop();
     m_clock_sync_timer.stop();
     m_message_queue.clear();
@@ -172,6 +166,12 @@ void network_client::start(events::looper* looper) {
     m_update_timer_handle = m_looper->create_timer(update_time, update_callback);
 }
 
+network_stats network_client::get_stats() const {
+    network_stats stats;
+    m_compression_stats.add_to(stats);
+    return stats;
+}
+
 void network_client::stop() {
     std::unique_lock lock(m_mutex);
 
@@ -189,6 +189,7 @@ void network_client::stop() {
         }
 
         m_io.stop();
+        m_multicast.stop();
     }, events::looper::execute_type::sync);
     lock.lock();
 
@@ -239,8 +240,26 @@ void network_client::update() {
 }
 
 bool network_client::do_open_and_connect() {
+    if (m_conn_info.transport == transport_type::shared_memory) {
+        try {
+            // attaching is done synchronously, there is no connecting phase
+            auto stream = os::shm_stream::connect(m_conn_info.port);
+            m_io.start(m_looper, std::move(stream));
+            on_connected();
+
+            return true;
+        } catch (const std::exception& e) {
+            TRACE_ERROR(LOG_MODULE, "error while attaching to server over shared memory: what=%s", e.what());
+            m_io.stop();
+
+            return false;
+        }
+    }
+
     try {
-        m_io.start(m_looper);
+        m_io.start(m_looper, m_conn_info.transport == transport_type::local ?
+                             os::socket_domain::local :
+                             os::socket_domain::inet);
         m_io.connect(m_conn_info);
         m_state = state::connecting;
 
@@ -253,7 +272,216 @@ bool network_client::do_open_and_connect() {
     }
 }
 
+void network_client::on_connected() {
+    m_message_queue.clear();
+    m_transaction_depth = 0;
+    m_transaction_changes.clear();
+    m_transaction_sequence.reset();
+
+    const auto now = m_clock->now();
+    m_message_queue.enqueue(out_message::time_sync_request(now), message_queue::flag_immediate);
+
+    if (m_session_sequence) {
+        // the clock was synced before, so there is no need to wait for it
+        TRACE_DEBUG(LOG_MODULE, "connected to server, resuming session");
+        start_handshake();
+    } else {
+        TRACE_DEBUG(LOG_MODULE, "connected to server, starting first time sync");
+        m_state = state::in_handshake_time_sync;
+    }
+}
+
+void network_client::start_handshake() {
+    // the server only sends us what we subscribed to
+    for (auto& path : m_subscriptions) {
+        m_message_queue.enqueue(out_message::subscribe(path));
+    }
+
+    if (m_session_sequence) {
+        m_message_queue.enqueue(out_message::session_resume(m_session, m_session_sequence.value()));
+    }
+
+    m_message_queue.enqueue(out_message::handshake_ready());
+    m_state = state::in_handshake;
+}
+
+void network_client::handle_message(const message_header& header, const uint8_t* buffer, size_t size) {
+    auto type = static_cast<message_type>(header.type);
+    m_parser.set_data(type, buffer, size);
+    m_parser.process();
+
+    if (m_parser.is_errored()) {
+        TRACE_ERROR(LOG_MODULE, "failed to parse incoming data, parser error=%d", m_parser.error_code());
+        return;
+    } else if (!m_parser.is_finished()) {
+        TRACE_ERROR(LOG_MODULE, "failed to parse incoming data, parser did not finish");
+        return;
+    }
+
+    auto parse_data = m_parser.data();
+    switch (type) {
+        case message_type::entry_update:
+            TRACE_DEBUG(LOG_MODULE, "ENTRY UPDATE from server: id=%d", parse_data.id);
+            if (m_transaction_depth > 0) {
+                m_transaction_changes.push_back({parse_data.id, std::move(parse_data.value), parse_data.send_time});
+                break;
+            }
+
+            invoke_sharedptr_nolock<storage::storage, storage::entry_id, const obsr::value&, std::chrono::milliseconds>(
+                    m_storage,
+                    &storage::storage::on_entry_updated,
+                    parse_data.id,
+                    parse_data.value,
+                    parse_data.send_time);
+            break;
+        case message_type::entry_delete:
+            TRACE_DEBUG(LOG_MODULE, "ENTRY DELETE from server: id=%d", parse_data.id);
+            if (m_transaction_depth > 0) {
+                m_transaction_changes.push_back({parse_data.id, std::nullopt, parse_data.send_time});
+                break;
+            }
+
+            invoke_sharedptr_nolock<storage::storage, storage::entry_id, std::chrono::milliseconds>(
+                    m_storage,
+                    &storage::storage::on_entry_deleted,
+                    parse_data.id,
+                    parse_data.send_time);
+            break;
+        case message_type::entry_id_assign:
+            TRACE_DEBUG(LOG_MODULE, "ENTRY ASSIGN from server: id=%d, name=%s", parse_data.id, parse_data.name.c_str());
+            invoke_sharedptr_nolock<storage::storage, storage::entry_id, std::string_view>(
+                    m_storage,
+                    &storage::storage::on_entry_id_assigned,
+                    parse_data.id,
+                    parse_data.name);
+            break;
+        case message_type::entry_id_release:
+            TRACE_DEBUG(LOG_MODULE, "ENTRY ID RELEASE from server: id=%d", parse_data.id);
+            m_storage->on_entry_id_released(parse_data.id);
+            break;
+        case message_type::entry_publish:
+            TRACE_DEBUG(LOG_MODULE, "ENTRY PUBLISH from server: id=%d, name=%s", parse_data.id, parse_data.name.c_str());
+            invoke_sharedptr_nolock<storage::storage, storage::entry_id, std::string_view>(
+                    m_storage,
+                    &storage::storage::on_entry_id_assigned,
+                    parse_data.id,
+                    parse_data.name);
+            if (m_transaction_depth > 0) {
+                // the id is of use right away, only the value waits for the transaction
+                m_transaction_changes.push_back({parse_data.id, std::move(parse_data.value), parse_data.send_time});
+                break;
+            }
+
+            invoke_sharedptr_nolock<storage::storage, storage::entry_id, const obsr::value&, std::chrono::milliseconds>(
+                    m_storage,
+                    &storage::storage::on_entry_updated,
+                    parse_data.id,
+                    parse_data.value,
+                    parse_data.send_time);
+            break;
+        case message_type::handshake_finished:
+            TRACE_DEBUG(LOG_MODULE, "server declared handshake is finished");
+            m_session_sequence = m_handshake_sequence;
+            m_state = state::in_use;
+            m_clock_sync_timer.start();
+            break;
+        case message_type::time_sync_response: {
+            if (m_clock->sync(parse_data.time_value, parse_data.send_time)) {
+                m_storage->on_clock_resync();
+            }
+
+            const auto time = m_clock->now();
+            TRACE_DEBUG(LOG_MODULE, "received time sync response from server: %lu", time.count());
+
+            if (m_state == state::in_handshake_time_sync) {
+                TRACE_DEBUG(LOG_MODULE, "transitioning to handshake wait");
+                start_handshake();
+            } else {
+                m_clock_sync_timer.start();
+            }
+            break;
+        }
+        case message_type::session_info:
+            if (m_state == state::in_use) {
+                // everything up to here was received
+                if (parse_data.session == m_session && m_session_sequence) {
+                    if (m_transaction_depth > 0) {
+                        m_transaction_sequence = parse_data.sequence;
+                    } else {
+                        m_session_sequence = parse_data.sequence;
+                    }
+                }
+                break;
+            }
+
+            if (parse_data.session != m_session) {
+                if (m_session != 0) {
+                    // the server restarted and assigns ids anew
+                    TRACE_INFO(LOG_MODULE, "server session changed, dropping entry ids");
+                    m_storage->clear_net_ids();
+                }
+
+                m_session = parse_data.session;
+                m_session_sequence.reset();
+            }
+
+            // only counts once the handshake is done
+            m_handshake_sequence = parse_data.sequence;
+            break;
+        case message_type::multicast_info:
+            TRACE_DEBUG(LOG_MODULE, "server offers multicast: group=%s, port=%d", parse_data.name.c_str(), parse_data.port);
+            start_multicast(parse_data.name, parse_data.port, parse_data.id);
+            break;
+        case message_type::transaction_begin:
+            m_transaction_depth++;
+            break;
+        case message_type::transaction_end:
+            if (m_transaction_depth == 0) {
+                TRACE_ERROR(LOG_MODULE, "received end of transaction without its start");
+                break;
+            }
+
+            if (--m_transaction_depth == 0) {
+                apply_transaction();
+            }
+            break;
+        case message_type::entry_create:
+        case message_type::no_type:
+        default:
+            break;
+    }
+}
+
+void network_client::apply_transaction() {
+    TRACE_DEBUG(LOG_MODULE, "TRANSACTION from server: changes=%lu", m_transaction_changes.size());
+    m_storage->on_entries_changed(m_transaction_changes);
+    m_transaction_changes.clear();
+
+    if (m_transaction_sequence) {
+        if (m_session_sequence) {
+            m_session_sequence = m_transaction_sequence;
+        }
+        m_transaction_sequence.reset();
+    }
+}
+
+void network_client::start_multicast(const std::string& group, uint16_t port, uint16_t client_id) {
+    m_multicast.stop();
+
+    try {
+        // updates we sent ourselves are echoed back by the server, skip them
+        m_multicast.start(m_looper, group, port, client_id);
+    } catch (const std::exception& e) {
+        TRACE_ERROR(LOG_MODULE, "error while joining multicast group, best effort entries will not be received: what=%s", e.what());
+        m_multicast.stop();
+    }
+}
+
 void network_client::process_storage() {
+    const auto on_transaction = [this](bool begin)->void {
+        m_message_queue.enqueue(begin ? out_message::transaction_begin() : out_message::transaction_end());
+    };
+
     m_storage->act_on_dirty_entries([this](const storage::storage_entry& entry) -> bool {
         const auto id = entry.get_net_id();
 
@@ -283,7 +511,7 @@ void network_client::process_storage() {
 
         // we want to mark un-dirty and resume if we succeeded
         return true;
-    });
+    }, on_transaction);
 }
 
 }
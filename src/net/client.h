@@ -1,5 +1,7 @@
 #pragma once
 
+#include <set>
+
 #include "storage/storage.h"
 #include "net/io.h"
 #include "net/serialize.h"
@@ -14,11 +16,18 @@ public:
     explicit network_client(clock_ref& clock);
 
     void configure_target(connection_info info);
+    void configure_options(const client_options& options);
+
+    // may be called while running. the subscriptions are sent again on each connection.
+    void subscribe(std::string_view path);
+    void unsubscribe(std::string_view path);
 
     void attach_storage(std::shared_ptr<storage::storage> storage) override;
     void start(events::looper* looper) override;
     void stop() override;
 
+    network_stats get_stats() const override;
+
 private:
     enum class state {
         idle,
@@ -31,7 +40,12 @@ private:
 
     void update();
     bool do_open_and_connect();
+    void on_connected();
+    void start_handshake();
+    void handle_message(const message_header& header, const uint8_t* buffer, size_t size);
+    void start_multicast(const std::string& group, uint16_t port, uint16_t client_id);
     void process_storage();
+    void apply_transaction();
 
     std::mutex m_mutex;
     state m_state;
@@ -39,11 +53,26 @@ private:
     clock_ref m_clock;
     std::shared_ptr<storage::storage> m_storage;
     connection_info m_conn_info;
+    std::set<std::string, std::less<>> m_subscriptions;
+
+    // session of the server, and how far in it we got. when reconnecting, the server sends only
+    // what changed since then.
+    uint64_t m_session;
+    std::optional<uint64_t> m_session_sequence;
+    uint64_t m_handshake_sequence;
+
+    // changes received within a transaction, applied once it ends. if the connection is lost
+    // before that, they are dropped, as is the progress in the session made during it.
+    uint32_t m_transaction_depth;
+    std::vector<storage::entry_change> m_transaction_changes;
+    std::optional<uint64_t> m_transaction_sequence;
 
     events::looper* m_looper;
     obsr::handle m_update_timer_handle;
 
     socket_io m_io;
+    io::compression_stats m_compression_stats;
+    multicast_receiver m_multicast;
     message_parser m_parser;
     message_queue m_message_queue;
 
@@ -1,8 +1,11 @@
+#include <cstring>
+#include <chrono>
 
 #include "os/io.h"
 #include "internal_except.h"
 #include "debug.h"
 #include "util/general.h"
+#include "util/bits.h"
 
 #include "io.h"
 
@@ -11,54 +14,144 @@ namespace obsr::net {
 #define LOG_MODULE_CLIENT "socketio"
 #define LOG_MODULE_SERVER "serverio"
 
+static constexpr size_t max_write_queue_size = 64 * 1024;
+static constexpr size_t max_write_vectors = 64;
+static constexpr size_t max_accepts_per_event = 64;
+static constexpr size_t max_datagrams_per_event = 64;
+static constexpr uint8_t multicast_ttl = 1;
+static constexpr events::event_types connected_events =
+        events::event_in | events::event_out | events::event_edge;
+
+static void configure_buffer_sizes(obsr::os::base_socket& socket, const socket_options& options) {
+    if (options.send_buffer_size > 0) {
+        socket.setoption<os::sockopt_sndbuf>(options.send_buffer_size);
+    }
+    if (options.receive_buffer_size > 0) {
+        socket.setoption<os::sockopt_rcvbuf>(options.receive_buffer_size);
+    }
+}
+
+static void configure_tcp_socket(obsr::os::socket& socket, const socket_options& options) {
+    configure_buffer_sizes(socket, options);
+    socket.setoption<os::sockopt_nodelay>(options.no_delay);
+
+    if (options.busy_poll_us > 0) {
+        try {
+            socket.setoption<os::sockopt_busypoll>(static_cast<int>(options.busy_poll_us));
+        } catch (const io_exception& e) {
+            // busy polling is only an optimization, and may require privileges we lack
+            TRACE_ERROR(LOG_MODULE_CLIENT, "failed to enable busy poll: code=%d", e.get_code());
+        }
+    }
+}
+
 reader::reader(size_t buffer_size)
     : state_machine()
-    , m_read_buffer(buffer_size) {
+    , m_read_buffer(buffer_size)
+    , m_last_send_time(0)
+    , m_next_index(0)
+    , m_inflater()
+    , m_expanded_buffer(read_data::message_buffer_size + 1)
+    , m_source(&m_read_buffer)
+    , m_expand_output() {
 }
 
 bool reader::update(obsr::os::readable* readable) {
     return m_read_buffer.read_from(readable);
 }
 
+size_t reader::available() const {
+    return m_read_buffer.read_available();
+}
+
+void reader::clear() {
+    m_read_buffer.reset();
+    m_last_send_time = 0;
+    m_next_index = 0;
+    m_inflater.reset();
+    m_expanded_buffer.reset();
+    m_source = &m_read_buffer;
+    reset();
+}
+
+bool reader::expand(const uint8_t* data, size_t size) {
+    if (m_expanded_buffer.read_available() > 0) {
+        // compressed frames are never nested
+        return false;
+    }
+
+    const auto expanded_size = m_inflater.decompress(data, size, m_expand_output, sizeof(m_expand_output));
+    if (expanded_size == 0) {
+        return false;
+    }
+
+    m_expanded_buffer.reset();
+    return m_expanded_buffer.write(m_expand_output, expanded_size);
+}
+
 bool reader::process_state(read_state current_state, read_data& data) {
     switch (current_state) {
         case read_state::header: {
-            auto& header = data.header;
-            do {
-                auto success = m_read_buffer.find_and_seek_read(message_header::message_magic);
-                if (!success) {
-                    return try_later();
-                }
-
-                success = m_read_buffer.read(header);
-                if (!success) {
-                    return try_later();
-                }
-
-                header_convert_host(header);
-            } while (header.magic != message_header::message_magic ||
-                     header.version != message_header::current_version);
+            // frames which were compressed are read before continuing with the stream
+            m_source = m_expanded_buffer.read_available() > 0 ? &m_expanded_buffer : &m_read_buffer;
+            auto& source = *m_source;
+
+            uint8_t first;
+            if (source.peek(&first, sizeof(first)) == 0) {
+                return try_later();
+            }
+
+            bool success;
+            if ((first & message_header::compact_frame_flag) != 0) {
+                success = read_compact_header(source, data);
+            } else {
+                success = read_full_header(source, data.header);
+                data.has_send_time = false;
+            }
+
+            if (!success) {
+                // the compressed run holds only whole frames
+                return m_source == &m_read_buffer ? try_later() : error(read_error::read_failed);
+            }
+
+            const auto is_full = (first & message_header::compact_frame_flag) == 0;
+            if (is_full && data.header.version != message_header::full_frame_version) {
+                // such as peers from before the version was last changed. nothing they send can be read,
+                // so rather than dropping all of it, the connection is closed.
+                TRACE_ERROR(LOG_MODULE_CLIENT, "peer sent frame of version %d, only version %d is supported",
+                            data.header.version, message_header::full_frame_version);
+                return error(read_error::read_unsupported_version);
+            }
 
             return move_to_state(read_state::message);
         }
         case read_state::message: {
             const auto& header = data.header;
             auto buffer = data.message_buffer;
+            // the send time of compact frames is not in the stream
+            const auto time_size = data.has_send_time ? sizeof(uint64_t) : 0;
+            const auto size = header.message_size - time_size;
+            auto& source = *m_source;
             if (header.message_size > read_data::message_buffer_size) {
                 // we can skip forward by the size, but regardless we will handle it fine because
                 // we jump to the magic
-                m_read_buffer.seek_read(header.message_size);
+                source.seek_read(size);
                 return error(read_error::read_unsupported_size);
             }
 
-            if (!m_read_buffer.can_read(header.message_size)) {
-                return try_later();
+            if (!source.can_read(size)) {
+                return m_source == &m_read_buffer ? try_later() : error(read_error::read_failed);
             }
 
-            if (!m_read_buffer.read(buffer, header.message_size)) {
+            if (!source.read(buffer + time_size, size)) {
                 return error(read_error::read_failed);
             }
 
+            if (data.has_send_time) {
+                const auto send_time = obsr::bits::net64(data.send_time);
+                memcpy(buffer, &send_time, sizeof(send_time));
+            }
+
             return finished();
         }
         default:
@@ -66,15 +159,103 @@ bool reader::process_state(read_state current_state, read_data& data) {
     }
 }
 
+bool reader::read_full_header(obsr::io::circular_buffer& buffer, message_header& header) {
+    do {
+        auto success = buffer.find_and_seek_read(message_header::message_magic);
+        if (!success) {
+            return false;
+        }
+
+        success = buffer.read(header);
+        if (!success) {
+            return false;
+        }
+
+        header_convert_host(header);
+    } while (header.magic != message_header::message_magic);
+
+    return true;
+}
+
+bool reader::read_compact_header(obsr::io::circular_buffer& buffer, read_data& data) {
+    uint8_t bytes[1 + 2 * obsr::bits::max_varint_size];
+    const auto available = buffer.peek(bytes, sizeof(bytes));
+
+    const auto type = static_cast<uint8_t>(bytes[0] & ~message_header::compact_frame_flag);
+    size_t used = 1;
+
+    uint64_t size;
+    auto varint_size = obsr::bits::decode_varint(bytes + used, available - used, size);
+    if (varint_size == 0) {
+        return false;
+    }
+    used += varint_size;
+
+    data.has_send_time = has_send_time(static_cast<message_type>(type));
+    if (data.has_send_time) {
+        uint64_t delta;
+        varint_size = obsr::bits::decode_varint(bytes + used, available - used, delta);
+        if (varint_size == 0) {
+            return false;
+        }
+        used += varint_size;
+
+        m_last_send_time += obsr::bits::zigzag_decode(delta);
+        data.send_time = m_last_send_time;
+        size += sizeof(uint64_t);
+    }
+
+    buffer.seek_read(used);
+
+    data.header = {
+            message_header::message_magic,
+            message_header::compact_frame_version,
+            m_next_index++,
+            type,
+            static_cast<uint32_t>(std::min<uint64_t>(size, UINT32_MAX))
+    };
+
+    return true;
+}
+
+connection_info make_connection_info(std::string_view address, uint16_t port) {
+    if (address == shared_memory_address) {
+        return {"", port, transport_type::shared_memory};
+    }
+    if (address.starts_with(local_address_prefix)) {
+        return {"", port, transport_type::local, std::string(address.substr(local_address_prefix.size()))};
+    }
+
+    return {std::string(address), port, transport_type::tcp};
+}
+
 socket_io::socket_io()
-    : m_state(state::idle)
+    : m_options()
+    , m_quick_ack(false)
+    , m_state(state::idle)
     , m_looper(nullptr)
     , m_looper_handle(empty_handle)
+    , m_link_handle(empty_handle)
     , m_callbacks()
     , m_socket()
+    , m_shm()
+    , m_stream(nullptr)
     , m_reader(1024)
-    , m_write_buffer(1024)
+    , m_write_queue()
+    , m_write_queue_size(0)
+    , m_write_offset(0)
     , m_next_message_index(0)
+    , m_writable(false)
+    , m_flush_requested(false)
+    , m_write_refused(false)
+    , m_compact_frames(false)
+    , m_last_send_time(0)
+    , m_compress(false)
+    , m_compress_from(0)
+    , m_deflater()
+    , m_stats(nullptr)
+    , m_batch_buffer()
+    , m_compressed_buffer()
 {}
 
 socket_io::~socket_io() {
@@ -95,14 +276,32 @@ void socket_io::on_message(on_message_cb callback) {
     m_callbacks.on_message = std::move(callback);
 }
 
-void socket_io::start(events::looper* looper) {
+void socket_io::on_drain(on_drain_cb callback) {
+    m_callbacks.on_drain = std::move(callback);
+}
+
+void socket_io::configure(const socket_options& options) {
     if (m_state != state::idle) {
         throw illegal_state_exception("io already started");
     }
 
-    auto socket = std::make_shared<obsr::os::socket>();
+    m_options = options;
+}
+
+void socket_io::attach_stats(io::compression_stats* stats) {
+    m_stats = stats;
+}
+
+void socket_io::start(events::looper* looper, os::socket_domain domain) {
+    if (m_state != state::idle) {
+        throw illegal_state_exception("io already started");
+    }
+
+    auto socket = std::make_shared<obsr::os::socket>(domain);
     try {
-        socket->setoption<os::sockopt_reuseport>(true);
+        if (domain == os::socket_domain::inet) {
+            socket->setoption<os::sockopt_reuseport>(true);
+        }
         socket->configure_blocking(false);
     } catch (const io_exception& e) {
         TRACE_ERROR(LOG_MODULE_CLIENT, "failed creating socket: code=%d", e.get_code());
@@ -123,35 +322,98 @@ void socket_io::start(events::looper* looper,
         throw illegal_state_exception("io already started");
     }
 
+    // unix domain sockets have no use for these options
+    const auto is_tcp = socket->get_domain() == os::socket_domain::inet;
+    if (is_tcp) {
+        configure_tcp_socket(*socket, m_options);
+    }
+
     m_looper = looper;
 
     m_socket = std::move(socket);
     m_socket->configure_blocking(false);
+    m_stream = m_socket.get();
+    m_quick_ack = is_tcp && m_options.quick_ack;
 
     m_state = state::bound;
 
+    m_writable = false;
+    m_flush_requested = false;
+    m_write_refused = false;
+    m_compact_frames = false;
+    m_last_send_time = 0;
+    m_compress = false;
+    m_compress_from = 0;
+    m_deflater.reset();
+    m_reader.clear();
+
     events::event_types events = events::event_hung | events::event_error;
     if (connected) {
-        events |= events::event_in | events::event_out;
+        events |= connected_events;
         m_state = state::connected;
     }
 
-    auto callback = [this](events::looper& looper, obsr::handle handle, events::event_types events)->void {
-        if ((events & (events::event_hung | events::event_error)) != 0) {
-            on_hung_or_error();
-            return;
-        }
+    try {
+        m_looper_handle = m_looper->add(m_socket, events, create_callback());
+    } catch (...) {
+        // looper may be out of space, leave the io as if it was never started
+        m_socket.reset();
+        m_stream = nullptr;
+        m_state = state::idle;
+        throw;
+    }
 
-        if ((events & events::event_in) != 0) {
-            on_read_ready();
-        }
+    // sent once connected, like anything else written before then
+    announce_frame_version();
+}
 
-        if ((events & events::event_out) != 0) {
-            on_write_ready();
+void socket_io::start(events::looper* looper, std::shared_ptr<obsr::os::shm_stream> stream) {
+    if (m_state != state::idle) {
+        throw illegal_state_exception("io already started");
+    }
+
+    m_looper = looper;
+
+    m_shm = std::move(stream);
+    m_stream = m_shm.get();
+    m_quick_ack = false;
+
+    m_state = state::connected;
+
+    m_writable = false;
+    m_flush_requested = false;
+    m_write_refused = false;
+    m_compact_frames = false;
+    m_last_send_time = 0;
+    m_compress = false;
+    m_compress_from = 0;
+    m_deflater.reset();
+    m_reader.clear();
+
+    try {
+        m_looper_handle = m_looper->add(m_shm,
+                                        events::event_hung | events::event_error | connected_events,
+                                        create_callback());
+
+        // the stream itself never hangs up, so we learn of the peer going away from the link
+        m_link_handle = m_looper->add(m_shm->get_link(),
+                                      events::event_hung | events::event_error,
+                                      [this](events::looper&, obsr::handle, events::event_types)->void {
+            on_hung_or_error();
+        });
+    } catch (...) {
+        if (m_looper_handle != empty_handle) {
+            m_looper->remove(m_looper_handle);
+            m_looper_handle = empty_handle;
         }
-    };
 
-    m_looper_handle = m_looper->add(m_socket, events, callback);
+        m_shm.reset();
+        m_stream = nullptr;
+        m_state = state::idle;
+        throw;
+    }
+
+    announce_frame_version();
 }
 
 void socket_io::stop() {
@@ -171,10 +433,16 @@ void socket_io::connect(const connection_info& info) {
     m_looper->request_updates(m_looper_handle, events::event_in, events::looper::events_update_type::remove);
     try {
         m_state = state::connecting;
-        m_socket->connect(info.ip, info.port);
+        if (info.transport == transport_type::local) {
+            m_socket->connect_local(info.path);
+        } else {
+            m_socket->connect(info.ip, info.port);
+        }
     } catch (const io_exception& e) {
         TRACE_DEBUG(LOG_MODULE_CLIENT, "connect failed: code=%d", e.get_code());
-        stop_internal();
+        // the caller learns of the failure from the exception, and may be holding locks
+        // the close callback needs
+        stop_internal(false);
 
         throw;
     }
@@ -182,59 +450,167 @@ void socket_io::connect(const connection_info& info) {
     m_looper->request_updates(m_looper_handle, events::event_out, events::looper::events_update_type::append);
 }
 
-bool socket_io::write(uint8_t type, const uint8_t* buffer, size_t size) {
-    if (!m_write_buffer.can_write(sizeof(message_header) + size)) {
-        TRACE_DEBUG(LOG_MODULE_CLIENT, "write circular_buffer does not have enough space");
+bool socket_io::write(uint8_t type, const io::shared_buffer& payload) {
+    const auto max_size = max_frame_header_size + payload.size();
+    if (m_write_queue_size + max_size > max_write_queue_size) {
+        TRACE_DEBUG(LOG_MODULE_CLIENT, "write queue does not have enough space");
+        m_write_refused = true;
         return false;
     }
 
-    auto index = m_next_message_index++;
+    // the payload is not copied, we only hold a reference to it until it is written into the socket.
+    auto& pending = m_write_queue.emplace_back();
+    pending.payload = payload;
+    pending.payload_offset = 0;
+
+    // the reader of a compact frame of a type with a send time always takes the time from its header,
+    // so a payload too short to start with one is sent with a full header, which may be read at any time
+    const auto fits_compact = !has_send_time(static_cast<message_type>(type)) || payload.size() >= sizeof(uint64_t);
+    if (m_compact_frames && (type & message_header::compact_frame_flag) == 0 && fits_compact) {
+        encode_compact_header(pending, type);
+    } else {
+        encode_full_header(pending, type);
+    }
+
+    m_write_queue_size += pending.size();
+
+    if (m_state == state::connected && m_writable && !m_flush_requested) {
+        // the socket will not report being writable again until it fills up, so flush
+        // from the loop. any writes until then are sent together.
+        m_flush_requested = true;
+        m_looper->notify(m_looper_handle, events::event_out);
+    }
+
+    return true;
+}
+
+void socket_io::encode_full_header(pending_write& pending, uint8_t type) {
     message_header header {
             message_header::message_magic,
-            message_header::current_version,
-            index,
+            message_header::full_frame_version,
+            m_next_message_index++,
             type,
-            static_cast<uint32_t>(size)
+            static_cast<uint32_t>(pending.payload.size())
     };
     header_convert_net(header);
 
-    if (!m_write_buffer.write(reinterpret_cast<uint8_t*>(&header), sizeof(header))) {
-        TRACE_DEBUG(LOG_MODULE_CLIENT, "write failed to circular_buffer at start");
-        return false;
+    memcpy(pending.header, &header, sizeof(header));
+    pending.header_size = sizeof(header);
+}
+
+void socket_io::encode_compact_header(pending_write& pending, uint8_t type) {
+    const auto& payload = pending.payload;
+    // the time is moved from the payload into the header, as a difference from the previous one
+    const auto with_time = has_send_time(static_cast<message_type>(type));
+    if (with_time) {
+        assert(payload.size() >= sizeof(uint64_t));
+        pending.payload_offset = sizeof(uint64_t);
     }
 
-    if (buffer != nullptr && size > 0) {
-        if (!m_write_buffer.write(buffer, size)) {
-            // this means we have probably sent a message with a header but no data. this will seriously
-            // break down communication. as such, we will terminate connection here.
-            TRACE_ERROR(LOG_MODULE_CLIENT, "write attempt failed halfway, stopping");
-            stop_internal();
-            return false;
-        }
+    size_t size = 0;
+    pending.header[size++] = type | message_header::compact_frame_flag;
+    size += obsr::bits::encode_varint(payload.size() - pending.payload_offset, pending.header + size);
+
+    if (with_time) {
+        uint64_t send_time;
+        memcpy(&send_time, payload.data(), sizeof(send_time));
+        send_time = obsr::bits::host64(send_time);
+
+        const auto delta = static_cast<int64_t>(send_time - m_last_send_time);
+        size += obsr::bits::encode_varint(obsr::bits::zigzag_encode(delta), pending.header + size);
+        m_last_send_time = send_time;
     }
 
-    m_looper->request_updates(m_looper_handle, events::event_out, events::looper::events_update_type::append);
+    pending.header_size = static_cast<uint8_t>(size);
+}
 
-    return true;
+void socket_io::announce_frame_version() {
+    const uint8_t announcement[] = {
+            message_header::current_version,
+            io::compression_supported() ? message_header::feature_deflate : static_cast<uint8_t>(0)
+    };
+    // queued first, so is always accepted
+    write(static_cast<uint8_t>(message_type::frame_version), io::shared_buffer(announcement, sizeof(announcement)));
+}
+
+void socket_io::on_frame_version(const uint8_t* buffer, size_t size) {
+    if (size < 1) {
+        return;
+    }
+
+    const auto version = buffer[0];
+    if (version >= message_header::compact_frame_version && !m_compact_frames) {
+        TRACE_INFO(LOG_MODULE_CLIENT, "peer supports version %d, switching to compact frames", version);
+        m_compact_frames = true;
+    }
+
+    // same-host transports have nothing to gain from compression
+    const auto is_tcp = m_socket && m_socket->get_domain() == os::socket_domain::inet;
+    const auto features = size > 1 ? buffer[1] : 0;
+    if (m_compact_frames && is_tcp && m_options.compression && io::compression_supported() &&
+        (features & message_header::feature_deflate) != 0 && !m_compress) {
+        TRACE_INFO(LOG_MODULE_CLIENT, "peer supports compression, compressing batches");
+        m_compress = true;
+        // anything queued until now may be compressed too
+        m_compress_from = 0;
+    }
+}
+
+events::looper::io_callback socket_io::create_callback() {
+    return [this](events::looper& looper, obsr::handle handle, events::event_types events)->void {
+        if ((events & (events::event_hung | events::event_error)) != 0) {
+            on_hung_or_error();
+            return;
+        }
+
+        if ((events & events::event_in) != 0) {
+            on_read_ready();
+        }
+
+        if ((events & events::event_out) != 0 && m_state != state::idle) {
+            on_write_ready();
+        }
+    };
 }
 
 void socket_io::on_read_ready() {
     TRACE_DEBUG(LOG_MODULE_CLIENT, "on read update");
 
     if (m_state == state::connected) {
-        try {
-            m_reader.update(m_socket.get());
-        } catch (const eof_exception&) {
-            // socket was closed
-            TRACE_ERROR(LOG_MODULE_CLIENT, "read eof");
-            stop_internal();
-        } catch (...) {
-            // any other error
-            TRACE_ERROR(LOG_MODULE_CLIENT, "read error");
-            stop_internal();
-        }
+        // edge-triggered, so read until there is nothing left in the socket
+        bool progress;
+        do {
+            const auto before_read = m_reader.available();
+            try {
+                m_reader.update(m_stream);
+            } catch (const eof_exception&) {
+                // socket was closed
+                TRACE_ERROR(LOG_MODULE_CLIENT, "read eof");
+                stop_internal();
+                return;
+            } catch (...) {
+                // any other error
+                TRACE_ERROR(LOG_MODULE_CLIENT, "read error");
+                stop_internal();
+                return;
+            }
+
+            const auto after_read = m_reader.available();
+            process_new_data();
+
+            // the buffer may have been full, in which case processing it makes room for more
+            progress = after_read != before_read || m_reader.available() != after_read;
+        } while (progress && m_state == state::connected);
 
-        process_new_data();
+        if (m_quick_ack && m_state == state::connected) {
+            // the kernel leaves quick ack mode on its own, so it is renewed after each read
+            try {
+                m_socket->setoption<os::sockopt_quickack>(true);
+            } catch (const io_exception& e) {
+                TRACE_ERROR(LOG_MODULE_CLIENT, "failed to renew quick ack: code=%d", e.get_code());
+                m_quick_ack = false;
+            }
+        }
     } else {
         // we shouldn't be here
         m_looper->request_updates(m_looper_handle, events::event_in, events::looper::events_update_type::remove);
@@ -258,21 +634,30 @@ void socket_io::on_write_ready() {
         }
 
         m_state = state::connected;
-        // we can start reading again
-        m_looper->request_updates(m_looper_handle, events::event_in, events::looper::events_update_type::append);
+        // we can start reading again. the looper will report the socket as writable
+        // once registered, which will flush anything written while connecting.
+        m_looper->request_updates(m_looper_handle,
+                                  events::event_hung | events::event_error | connected_events,
+                                  events::looper::events_update_type::override);
 
         invoke_func_nolock(m_callbacks.on_connect);
     } else if (m_state == state::connected) {
+        m_flush_requested = false;
         try {
             TRACE_DEBUG(LOG_MODULE_CLIENT, "writing to socket");
-            if (!m_write_buffer.write_into(m_socket.get())) {
-                TRACE_DEBUG(LOG_MODULE_CLIENT, "nothing more to write");
-                // nothing more to write
-                m_looper->request_updates(m_looper_handle, events::event_out, events::looper::events_update_type::remove);
-            }
+            // if not everything was written, the socket is full and will report when
+            // it can be written to again.
+            m_writable = !write_pending();
         } catch (const io_exception& e) {
             TRACE_ERROR(LOG_MODULE_CLIENT, "write error: code=%d", e.get_code());
             stop_internal();
+            return;
+        }
+
+        if (m_writable && m_write_refused) {
+            // whoever was refused may now write again
+            m_write_refused = false;
+            invoke_func_nolock(m_callbacks.on_drain);
         }
     } else {
         // we shouldn't be here
@@ -281,7 +666,8 @@ void socket_io::on_write_ready() {
 }
 
 void socket_io::on_hung_or_error() {
-    TRACE_ERROR(LOG_MODULE_CLIENT, "received error/hung event. internal error=%d", m_socket->get_internal_error());
+    TRACE_ERROR(LOG_MODULE_CLIENT, "received error/hung event. internal error=%d",
+                m_socket ? m_socket->get_internal_error() : 0);
     stop_internal();
 }
 
@@ -298,6 +684,19 @@ void socket_io::process_new_data() {
             auto& state = m_reader.data();
             TRACE_DEBUG(LOG_MODULE_CLIENT, "new message processed %d", state.header.index);
 
+            if (state.header.type == static_cast<uint8_t>(message_type::frame_version)) {
+                on_frame_version(state.message_buffer, state.header.message_size);
+                m_reader.reset();
+                run = true;
+                continue;
+            }
+            if (state.header.type == static_cast<uint8_t>(message_type::compressed_frames)) {
+                expand_frames(state.message_buffer, state.header.message_size);
+                m_reader.reset();
+                run = m_state == state::connected;
+                continue;
+            }
+
             invoke_func_nolock<const message_header&, const uint8_t*, size_t>(
                     m_callbacks.on_message,
                     state.header,
@@ -314,6 +713,160 @@ void socket_io::process_new_data() {
     } while (run);
 }
 
+bool socket_io::write_pending() {
+    if (m_compress) {
+        compress_pending();
+    }
+
+    while (!m_write_queue.empty()) {
+        os::io_vector vectors[max_write_vectors];
+        size_t count = 0;
+        size_t requested = 0;
+
+        // the first pending message may have been partially written, m_write_offset marks
+        // how much of it (header and payload) was already sent.
+        size_t offset = m_write_offset;
+        for (auto& pending : m_write_queue) {
+            if (count + 2 > max_write_vectors) {
+                break;
+            }
+
+            size_t payload_offset = pending.payload_offset;
+            if (offset < pending.header_size) {
+                vectors[count++] = {pending.header + offset, pending.header_size - offset};
+                requested += pending.header_size - offset;
+            } else {
+                payload_offset += offset - pending.header_size;
+            }
+
+            if (pending.payload.size() > payload_offset) {
+                const auto payload_size = pending.payload.size() - payload_offset;
+                vectors[count++] = {pending.payload.data() + payload_offset, payload_size};
+                requested += payload_size;
+            }
+
+            offset = 0;
+        }
+
+        const auto written = m_stream->writev(vectors, count);
+        m_write_queue_size -= written;
+
+        auto consumed = m_write_offset + written;
+        while (!m_write_queue.empty()) {
+            const auto message_size = m_write_queue.front().size();
+            if (consumed < message_size) {
+                break;
+            }
+
+            consumed -= message_size;
+            m_write_queue.pop_front();
+            m_compress_from -= std::min<size_t>(m_compress_from, 1);
+        }
+        m_write_offset = consumed;
+
+        if (written < requested) {
+            // socket cannot take any more at the moment
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void socket_io::compress_pending() {
+    // the first message may have been partially written already, and is left as is
+    auto index = std::max<size_t>(m_compress_from, m_write_offset > 0 ? 1 : 0);
+    while (index < m_write_queue.size() && m_compress) {
+        // runs of whole messages, up to what fits in a single compressed frame
+        size_t count = 0;
+        size_t size = 0;
+        while (index + count < m_write_queue.size() &&
+               size + m_write_queue[index + count].size() <= max_compressed_batch_size) {
+            size += m_write_queue[index + count].size();
+            count++;
+        }
+
+        if (count == 0) {
+            // too large to compress on its own
+            index++;
+        } else if (size < m_options.compression_threshold) {
+            index += count;
+        } else if (compress_batch(index, count, size)) {
+            index++;
+        } else {
+            index += count;
+        }
+    }
+
+    m_compress_from = m_write_queue.size();
+}
+
+bool socket_io::compress_batch(size_t index, size_t count, size_t size) {
+    size_t offset = 0;
+    for (size_t i = index; i < index + count; i++) {
+        const auto& pending = m_write_queue[i];
+        memcpy(m_batch_buffer + offset, pending.header, pending.header_size);
+        offset += pending.header_size;
+
+        const auto payload_size = pending.payload.size() - pending.payload_offset;
+        memcpy(m_batch_buffer + offset, pending.payload.data() + pending.payload_offset, payload_size);
+        offset += payload_size;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto compressed_size = m_deflater.compress(m_batch_buffer, size,
+                                                     m_compressed_buffer, sizeof(m_compressed_buffer));
+    const auto time = std::chrono::steady_clock::now() - start;
+
+    if (compressed_size == 0) {
+        // the stream is unusable from here on, but nothing of this batch was sent yet
+        TRACE_ERROR(LOG_MODULE_CLIENT, "failed compressing batch of size %lu, no longer compressing", size);
+        m_compress = false;
+        return false;
+    }
+
+    // sent even if it did not get smaller, as the peer must see everything that went into the stream
+    pending_write batch{};
+    batch.payload = io::shared_buffer(m_compressed_buffer, compressed_size);
+    batch.payload_offset = 0;
+    encode_compact_header(batch, static_cast<uint8_t>(message_type::compressed_frames));
+
+    const auto begin = m_write_queue.begin() + static_cast<ptrdiff_t>(index);
+    m_write_queue.erase(begin, begin + static_cast<ptrdiff_t>(count));
+    m_write_queue.insert(m_write_queue.begin() + static_cast<ptrdiff_t>(index), std::move(batch));
+    m_write_queue_size = m_write_queue_size - size + m_write_queue[index].size();
+
+    if (m_stats != nullptr) {
+        m_stats->compressed_batches.fetch_add(1, std::memory_order_relaxed);
+        m_stats->bytes_before_compression.fetch_add(size, std::memory_order_relaxed);
+        m_stats->bytes_after_compression.fetch_add(m_write_queue[index].size(), std::memory_order_relaxed);
+        m_stats->compress_time_ns.fetch_add(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(time).count(),
+                std::memory_order_relaxed);
+    }
+
+    return true;
+}
+
+void socket_io::expand_frames(const uint8_t* buffer, size_t size) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto success = m_reader.expand(buffer, size);
+    const auto time = std::chrono::steady_clock::now() - start;
+
+    if (!success) {
+        TRACE_ERROR(LOG_MODULE_CLIENT, "received corrupt compressed frames");
+        stop_internal();
+        return;
+    }
+
+    if (m_stats != nullptr) {
+        m_stats->decompressed_batches.fetch_add(1, std::memory_order_relaxed);
+        m_stats->decompress_time_ns.fetch_add(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(time).count(),
+                std::memory_order_relaxed);
+    }
+}
+
 void socket_io::stop_internal(bool notify) {
     if (m_state == state::idle) {
         return;
@@ -326,6 +879,10 @@ void socket_io::stop_internal(bool notify) {
             m_looper->remove(m_looper_handle);
             m_looper_handle = empty_handle;
         }
+        if (m_link_handle != empty_handle) {
+            m_looper->remove(m_link_handle);
+            m_link_handle = empty_handle;
+        }
     } catch (const std::exception& e) {
         TRACE_ERROR(LOG_MODULE_SERVER, "Error while detaching from looper: what=%s", e.what());
     } catch (...) {
@@ -333,14 +890,35 @@ void socket_io::stop_internal(bool notify) {
     }
 
     try {
-        m_socket->close();
-        m_socket.reset();
+        if (m_socket) {
+            m_socket->close();
+            m_socket.reset();
+        }
+        if (m_shm) {
+            m_shm->get_link()->close();
+            m_shm->close();
+            m_shm.reset();
+        }
+        m_stream = nullptr;
     } catch (const std::exception& e) {
         TRACE_ERROR(LOG_MODULE_SERVER, "Error while closing socket: what=%s", e.what());
     } catch (...) {
         TRACE_ERROR(LOG_MODULE_CLIENT, "Error while closing socket: unknown");
     }
 
+    m_write_queue.clear();
+    m_write_queue_size = 0;
+    m_write_offset = 0;
+    m_writable = false;
+    m_flush_requested = false;
+    m_write_refused = false;
+    m_compact_frames = false;
+    m_last_send_time = 0;
+    m_compress = false;
+    m_compress_from = 0;
+    m_deflater.reset();
+    m_reader.clear();
+
     m_state = state::idle;
 
     if (notify) {
@@ -348,12 +926,230 @@ void socket_io::stop_internal(bool notify) {
     }
 }
 
+multicast_sender::multicast_sender()
+    : m_mutex()
+    , m_socket()
+    , m_next_message_index(0)
+{}
+
+void multicast_sender::open(const std::string& group, uint16_t port) {
+    std::unique_lock lock(m_mutex);
+
+    if (m_socket) {
+        throw illegal_state_exception("sender already open");
+    }
+
+    auto socket = std::make_shared<obsr::os::datagram_socket>();
+    // a full socket buffer drops the datagram rather than blocking, same as the network would
+    socket->configure_blocking(false);
+    socket->configure_multicast(multicast_ttl, true);
+    socket->set_destination(group, port);
+
+    m_socket = std::move(socket);
+    m_next_message_index = 0;
+}
+
+void multicast_sender::close() {
+    std::unique_lock lock(m_mutex);
+
+    if (m_socket) {
+        m_socket->close();
+        m_socket.reset();
+    }
+}
+
+bool multicast_sender::is_open() const {
+    return static_cast<bool>(m_socket);
+}
+
+bool multicast_sender::send(uint8_t type, const io::shared_buffer& payload, uint16_t origin) {
+    if (payload.size() > read_data::message_buffer_size) {
+        return false;
+    }
+
+    // numbering and sending under the same lock keeps the datagrams in order
+    std::unique_lock lock(m_mutex);
+
+    if (!m_socket) {
+        return false;
+    }
+
+    multicast_header header {
+            {
+                    message_header::message_magic,
+                    message_header::full_frame_version,
+                    m_next_message_index,
+                    type,
+                    static_cast<uint32_t>(payload.size())
+            },
+            obsr::bits::net16(origin)
+    };
+    header_convert_net(header.message);
+
+    os::io_vector vectors[] = {
+            {reinterpret_cast<const uint8_t*>(&header), sizeof(header)},
+            {payload.data(), payload.size()}
+    };
+
+    // the number is used even if sending fails, so receivers see it as lost
+    m_next_message_index++;
+
+    try {
+        return m_socket->send(vectors, payload.empty() ? 1 : 2) > 0;
+    } catch (const io_exception& e) {
+        TRACE_ERROR(LOG_MODULE_SERVER, "failed sending multicast message: code=%d", e.get_code());
+        return false;
+    }
+}
+
+multicast_receiver::multicast_receiver()
+    : m_looper(nullptr)
+    , m_looper_handle(empty_handle)
+    , m_on_message(nullptr)
+    , m_socket()
+    , m_ignored_origin(0)
+    , m_has_index(false)
+    , m_next_index(0)
+    , m_lost_count(0)
+    , m_buffer()
+{}
+
+multicast_receiver::~multicast_receiver() {
+    if (m_socket) {
+        std::abort();
+    }
+}
+
+void multicast_receiver::on_message(on_message_cb callback) {
+    m_on_message = std::move(callback);
+}
+
+void multicast_receiver::start(events::looper* looper, const std::string& group, uint16_t port, uint16_t ignored_origin) {
+    if (m_socket) {
+        throw illegal_state_exception("receiver already started");
+    }
+
+    auto socket = std::make_shared<obsr::os::datagram_socket>();
+    try {
+        // several nodes on the same host may listen to the same group
+        socket->setoption<os::sockopt_reuseport>(true);
+        socket->configure_blocking(false);
+        socket->bind(group, port);
+        socket->join_multicast_group(group);
+    } catch (const io_exception& e) {
+        TRACE_ERROR(LOG_MODULE_CLIENT, "failed opening multicast socket: code=%d", e.get_code());
+        socket->close();
+        throw;
+    }
+
+    m_looper = looper;
+    m_looper_handle = m_looper->add(socket, events::event_in,
+                                    [this](events::looper&, obsr::handle, events::event_types)->void {
+        on_read_ready();
+    });
+
+    m_socket = std::move(socket);
+    m_ignored_origin = ignored_origin;
+    m_has_index = false;
+    m_next_index = 0;
+    m_lost_count = 0;
+}
+
+void multicast_receiver::stop() {
+    if (!m_socket) {
+        return;
+    }
+
+    try {
+        m_looper->remove(m_looper_handle);
+    } catch (const std::exception& e) {
+        TRACE_ERROR(LOG_MODULE_CLIENT, "Error while detaching from looper: what=%s", e.what());
+    }
+    m_looper_handle = empty_handle;
+
+    m_socket->close();
+    m_socket.reset();
+}
+
+uint64_t multicast_receiver::get_lost_count() const {
+    return m_lost_count;
+}
+
+void multicast_receiver::on_read_ready() {
+    for (size_t i = 0; i < max_datagrams_per_event && m_socket; ++i) {
+        size_t size;
+        try {
+            size = m_socket->receive(m_buffer, sizeof(m_buffer));
+        } catch (const io_exception& e) {
+            TRACE_ERROR(LOG_MODULE_CLIENT, "multicast receive error: code=%d", e.get_code());
+            return;
+        }
+
+        if (size == 0) {
+            return;
+        }
+
+        process_datagram(size);
+    }
+}
+
+void multicast_receiver::process_datagram(size_t size) {
+    if (size < sizeof(multicast_header)) {
+        return;
+    }
+
+    multicast_header multicast{};
+    memcpy(&multicast, m_buffer, sizeof(multicast));
+    auto& header = multicast.message;
+    header_convert_host(header);
+
+    if (header.magic != message_header::message_magic ||
+        header.version != message_header::full_frame_version ||
+        header.message_size != size - sizeof(multicast_header)) {
+        return;
+    }
+
+    if (m_has_index) {
+        const auto distance = static_cast<int32_t>(header.index - m_next_index);
+        if (distance < 0) {
+            // arrived after a newer message, which it would override
+            return;
+        } else if (distance > 0) {
+            m_lost_count += distance;
+            TRACE_INFO(LOG_MODULE_CLIENT, "lost %d multicast messages", distance);
+        }
+    }
+
+    m_has_index = true;
+    m_next_index = header.index + 1;
+
+    if (obsr::bits::host16(multicast.origin) == m_ignored_origin) {
+        return;
+    }
+
+    invoke_func_nolock<const message_header&, const uint8_t*, size_t>(
+            m_on_message,
+            header,
+            m_buffer + sizeof(multicast_header),
+            header.message_size);
+}
+
 server_io::server_io()
     : m_state(state::idle)
     , m_looper(nullptr)
     , m_looper_handle(empty_handle)
     , m_callbacks()
     , m_socket()
+    , m_local_socket()
+    , m_local_handle(empty_handle)
+    , m_shm_listener()
+    , m_shm_handle(empty_handle)
+    , m_max_clients(0)
+    , m_socket_options()
+    , m_compression_stats()
+    , m_shards()
+    , m_next_shard(0)
+    , m_clients_mutex()
     , m_clients()
     , m_next_client_id(0)
 {}
@@ -380,7 +1176,11 @@ void server_io::on_message(on_message_cb callback) {
     m_callbacks.on_message = std::move(callback);
 }
 
-void server_io::start(events::looper* looper, uint16_t bind_port) {
+void server_io::on_drain(on_drain_cb callback) {
+    m_callbacks.on_drain = std::move(callback);
+}
+
+void server_io::start(events::looper* looper, uint16_t bind_port, const server_options& options) {
     if (m_state != state::idle) {
         throw illegal_state_exception("io already started");
     }
@@ -389,15 +1189,30 @@ void server_io::start(events::looper* looper, uint16_t bind_port) {
 
     TRACE_INFO(LOG_MODULE_SERVER, "start called");
 
-    m_clients.clear();
+    {
+        std::unique_lock lock(m_clients_mutex);
+        m_clients.clear();
+    }
     m_next_client_id = 0;
+    m_socket_options = options.sockets;
+    m_max_clients = std::min(options.max_clients, static_cast<size_t>(invalid_client_id));
 
     try {
         m_socket = std::make_shared<obsr::os::server_socket>();
         m_socket->setoption<os::sockopt_reuseport>(true);
+        // accepted sockets inherit the buffer sizes, which must be known before the
+        // connection is established for the window to be scaled to them
+        configure_buffer_sizes(*m_socket, options.sockets);
         m_socket->configure_blocking(false);
         m_socket->bind(bind_port);
-        m_socket->listen(2);
+        m_socket->listen(options.listen_backlog);
+
+        if (!options.local_path.empty()) {
+            m_local_socket = std::make_shared<obsr::os::server_socket>(os::socket_domain::local);
+            m_local_socket->configure_blocking(false);
+            m_local_socket->bind_local(options.local_path);
+            m_local_socket->listen(options.listen_backlog);
+        }
     } catch (const io_exception& e) {
         TRACE_ERROR(LOG_MODULE_SERVER, "start failed: code=%d", e.get_code());
 
@@ -405,25 +1220,76 @@ void server_io::start(events::looper* looper, uint16_t bind_port) {
             m_socket->close();
             m_socket.reset();
         }
+        if (m_local_socket) {
+            m_local_socket->close();
+            m_local_socket.reset();
+        }
 
         throw;
     }
 
+    // with a single io thread, clients are handled on the looper of the server itself
+    m_shards.clear();
+    m_next_shard = 0;
+    if (options.io_threads > 1) {
+        for (size_t i = 0; i < options.io_threads; ++i) {
+            auto shard_looper = std::make_shared<events::looper>();
+            auto shard_thread = std::make_unique<events::looper_thread>(shard_looper);
+            m_shards.push_back({std::move(shard_looper), std::move(shard_thread)});
+        }
+    }
+
     m_state = state::open;
 
     events::event_types events = events::event_hung | events::event_error | events::event_in;
-    auto callback = [this](events::looper& looper, obsr::handle handle, events::event_types events)->void {
-        if ((events & (events::event_hung | events::event_error)) != 0) {
-            on_hung_or_error();
-            return;
+    auto create_callback = [this](obsr::os::server_socket& socket) {
+        return [this, &socket](events::looper& looper, obsr::handle handle, events::event_types events)->void {
+            if ((events & (events::event_hung | events::event_error)) != 0) {
+                on_hung_or_error();
+                return;
+            }
+
+            if ((events & events::event_in) != 0) {
+                on_read_ready(socket);
+            }
+        };
+    };
+
+    m_looper_handle = m_looper->add(m_socket, events, create_callback(*m_socket));
+    if (m_local_socket) {
+        m_local_handle = m_looper->add(m_local_socket, events, create_callback(*m_local_socket));
+    }
+
+    if (options.shared_memory) {
+        // same-host clients are optional, so the server works without them
+        try {
+            m_shm_listener = std::make_shared<obsr::os::shm_listener>(bind_port);
+            m_shm_handle = m_looper->add(m_shm_listener, events::event_in,
+                                         [this](events::looper&, obsr::handle, events::event_types)->void {
+                on_shm_read_ready();
+            });
+        } catch (const std::exception& e) {
+            TRACE_ERROR(LOG_MODULE_SERVER, "failed to listen for shared memory clients: what=%s", e.what());
+            m_shm_listener.reset();
         }
+    }
 
-        if ((events & events::event_in) != 0) {
-            on_read_ready();
+    // each client takes a resource in the looper it is handled by (two over shared memory), so the loopers
+    // limit how many there may be. this runs from the looper, so no client is accepted before the limit is set.
+    size_t client_capacity = 0;
+    if (m_shards.empty()) {
+        client_capacity = m_looper->get_free_resources();
+    } else {
+        for (auto& shard : m_shards) {
+            client_capacity += shard.looper->get_free_resources();
         }
-    };
+    }
 
-    m_looper_handle = m_looper->add(m_socket, events, callback);
+    if (m_max_clients > client_capacity) {
+        TRACE_INFO(LOG_MODULE_SERVER, "io threads can handle up to %lu clients, limiting max clients to it",
+                   client_capacity);
+        m_max_clients = client_capacity;
+    }
 }
 
 void server_io::stop() {
@@ -434,56 +1300,165 @@ void server_io::stop() {
     stop_internal(false);
 }
 
-bool server_io::write_to(client_id id, uint8_t type, const uint8_t* buffer, size_t size) {
-    if (m_state != state::open) {
-        throw illegal_state_exception("io not started");
-    }
+events::looper* server_io::get_looper_for(client_id id) {
+    std::shared_lock lock(m_clients_mutex);
 
     auto it = m_clients.find(id);
     if (it == m_clients.end()) {
-        throw illegal_argument_exception("no such client");
+        return nullptr;
+    }
+
+    return it->second->get_looper();
+}
+
+bool server_io::write_to(client_id id, uint8_t type, const io::shared_buffer& payload) {
+    std::shared_ptr<client> client;
+    {
+        std::shared_lock lock(m_clients_mutex);
+
+        auto it = m_clients.find(id);
+        if (it == m_clients.end()) {
+            throw illegal_argument_exception("no such client");
+        }
+
+        client = it->second;
     }
 
-    return it->second->write(type, buffer, size);
+    return client->write(type, payload);
+}
+
+const io::compression_stats& server_io::get_compression_stats() const {
+    return m_compression_stats;
 }
 
-void server_io::on_read_ready() {
+void server_io::on_read_ready(obsr::os::server_socket& server_socket) {
     TRACE_DEBUG(LOG_MODULE_SERVER, "on read ready");
 
-    client_id id = invalid_client_id;
-    try {
-        auto socket = m_socket->accept();
+    // drain the pending connections, but leave some room for other events
+    // in the looper. any remaining connections will trigger another event.
+    for (size_t i = 0; i < max_accepts_per_event; ++i) {
+        std::shared_ptr<obsr::os::socket> socket;
+        try {
+            socket = server_socket.accept();
+        } catch (const io_exception& e) {
+            TRACE_ERROR(LOG_MODULE_SERVER, "error accepting new client: code=%d", e.get_code());
+            return;
+        }
+
+        if (!socket) {
+            // no more pending connections
+            return;
+        }
+
+        handle_new_client(std::move(socket));
+    }
+}
 
-        id = m_next_client_id++;
-        TRACE_INFO(LOG_MODULE_SERVER, "handling new server client %d", id);
+void server_io::on_shm_read_ready() {
+    TRACE_DEBUG(LOG_MODULE_SERVER, "on shared memory read ready");
 
-        auto client = std::make_unique<server_io::client>(*this, id);
-        auto [it, inserted] = m_clients.emplace(id, std::move(client));
+    for (size_t i = 0; i < max_accepts_per_event; ++i) {
+        std::shared_ptr<obsr::os::shm_stream> stream;
+        try {
+            stream = m_shm_listener->accept();
+        } catch (const io_exception& e) {
+            TRACE_ERROR(LOG_MODULE_SERVER, "error accepting new shared memory client: code=%d", e.get_code());
+            return;
+        }
+
+        if (!stream) {
+            return;
+        }
+
+        handle_new_client(std::move(stream));
+    }
+}
+
+void server_io::on_hung_or_error() {
+    TRACE_ERROR(LOG_MODULE_SERVER, "received error/hung event. internal error=%d", m_socket->get_internal_error());
+    stop_internal();
+}
+
+template<typename stream_>
+void server_io::handle_new_client(std::shared_ptr<stream_> socket) {
+    auto looper = next_client_looper();
+
+    client_id id;
+    std::shared_ptr<client> client;
+    {
+        std::unique_lock lock(m_clients_mutex);
+
+        if (m_clients.size() >= m_max_clients) {
+            TRACE_ERROR(LOG_MODULE_SERVER, "reached max clients (%lu), refusing new client", m_max_clients);
+            socket->close();
+            return;
+        }
+
+        // ids wrap around, and are given again once the clients holding them are gone. with fewer clients
+        // than ids, a free one is always found.
+        id = m_next_client_id;
+        while (id == invalid_client_id || m_clients.contains(id)) {
+            id++;
+        }
+        m_next_client_id = static_cast<client_id>(id + 1);
+
+        client = std::make_shared<server_io::client>(*this, id, looper);
+
+        auto [it, inserted] = m_clients.emplace(id, client);
         if (!inserted) {
             TRACE_ERROR(LOG_MODULE_SERVER, "failed to store new client");
             socket->close();
             return;
         }
+    }
 
-        it->second->start(m_looper, std::move(socket));
-        invoke_func_nolock(m_callbacks.on_connect, id);
+    TRACE_INFO(LOG_MODULE_SERVER, "handling new server client %d", id);
 
-        TRACE_ERROR(LOG_MODULE_SERVER, "new client registered %d", id);
-    } catch (const io_exception& e) {
-        TRACE_ERROR(LOG_MODULE_SERVER, "error with new server: code=%d", e.get_code());
+    // the client is started from its own looper, so that all of its callbacks
+    // run on the same thread.
+    looper->request_execute([this, id, client, socket](events::looper&)->void {
+        {
+            std::shared_lock lock(m_clients_mutex);
 
-        if (id != invalid_client_id) {
             auto it = m_clients.find(id);
-            if (it != m_clients.end()) {
-                m_clients.erase(it);
+            if (it == m_clients.end() || it->second != client) {
+                // server was stopped before the client got to start
+                socket->close();
+                return;
             }
         }
+
+        try {
+            client->start(socket);
+        } catch (const std::exception& e) {
+            TRACE_ERROR(LOG_MODULE_SERVER, "error starting new client: what=%s", e.what());
+            remove_client(id);
+            return;
+        }
+
+        invoke_func_nolock(m_callbacks.on_connect, id);
+        TRACE_INFO(LOG_MODULE_SERVER, "new client registered %d", id);
+    });
+}
+
+events::looper* server_io::next_client_looper() {
+    if (m_shards.empty()) {
+        return m_looper;
     }
+
+    auto& shard = m_shards[m_next_shard];
+    m_next_shard = (m_next_shard + 1) % m_shards.size();
+
+    return shard.looper.get();
 }
 
-void server_io::on_hung_or_error() {
-    TRACE_ERROR(LOG_MODULE_SERVER, "received error/hung event. internal error=%d", m_socket->get_internal_error());
-    stop_internal();
+void server_io::remove_client(client_id id) {
+    std::unique_lock lock(m_clients_mutex);
+
+    auto it = m_clients.find(id);
+    if (it != m_clients.end()) {
+        m_clients.erase(it);
+    }
 }
 
 void server_io::stop_internal(bool notify) {
@@ -498,26 +1473,60 @@ void server_io::stop_internal(bool notify) {
             m_looper->remove(m_looper_handle);
             m_looper_handle = empty_handle;
         }
+        if (m_local_handle != empty_handle) {
+            m_looper->remove(m_local_handle);
+            m_local_handle = empty_handle;
+        }
+        if (m_shm_handle != empty_handle) {
+            m_looper->remove(m_shm_handle);
+            m_shm_handle = empty_handle;
+        }
     } catch (const std::exception& e) {
         TRACE_ERROR(LOG_MODULE_SERVER, "Error while detaching from looper: what=%s", e.what());
     } catch (...) {
         TRACE_ERROR(LOG_MODULE_SERVER, "Error while detaching from looper: unknown");
     }
 
-    for (auto& [id, client] : m_clients) {
+    std::unordered_map<client_id, std::shared_ptr<client>> clients;
+    {
+        std::unique_lock lock(m_clients_mutex);
+        clients.swap(m_clients);
+    }
+
+    for (auto& [id, client] : clients) {
         try {
-            client->stop();
+            auto client_looper = client->get_looper();
+            if (client_looper == m_looper) {
+                client->stop();
+            } else {
+                // clients must be stopped from their own looper
+                client_looper->request_execute([client](events::looper&)->void {
+                    client->stop();
+                }, events::looper::execute_type::sync);
+            }
         } catch (const std::exception& e) {
             TRACE_ERROR(LOG_MODULE_SERVER, "Error stopping client: what=%s", e.what());
         } catch (...) {
             TRACE_ERROR(LOG_MODULE_SERVER, "Error stopping client: unknown");
         }
     }
-    m_clients.clear();
+    clients.clear();
+
+    // stops and joins the io threads
+    m_shards.clear();
 
     try {
         m_socket->close();
         m_socket.reset();
+
+        if (m_local_socket) {
+            m_local_socket->close();
+            m_local_socket.reset();
+        }
+        if (m_shm_listener) {
+            m_shm_listener->close();
+            m_shm_listener.reset();
+        }
     } catch (const std::exception& e) {
         TRACE_ERROR(LOG_MODULE_SERVER, "Error while closing socket: what=%s", e.what());
     } catch (...) {
@@ -531,11 +1540,13 @@ void server_io::stop_internal(bool notify) {
     }
 }
 
-server_io::client::client(server_io& parent, client_id id)
+server_io::client::client(server_io& parent, client_id id, events::looper* looper)
     : m_parent(parent)
     , m_id(id)
+    , m_looper(looper)
     , m_io()
     , m_closing(false) {
+    m_io.attach_stats(&m_parent.m_compression_stats);
     m_io.on_connect([this]()->void {
         invoke_func_nolock(
                 m_parent.m_callbacks.on_connect,
@@ -545,6 +1556,13 @@ server_io::client::client(server_io& parent, client_id id)
         invoke_func_nolock(
                 m_parent.m_callbacks.on_disconnect,
                 m_id);
+
+        // we are called from inside the io, so removing (and destroying) the client must be deferred
+        auto& parent = m_parent;
+        auto id = m_id;
+        m_looper->request_execute([&parent, id](events::looper&)->void {
+            parent.remove_client(id);
+        });
     });
     m_io.on_message([this](const message_header& header, const uint8_t* buffer, size_t size)->void {
         invoke_func_nolock<client_id, const message_header&, const uint8_t*, size_t>(
@@ -554,10 +1572,24 @@ server_io::client::client(server_io& parent, client_id id)
                 buffer,
                 size);
     });
+    m_io.on_drain([this]()->void {
+        invoke_func_nolock(
+                m_parent.m_callbacks.on_drain,
+                m_id);
+    });
+}
+
+events::looper* server_io::client::get_looper() const {
+    return m_looper;
+}
+
+void server_io::client::start(std::shared_ptr<obsr::os::socket> socket) {
+    m_io.configure(m_parent.m_socket_options);
+    m_io.start(m_looper, std::move(socket), true);
 }
 
-void server_io::client::start(events::looper* looper, std::shared_ptr<obsr::os::socket> socket) {
-    m_io.start(looper, std::move(socket), true);
+void server_io::client::start(std::shared_ptr<obsr::os::shm_stream> stream) {
+    m_io.start(m_looper, std::move(stream));
 }
 
 void server_io::client::stop() {
@@ -565,8 +1597,8 @@ void server_io::client::stop() {
     m_io.stop();
 }
 
-bool server_io::client::write(uint8_t type, const uint8_t* buffer, size_t size) {
-    return m_io.write(type, buffer, size);
+bool server_io::client::write(uint8_t type, const io::shared_buffer& payload) {
+    return m_io.write(type, payload);
 }
 
 }
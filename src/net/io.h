@@ -2,23 +2,49 @@
 
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <deque>
+#include <vector>
 
 #include "os/socket.h"
+#include "os/shm.h"
 #include "io/buffer.h"
+#include "io/compress.h"
 #include "util/state.h"
+#include "util/bits.h"
 #include "net/serialize.h"
 #include "events/events.h"
 
 namespace obsr::net {
 
+enum class transport_type {
+    tcp,
+    // same-host, over shared memory. the port identifies the server.
+    shared_memory,
+    // same-host, over a unix domain socket at the path
+    local
+};
+
 struct connection_info {
     std::string ip;
     uint16_t port;
+    transport_type transport = transport_type::tcp;
+    std::string path = {};
 };
 
+// address which targets a server on the same host over shared memory
+static constexpr std::string_view shared_memory_address = "shm";
+// prefix of addresses which target a unix domain socket path
+static constexpr std::string_view local_address_prefix = "unix:";
+
+connection_info make_connection_info(std::string_view address, uint16_t port);
+
 struct read_data {
     static constexpr size_t message_buffer_size = 1024;
     message_header header;
+    // of compact frames, restored into the start of the payload
+    bool has_send_time;
+    uint64_t send_time;
     uint8_t message_buffer[message_buffer_size];
 };
 
@@ -30,20 +56,40 @@ enum class read_state {
 enum read_error {
     read_unsupported_size = 1,
     read_unknown_state = 2,
-    read_failed = 3
+    read_failed = 3,
+    // the peer frames messages with another version, which we cannot read
+    read_unsupported_version = 4
 };
 
+// reads both full and compact frames
 class reader : public state_machine<read_state, read_state::header, read_data> {
 public:
     explicit reader(size_t buffer_size);
 
     bool update(obsr::os::readable* readable);
+    size_t available() const;
+    // drops anything read, for use with a new connection
+    void clear();
+    // decompresses the payload of a compressed_frames message. the frames in it are read
+    // before anything else. returns false if it is corrupt.
+    bool expand(const uint8_t* data, size_t size);
 
 protected:
     bool process_state(read_state current_state, read_data& data) override;
 
 private:
+    bool read_full_header(obsr::io::circular_buffer& buffer, message_header& header);
+    bool read_compact_header(obsr::io::circular_buffer& buffer, read_data& data);
+
     obsr::io::circular_buffer m_read_buffer;
+    uint64_t m_last_send_time;
+    uint32_t m_next_index;
+
+    obsr::io::inflater m_inflater;
+    obsr::io::circular_buffer m_expanded_buffer;
+    // buffer the current frame is read from
+    obsr::io::circular_buffer* m_source;
+    uint8_t m_expand_output[read_data::message_buffer_size];
 };
 
 // must be used from inside the looper
@@ -52,6 +98,7 @@ public:
     using on_connect_cb = std::function<void()>;
     using on_close_cb = std::function<void()>;
     using on_message_cb = std::function<void(const message_header&, const uint8_t*, size_t)>;
+    using on_drain_cb = std::function<void()>;
 
     socket_io();
     ~socket_io();
@@ -59,15 +106,24 @@ public:
     void on_connect(on_connect_cb callback);
     void on_close(on_close_cb callback);
     void on_message(on_message_cb callback);
+    // called once everything queued was written, if a write was refused since the last time
+    void on_drain(on_drain_cb callback);
 
-    void start(events::looper* looper);
+    // applied to tcp sockets the io is started with from now on
+    void configure(const socket_options& options);
+    // compression done by the io is counted into the given stats, which must outlive it
+    void attach_stats(io::compression_stats* stats);
+
+    void start(events::looper* looper, os::socket_domain domain = os::socket_domain::inet);
     void start(events::looper* looper,
                std::shared_ptr<obsr::os::socket> socket,
                bool connected = false);
+    // starts over an already established shared memory stream
+    void start(events::looper* looper, std::shared_ptr<obsr::os::shm_stream> stream);
     void stop();
 
     void connect(const connection_info& info);
-    bool write(uint8_t type, const uint8_t* buffer, size_t size);
+    bool write(uint8_t type, const io::shared_buffer& payload);
 
 private:
     enum class state {
@@ -76,31 +132,147 @@ private:
         connecting,
         connected
     };
+    static constexpr size_t max_frame_header_size = 1 + 2 * obsr::bits::max_varint_size;
+    static_assert(max_frame_header_size >= sizeof(message_header));
+    // compressed frames must fit in the read buffer of the peer, even if the frames in them
+    // do not compress at all
+    static constexpr size_t max_compressed_frame_size = read_data::message_buffer_size - 64;
+    static constexpr size_t max_compressed_batch_size = max_compressed_frame_size - 16;
+
+    struct pending_write {
+        uint8_t header[max_frame_header_size];
+        uint8_t header_size;
+        io::shared_buffer payload;
+        // part of the payload which is sent in the header instead
+        size_t payload_offset;
+
+        inline size_t size() const {
+            return header_size + payload.size() - payload_offset;
+        }
+    };
 
+    events::looper::io_callback create_callback();
     void on_read_ready();
     void on_write_ready();
     void on_hung_or_error();
     void process_new_data();
+    bool write_pending();
+    void compress_pending();
+    bool compress_batch(size_t index, size_t count, size_t size);
+    void expand_frames(const uint8_t* buffer, size_t size);
+    void encode_full_header(pending_write& pending, uint8_t type);
+    void encode_compact_header(pending_write& pending, uint8_t type);
+    void announce_frame_version();
+    void on_frame_version(const uint8_t* buffer, size_t size);
 
     void stop_internal(bool notify = true);
 
+    socket_options m_options;
+    bool m_quick_ack;
     state m_state;
     events::looper* m_looper;
     obsr::handle m_looper_handle;
+    obsr::handle m_link_handle;
 
     struct {
         on_connect_cb on_connect = nullptr;
         on_close_cb on_close = nullptr;
         on_message_cb on_message = nullptr;
+        on_drain_cb on_drain = nullptr;
     } m_callbacks;
 
+    // only one of the socket or the shared memory stream is used, with m_stream pointing to it
     std::shared_ptr<obsr::os::socket> m_socket;
+    std::shared_ptr<obsr::os::shm_stream> m_shm;
+    obsr::os::stream* m_stream;
     reader m_reader;
-    obsr::io::circular_buffer m_write_buffer;
+    std::deque<pending_write> m_write_queue;
+    size_t m_write_queue_size;
+    size_t m_write_offset;
     uint32_t m_next_message_index;
+    // connected sockets are registered edge-triggered, so we track whether the socket
+    // can be written to instead of asking the looper each time.
+    bool m_writable;
+    bool m_flush_requested;
+    bool m_write_refused;
+    // whether the peer announced it reads compact frames
+    bool m_compact_frames;
+    uint64_t m_last_send_time;
+
+    // whether the peer announced it reads compressed frames, and we were configured to send them
+    bool m_compress;
+    // messages in the write queue from this index on were not yet considered for compression
+    size_t m_compress_from;
+    io::deflater m_deflater;
+    io::compression_stats* m_stats;
+    uint8_t m_batch_buffer[max_compressed_batch_size];
+    uint8_t m_compressed_buffer[max_compressed_frame_size];
 };
 
-// must be used from inside the looper
+#pragma pack(push, 1)
+struct multicast_header {
+    // the index of the message numbers the datagrams sent to the group
+    message_header message;
+    // the client which caused the message to be sent, so it may ignore it
+    uint16_t origin;
+};
+#pragma pack(pop)
+
+// sends messages to a multicast group, each as a single datagram. messages are numbered
+// so that receivers can detect lost messages. may be used from any thread once open.
+class multicast_sender {
+public:
+    multicast_sender();
+
+    void open(const std::string& group, uint16_t port);
+    void close();
+    bool is_open() const;
+
+    bool send(uint8_t type, const io::shared_buffer& payload, uint16_t origin);
+
+private:
+    std::mutex m_mutex;
+    std::shared_ptr<obsr::os::datagram_socket> m_socket;
+    uint32_t m_next_message_index;
+};
+
+// receives messages sent by a multicast_sender. must be used from inside the looper.
+class multicast_receiver {
+public:
+    using on_message_cb = std::function<void(const message_header&, const uint8_t*, size_t)>;
+
+    multicast_receiver();
+    ~multicast_receiver();
+
+    void on_message(on_message_cb callback);
+
+    // messages caused by the given origin are not reported
+    void start(events::looper* looper, const std::string& group, uint16_t port, uint16_t ignored_origin);
+    void stop();
+
+    // amount of messages which were never received, judging by gaps in their numbering
+    uint64_t get_lost_count() const;
+
+private:
+    static constexpr size_t max_datagram_size = sizeof(multicast_header) + read_data::message_buffer_size;
+
+    void on_read_ready();
+    void process_datagram(size_t size);
+
+    events::looper* m_looper;
+    obsr::handle m_looper_handle;
+    on_message_cb m_on_message;
+
+    std::shared_ptr<obsr::os::datagram_socket> m_socket;
+    uint16_t m_ignored_origin;
+    bool m_has_index;
+    uint32_t m_next_index;
+    uint64_t m_lost_count;
+    uint8_t m_buffer[max_datagram_size];
+};
+
+// must be used from inside the looper. when started with more than one io thread, each client
+// is handled by one of several internal loopers, on which all callbacks for that client are invoked.
 class server_io {
 public:
     using client_id = uint16_t;
@@ -110,6 +282,7 @@ public:
     using on_disconnect_cb = std::function<void(client_id)>;
     using on_close_cb = std::function<void()>;
     using on_message_cb = std::function<void(client_id, const message_header&, const uint8_t*, size_t)>;
+    using on_drain_cb = std::function<void(client_id)>;
 
     server_io();
     ~server_io();
@@ -118,36 +291,56 @@ public:
     void on_disconnect(on_disconnect_cb callback);
     void on_close(on_close_cb callback);
     void on_message(on_message_cb callback);
+    // called from the looper of the client, once writes to it may be retried
+    void on_drain(on_drain_cb callback);
 
-    void start(events::looper* looper, uint16_t bind_port);
+    void start(events::looper* looper, uint16_t bind_port, const server_options& options = {});
     void stop();
 
-    bool write_to(client_id id, uint8_t type, const uint8_t* buffer, size_t size);
+    // the looper handling the io of the client. writes to the client must be done from this looper.
+    events::looper* get_looper_for(client_id id);
+    bool write_to(client_id id, uint8_t type, const io::shared_buffer& payload);
+
+    // of all the clients, since started
+    const io::compression_stats& get_compression_stats() const;
 
 private:
     enum class state {
         idle,
         open
     };
+    struct shard {
+        std::shared_ptr<events::looper> looper;
+        std::unique_ptr<events::looper_thread> thread;
+    };
     struct client {
     public:
-        client(server_io& parent, client_id id);
+        client(server_io& parent, client_id id, events::looper* looper);
+
+        events::looper* get_looper() const;
 
-        void start(events::looper* looper, std::shared_ptr<obsr::os::socket> socket);
+        void start(std::shared_ptr<obsr::os::socket> socket);
+        void start(std::shared_ptr<obsr::os::shm_stream> stream);
         void stop();
 
-        bool write(uint8_t type, const uint8_t* buffer, size_t size);
+        bool write(uint8_t type, const io::shared_buffer& payload);
 
     private:
         server_io& m_parent;
         client_id m_id;
+        events::looper* m_looper;
         socket_io m_io;
         bool m_closing;
     };
 
-    void on_read_ready();
+    void on_read_ready(obsr::os::server_socket& socket);
+    void on_shm_read_ready();
     void on_hung_or_error();
+    template<typename stream_>
+    void handle_new_client(std::shared_ptr<stream_> stream);
 
+    events::looper* next_client_looper();
+    void remove_client(client_id id);
     void stop_internal(bool notify = true);
 
     state m_state;
@@ -159,11 +352,23 @@ private:
         on_disconnect_cb on_disconnect = nullptr;
         on_close_cb on_close = nullptr;
         on_message_cb on_message = nullptr;
+        on_drain_cb on_drain = nullptr;
     } m_callbacks;
 
     std::shared_ptr<obsr::os::server_socket> m_socket;
-
-    std::unordered_map<client_id, std::unique_ptr<client>> m_clients;
+    std::shared_ptr<obsr::os::server_socket> m_local_socket;
+    obsr::handle m_local_handle;
+    std::shared_ptr<obsr::os::shm_listener> m_shm_listener;
+    obsr::handle m_shm_handle;
+    size_t m_max_clients;
+    socket_options m_socket_options;
+    io::compression_stats m_compression_stats;
+
+    std::vector<shard> m_shards;
+    size_t m_next_shard;
+
+    std::shared_mutex m_clients_mutex;
+    std::unordered_map<client_id, std::shared_ptr<client>> m_clients;
     client_id m_next_client_id;
 };
 
@@ -12,6 +12,8 @@ public:
     virtual void attach_storage(std::shared_ptr<storage::storage> storage) = 0;
     virtual void start(events::looper* looper) = 0;
     virtual void stop() = 0;
+
+    virtual network_stats get_stats() const = 0;
 };
 
 }
@@ -1,11 +1,14 @@
 
 #include "io/serialize.h"
 #include "util/bits.h"
+#include "debug.h"
 
 #include "serialize.h"
 
 namespace obsr::net {
 
+#define LOG_MODULE "message_serializer"
+
 static constexpr size_t writer_buffer_size = 512;
 
 void header_convert_net(message_header& header) {
@@ -18,6 +21,20 @@ void header_convert_host(message_header& header) {
     header.message_size = obsr::bits::host32(header.message_size);
 }
 
+bool has_send_time(message_type type) {
+    switch (type) {
+        case message_type::entry_create:
+        case message_type::entry_update:
+        case message_type::entry_delete:
+        case message_type::entry_publish:
+        case message_type::time_sync_request:
+        case message_type::time_sync_response:
+            return true;
+        default:
+            return false;
+    }
+}
+
 message_parser::message_parser()
     : state_machine()
     , m_type(static_cast<message_type>(-1))
@@ -37,7 +54,7 @@ bool message_parser::process_state(parse_state current_state, parse_data& data)
             return select_next_state(current_state);
         }
         case parse_state::read_id: {
-            const auto value_opt = m_deserializer.read16();
+            const auto value_opt = m_deserializer.read_varint();
             if (!value_opt) {
                 return error(error_read_data);
             }
@@ -61,11 +78,14 @@ bool message_parser::process_state(parse_state current_state, parse_data& data)
                 return error(error_read_data);
             }
 
-            data.type = static_cast<value_type>(value_opt.value());
+            const auto byte = value_opt.value();
+            data.type = static_cast<value_type>(byte & ~io::little_endian_type_flag);
+            data.order = (byte & io::little_endian_type_flag) != 0 ?
+                    io::byte_order::little_endian : io::byte_order::big_endian;
             return select_next_state(current_state);
         }
         case parse_state::read_value: {
-            auto value_opt = m_deserializer.read_value(data.type);
+            auto value_opt = m_deserializer.read_value(data.type, data.order);
             if (!value_opt) {
                 return error(error_read_data);
             }
@@ -91,6 +111,33 @@ bool message_parser::process_state(parse_state current_state, parse_data& data)
             data.time_value = std::chrono::milliseconds(value_opt.value());
             return select_next_state(current_state);
         }
+        case parse_state::read_port: {
+            const auto value_opt = m_deserializer.read16();
+            if (!value_opt) {
+                return error(error_read_data);
+            }
+
+            data.port = value_opt.value();
+            return select_next_state(current_state);
+        }
+        case parse_state::read_session: {
+            const auto value_opt = m_deserializer.read64();
+            if (!value_opt) {
+                return error(error_read_data);
+            }
+
+            data.session = value_opt.value();
+            return select_next_state(current_state);
+        }
+        case parse_state::read_sequence: {
+            const auto value_opt = m_deserializer.read64();
+            if (!value_opt) {
+                return error(error_read_data);
+            }
+
+            data.sequence = value_opt.value();
+            return select_next_state(current_state);
+        }
         default:
             return error(error_unknown_state);
     }
@@ -103,13 +150,24 @@ bool message_parser::select_next_state(parse_state current_state) {
                 case message_type::entry_create:
                 case message_type::entry_update:
                 case message_type::entry_delete:
+                case message_type::entry_publish:
                 case message_type::time_sync_request:
                 case message_type::time_sync_response:
                     return move_to_state(parse_state::read_send_time);
                 case message_type::entry_id_assign:
+                case message_type::entry_id_release:
                     return move_to_state(parse_state::read_id);
+                case message_type::multicast_info:
+                case message_type::subscribe:
+                case message_type::unsubscribe:
+                    return move_to_state(parse_state::read_name);
+                case message_type::session_info:
+                case message_type::session_resume:
+                    return move_to_state(parse_state::read_session);
                 case message_type::handshake_ready:
                 case message_type::handshake_finished:
+                case message_type::transaction_begin:
+                case message_type::transaction_end:
                     return finished();
                 default:
                     return error(error_unknown_type);
@@ -118,10 +176,13 @@ bool message_parser::select_next_state(parse_state current_state) {
         case parse_state::read_id: {
             switch (m_type) {
                 case message_type::entry_id_assign:
+                case message_type::entry_publish:
                     return move_to_state(parse_state::read_name);
                 case message_type::entry_update:
                     return move_to_state(parse_state::read_value_type);
                 case message_type::entry_delete:
+                case message_type::entry_id_release:
+                case message_type::multicast_info:
                     return finished();
                 default:
                     return error(error_unknown_type);
@@ -130,9 +191,14 @@ bool message_parser::select_next_state(parse_state current_state) {
         case parse_state::read_name: {
             switch (m_type) {
                 case message_type::entry_create:
+                case message_type::entry_publish:
                     return move_to_state(parse_state::read_value_type);
                 case message_type::entry_id_assign:
+                case message_type::subscribe:
+                case message_type::unsubscribe:
                     return finished();
+                case message_type::multicast_info:
+                    return move_to_state(parse_state::read_port);
                 default:
                     return error(error_unknown_type);
             }
@@ -141,6 +207,7 @@ bool message_parser::select_next_state(parse_state current_state) {
             switch (m_type) {
                 case message_type::entry_create:
                 case message_type::entry_update:
+                case message_type::entry_publish:
                     return move_to_state(parse_state::read_value);
                 default:
                     return error(error_unknown_type);
@@ -150,6 +217,7 @@ bool message_parser::select_next_state(parse_state current_state) {
             switch (m_type) {
                 case message_type::entry_create:
                 case message_type::entry_update:
+                case message_type::entry_publish:
                     return finished();
                 default:
                     return error(error_unknown_type);
@@ -161,6 +229,7 @@ bool message_parser::select_next_state(parse_state current_state) {
                     return move_to_state(parse_state::read_name);
                 case message_type::entry_update:
                 case message_type::entry_delete:
+                case message_type::entry_publish:
                     return move_to_state(parse_state::read_id);
                 case message_type::time_sync_request:
                     return finished();
@@ -178,6 +247,32 @@ bool message_parser::select_next_state(parse_state current_state) {
                     return error(error_unknown_type);
             }
         }
+        case parse_state::read_port: {
+            switch (m_type) {
+                case message_type::multicast_info:
+                    return move_to_state(parse_state::read_id);
+                default:
+                    return error(error_unknown_type);
+            }
+        }
+        case parse_state::read_session: {
+            switch (m_type) {
+                case message_type::session_info:
+                case message_type::session_resume:
+                    return move_to_state(parse_state::read_sequence);
+                default:
+                    return error(error_unknown_type);
+            }
+        }
+        case parse_state::read_sequence: {
+            switch (m_type) {
+                case message_type::session_info:
+                case message_type::session_resume:
+                    return finished();
+                default:
+                    return error(error_unknown_type);
+            }
+        }
         default:
             return error(error_unknown_state);
     }
@@ -196,12 +291,30 @@ size_t message_serializer::size() const {
     return m_buffer.pos();
 }
 
+io::shared_buffer message_serializer::share() const {
+    return {m_buffer.data(), m_buffer.pos()};
+}
+
 void message_serializer::reset() {
     m_buffer.reset();
 }
 
+std::optional<encoded_message> message_serializer::encode(const out_message& message) {
+    reset();
+
+    if (!serialize(message)) {
+        return {};
+    }
+
+    if (size() < 1) {
+        return {{message.type(), io::shared_buffer()}};
+    }
+
+    return {{message.type(), share()}};
+}
+
 bool message_serializer::entry_id_assign(storage::entry_id id, std::string_view name) {
-    if (!m_serializer.write16(id)) {
+    if (!m_serializer.write_varint(id)) {
         return false;
     }
 
@@ -221,7 +334,7 @@ bool message_serializer::entry_created(std::chrono::milliseconds send_time, std:
         return false;
     }
 
-    if (!m_serializer.write8(static_cast<uint8_t>(value.get_type()))) {
+    if (!m_serializer.write_value_type(value.get_type())) {
         return false;
     }
 
@@ -233,31 +346,59 @@ bool message_serializer::entry_created(std::chrono::milliseconds send_time, std:
 }
 
 bool message_serializer::entry_updated(std::chrono::milliseconds send_time, storage::entry_id id, const value& value) {
-    if (!m_serializer.write64(send_time.count())) {
+    // the part before the value is bounded, so is written at once
+    io::fixed_fields<sizeof(uint64_t) + io::max_varint32_size + sizeof(uint8_t)> fields;
+    fields.put64(send_time.count());
+    fields.put_varint(id);
+    fields.put8(io::encode_value_type(value.get_type()));
+    if (!m_serializer.write_fields(fields)) {
         return false;
     }
 
-    if (!m_serializer.write16(id)) {
+    if (!m_serializer.write_value(value)) {
         return false;
     }
 
-    if (!m_serializer.write8(static_cast<uint8_t>(value.get_type()))) {
+    return true;
+}
+
+bool message_serializer::entry_deleted(std::chrono::milliseconds send_time, storage::entry_id id) {
+    io::fixed_fields<sizeof(uint64_t) + io::max_varint32_size> fields;
+    fields.put64(send_time.count());
+    fields.put_varint(id);
+    if (!m_serializer.write_fields(fields)) {
         return false;
     }
 
-    if (!m_serializer.write_value(value)) {
+    return true;
+}
+
+bool message_serializer::entry_id_released(storage::entry_id id) {
+    if (!m_serializer.write_varint(id)) {
         return false;
     }
 
     return true;
 }
 
-bool message_serializer::entry_deleted(std::chrono::milliseconds send_time, storage::entry_id id) {
+bool message_serializer::entry_published(std::chrono::milliseconds send_time, storage::entry_id id, std::string_view name, const value& value) {
     if (!m_serializer.write64(send_time.count())) {
         return false;
     }
 
-    if (!m_serializer.write16(id)) {
+    if (!m_serializer.write_varint(id)) {
+        return false;
+    }
+
+    if (!m_serializer.write_str(name)) {
+        return false;
+    }
+
+    if (!m_serializer.write_value_type(value.get_type())) {
+        return false;
+    }
+
+    if (!m_serializer.write_value(value)) {
         return false;
     }
 
@@ -284,185 +425,139 @@ bool message_serializer::time_sync_response(std::chrono::milliseconds send_time,
     return true;
 }
 
-message_queue::message_queue()
-    : m_destination(nullptr)
-    , m_serializer()
-    , m_outgoing()
-{}
-
-void message_queue::attach(destination destination) {
-    m_destination = std::move(destination);
-}
-
-void message_queue::enqueue(const out_message& message, uint8_t flags) {
-    if ((flags & flag_immediate) != 0) {
-        if (write_message(message)) {
-            // success!
-            return;
-        } else {
-            m_outgoing.push_front(message);
-        }
-    } else {
-        m_outgoing.push_back(message);
-    }
-}
-
-void message_queue::clear() {
-    m_outgoing.clear();
-}
-
-void message_queue::process() {
-    auto it = m_outgoing.begin();
-    while (it != m_outgoing.end()) {
-        const auto success = write_message(*it);
-        if (success) {
-            it = m_outgoing.erase(it);
-        } else {
-            break;
-        }
-    }
-}
-
-bool message_queue::write_message(const out_message& message) {
-    switch (message.type()) {
-        case message_type::entry_create:
-            return write_entry_created(message);
-        case message_type::entry_update:
-            return write_entry_updated(message);
-        case message_type::entry_delete:
-            return write_entry_deleted(message);
-        case message_type::entry_id_assign:
-            return write_entry_id_assigned(message);
-        case message_type::time_sync_request:
-            return write_time_sync_request(message);
-        case message_type::time_sync_response:
-            return write_time_sync_response(message);
-        case message_type::handshake_ready:
-        case message_type::handshake_finished:
-            return write_basic(message);
-        case message_type::no_type:
-        default:
-            return true;
+bool message_serializer::multicast_info(std::string_view group, uint16_t port, uint16_t client_id) {
+    if (!m_serializer.write_str(group)) {
+        return false;
     }
-}
-
-bool message_queue::write_entry_created(const out_message& message) {
-    m_serializer.reset();
 
-    if (!m_serializer.entry_created(message.send_time(),
-                                    message.name(),
-                                    message.value())) {
+    if (!m_serializer.write16(port)) {
         return false;
     }
 
-    if (!m_destination(
-            static_cast<uint8_t>(message_type::entry_create),
-            m_serializer.data(),
-            m_serializer.size())) {
+    if (!m_serializer.write_varint(client_id)) {
         return false;
     }
 
     return true;
 }
 
-bool message_queue::write_entry_updated(const out_message& message) {
-    m_serializer.reset();
-
-    if (!m_serializer.entry_updated(message.send_time(),
-                                    message.id(),
-                                    message.value())) {
-        return false;
-    }
-
-    if (!m_destination(
-            static_cast<uint8_t>(message_type::entry_update),
-            m_serializer.data(),
-            m_serializer.size())) {
+bool message_serializer::subscription(std::string_view path) {
+    if (!m_serializer.write_str(path)) {
         return false;
     }
 
     return true;
 }
 
-bool message_queue::write_entry_deleted(const out_message& message) {
-    m_serializer.reset();
-
-    if (!m_serializer.entry_deleted(message.send_time(),
-                                    message.id())) {
+bool message_serializer::session(uint64_t session, uint64_t sequence) {
+    if (!m_serializer.write64(session)) {
         return false;
     }
 
-    if (!m_destination(
-            static_cast<uint8_t>(message_type::entry_delete),
-            m_serializer.data(),
-            m_serializer.size())) {
+    if (!m_serializer.write64(sequence)) {
         return false;
     }
 
     return true;
 }
 
-bool message_queue::write_entry_id_assigned(const out_message& message) {
-    m_serializer.reset();
-
-    if (!m_serializer.entry_id_assign(message.id(),
-                                      message.name())) {
-        return false;
+bool message_serializer::serialize(const out_message& message) {
+    switch (message.type()) {
+        case message_type::entry_create:
+            return entry_created(message.send_time(), message.name(), message.value());
+        case message_type::entry_update:
+            return entry_updated(message.send_time(), message.id(), message.value());
+        case message_type::entry_delete:
+            return entry_deleted(message.send_time(), message.id());
+        case message_type::entry_id_assign:
+            return entry_id_assign(message.id(), message.name());
+        case message_type::entry_id_release:
+            return entry_id_released(message.id());
+        case message_type::entry_publish:
+            return entry_published(message.send_time(), message.id(), message.name(), message.value());
+        case message_type::time_sync_request:
+            return time_sync_request(message.send_time());
+        case message_type::time_sync_response:
+            return time_sync_response(message.send_time(), message.time_value());
+        case message_type::multicast_info:
+            return multicast_info(message.name(), message.port(), message.id());
+        case message_type::subscribe:
+        case message_type::unsubscribe:
+            return subscription(message.name());
+        case message_type::session_info:
+        case message_type::session_resume:
+            return session(message.session(), message.sequence());
+        case message_type::handshake_ready:
+        case message_type::handshake_finished:
+        case message_type::transaction_begin:
+        case message_type::transaction_end:
+            // no payload
+            return true;
+        case message_type::no_type:
+        default:
+            return false;
     }
+}
 
-    if (!m_destination(
-            static_cast<uint8_t>(message_type::entry_id_assign),
-            m_serializer.data(),
-            m_serializer.size())) {
-        return false;
-    }
+message_queue::message_queue()
+    : m_destination(nullptr)
+    , m_serializer()
+    , m_outgoing()
+{}
 
-    return true;
+void message_queue::attach(destination destination) {
+    m_destination = std::move(destination);
 }
 
-bool message_queue::write_time_sync_request(const out_message& message) {
-    m_serializer.reset();
-
-    if (!m_serializer.time_sync_request(message.send_time())) {
-        return false;
+void message_queue::enqueue(const out_message& message, uint8_t flags) {
+    if (message.type() == message_type::no_type) {
+        return;
     }
 
-    if (!m_destination(
-            static_cast<uint8_t>(message_type::time_sync_request),
-            m_serializer.data(),
-            m_serializer.size())) {
-        return false;
+    auto encoded_opt = m_serializer.encode(message);
+    if (!encoded_opt) {
+        TRACE_ERROR(LOG_MODULE, "failed to serialize message of type %d, dropping it", message.type());
+        return;
     }
 
-    return true;
+    enqueue(encoded_opt.value(), flags);
 }
 
-bool message_queue::write_time_sync_response(const out_message& message) {
-    m_serializer.reset();
-
-    if (!m_serializer.time_sync_response(message.send_time(), message.time_value())) {
-        return false;
+void message_queue::enqueue(const encoded_message& message, uint8_t flags) {
+    if ((flags & flag_immediate) != 0) {
+        if (write_message(message)) {
+            // success!
+            return;
+        } else {
+            m_outgoing.push_front(message);
+        }
+    } else {
+        m_outgoing.push_back(message);
     }
+}
 
-    if (!m_destination(
-            static_cast<uint8_t>(message_type::time_sync_response),
-            m_serializer.data(),
-            m_serializer.size())) {
-        return false;
-    }
+void message_queue::clear() {
+    m_outgoing.clear();
+}
 
-    return true;
+bool message_queue::empty() const {
+    return m_outgoing.empty();
 }
 
-bool message_queue::write_basic(const out_message& message) {
-    if (!m_destination(
-            static_cast<uint8_t>(message.type()),
-            nullptr,
-            0)) {
-        return false;
+void message_queue::process() {
+    auto it = m_outgoing.begin();
+    while (it != m_outgoing.end()) {
+        const auto success = write_message(*it);
+        if (success) {
+            it = m_outgoing.erase(it);
+        } else {
+            break;
+        }
     }
+}
 
-    return true;
+bool message_queue::write_message(const encoded_message& message) {
+    return m_destination(static_cast<uint8_t>(message.type), message.payload);
 }
 
 }
@@ -9,10 +9,24 @@
 
 namespace obsr::net {
 
+// messages are framed either by a full header, or once both peers announced support for it,
+// by a compact one: a byte of the type with compact_frame_flag set, the size of the payload
+// as a varint and, for messages which start with a send time, the difference of that time from
+// the one of the previous such frame as a zigzag varint. the time is removed from the payload.
+// a compressed_frames message carries a run of consecutive frames, compressed as a continuation
+// of the previous run sent on the connection.
 #pragma pack(push, 1)
 struct message_header {
     static constexpr uint8_t message_magic = 0x29;
-    static constexpr uint8_t current_version = 0x1;
+    // highest version spoken, announced to the peer with frame_version
+    static constexpr uint8_t current_version = 0x3;
+    // version of the full header
+    static constexpr uint8_t full_frame_version = 0x2;
+    // first version to support compact frames
+    static constexpr uint8_t compact_frame_version = 0x3;
+    static constexpr uint8_t compact_frame_flag = 0x80;
+    // announced along with the version, if the peer can read compressed frames
+    static constexpr uint8_t feature_deflate = 0x1;
 
     uint8_t magic;
     uint8_t version;
@@ -32,8 +46,25 @@ enum class message_type {
     handshake_ready = 6,
     time_sync_request = 7,
     time_sync_response = 8,
+    multicast_info = 9,
+    subscribe = 10,
+    unsubscribe = 11,
+    session_info = 12,
+    session_resume = 13,
+    entry_publish = 14,
+    entry_id_release = 15,
+    // handled by the io layer
+    frame_version = 16,
+    compressed_frames = 17,
+    // the changes between these are applied together. may be nested, in which case they
+    // are applied once the outermost ends.
+    transaction_begin = 18,
+    transaction_end = 19,
 };
 
+// whether the payload of the message starts with its send time
+bool has_send_time(message_type type);
+
 enum class parse_state {
     check_type,
     read_id,
@@ -41,7 +72,10 @@ enum class parse_state {
     read_value_type,
     read_value,
     read_send_time,
-    read_time_value
+    read_time_value,
+    read_port,
+    read_session,
+    read_sequence
 };
 
 enum parse_error {
@@ -56,8 +90,12 @@ struct parse_data {
     storage::entry_id id;
     std::string name;
     value_type type;
+    io::byte_order order;
     obsr::value value = obsr::value::make();
     std::chrono::milliseconds time_value;
+    uint16_t port;
+    uint64_t session;
+    uint64_t sequence;
 };
 
 void header_convert_net(message_header& header);
@@ -72,6 +110,9 @@ public:
         , m_value(value::make())
         , m_time(0)
         , m_send_time(0)
+        , m_port(0)
+        , m_session(0)
+        , m_sequence(0)
     {}
 
     inline message_type type() const {
@@ -79,22 +120,22 @@ public:
     }
 
     inline storage::entry_id id() const {
-        assert(m_type == message_type::entry_create || m_type == message_type::entry_update || m_type == message_type::entry_delete || m_type == message_type::entry_id_assign);
+        assert(m_type == message_type::entry_create || m_type == message_type::entry_update || m_type == message_type::entry_delete || m_type == message_type::entry_id_assign || m_type == message_type::entry_publish || m_type == message_type::entry_id_release || m_type == message_type::multicast_info);
         return m_id;
     }
 
     inline std::string_view name() const {
-        assert(m_type == message_type::entry_create || m_type == message_type::entry_id_assign);
+        assert(m_type == message_type::entry_create || m_type == message_type::entry_id_assign || m_type == message_type::entry_publish || m_type == message_type::multicast_info || m_type == message_type::subscribe || m_type == message_type::unsubscribe);
         return m_name;
     }
 
     inline const obsr::value& value() const {
-        assert(m_type == message_type::entry_create || m_type == message_type::entry_update);
+        assert(m_type == message_type::entry_create || m_type == message_type::entry_update || m_type == message_type::entry_publish);
         return m_value;
     }
 
     inline std::chrono::milliseconds send_time() const {
-        assert(m_type == message_type::entry_create || m_type == message_type::entry_update || m_type == message_type::entry_delete || m_type == message_type::entry_id_assign || m_type == message_type::time_sync_response || m_type == message_type::time_sync_request);
+        assert(m_type == message_type::entry_create || m_type == message_type::entry_update || m_type == message_type::entry_delete || m_type == message_type::entry_id_assign || m_type == message_type::entry_publish || m_type == message_type::time_sync_response || m_type == message_type::time_sync_request);
         return m_send_time;
     }
 
@@ -103,6 +144,21 @@ public:
         return m_time;
     }
 
+    inline uint16_t port() const {
+        assert(m_type == message_type::multicast_info);
+        return m_port;
+    }
+
+    inline uint64_t session() const {
+        assert(m_type == message_type::session_info || m_type == message_type::session_resume);
+        return m_session;
+    }
+
+    inline uint64_t sequence() const {
+        assert(m_type == message_type::session_info || m_type == message_type::session_resume);
+        return m_sequence;
+    }
+
     static inline out_message empty() {
         return out_message();
     }
@@ -140,6 +196,25 @@ public:
         return std::move(message);
     }
 
+    // id assignment and current value of an entry, in one message
+    static inline out_message entry_publish(std::chrono::milliseconds send_time, storage::entry_id id, std::string_view name, obsr::value&& value) {
+        out_message message(message_type::entry_publish);
+        message.m_send_time = send_time;
+        message.m_id = id;
+        message.m_name = name;
+        message.m_value = std::move(value);
+
+        return std::move(message);
+    }
+
+    // the id is no longer used, and may be assigned to another entry later
+    static inline out_message entry_id_release(storage::entry_id id) {
+        out_message message(message_type::entry_id_release);
+        message.m_id = id;
+
+        return std::move(message);
+    }
+
     static inline out_message handshake_ready() {
         return out_message(message_type::handshake_ready);
     }
@@ -148,6 +223,14 @@ public:
         return out_message(message_type::handshake_finished);
     }
 
+    static inline out_message transaction_begin() {
+        return out_message(message_type::transaction_begin);
+    }
+
+    static inline out_message transaction_end() {
+        return out_message(message_type::transaction_end);
+    }
+
     static inline out_message time_sync_request(std::chrono::milliseconds send_time) {
         out_message message(message_type::time_sync_request);
         message.m_send_time = send_time;
@@ -163,6 +246,49 @@ public:
         return std::move(message);
     }
 
+    // the id is that of the receiving client, with which the server marks the updates it multicasts
+    // on behalf of that client.
+    static inline out_message multicast_info(std::string_view group, uint16_t port, uint16_t client_id) {
+        out_message message(message_type::multicast_info);
+        message.m_name = group;
+        message.m_port = port;
+        message.m_id = client_id;
+
+        return std::move(message);
+    }
+
+    static inline out_message subscribe(std::string_view path) {
+        out_message message(message_type::subscribe);
+        message.m_name = path;
+
+        return std::move(message);
+    }
+
+    static inline out_message unsubscribe(std::string_view path) {
+        out_message message(message_type::unsubscribe);
+        message.m_name = path;
+
+        return std::move(message);
+    }
+
+    // all changes up to and including the sequence were sent before this message
+    static inline out_message session_info(uint64_t session, uint64_t sequence) {
+        out_message message(message_type::session_info);
+        message.m_session = session;
+        message.m_sequence = sequence;
+
+        return std::move(message);
+    }
+
+    // the client asks for only the changes after the sequence, if the session is still known
+    static inline out_message session_resume(uint64_t session, uint64_t sequence) {
+        out_message message(message_type::session_resume);
+        message.m_session = session;
+        message.m_sequence = sequence;
+
+        return std::move(message);
+    }
+
 private:
     message_type m_type;
 
@@ -171,6 +297,9 @@ private:
     obsr::value m_value;
     std::chrono::milliseconds m_time;
     std::chrono::milliseconds m_send_time;
+    uint16_t m_port;
+    uint64_t m_session;
+    uint64_t m_sequence;
 };
 
 class message_parser : public state_machine<parse_state, parse_state::check_type, parse_data> {
@@ -187,7 +316,14 @@ private:
 
     message_type m_type;
     io::readonly_buffer_view m_buffer;
-    io::deserializer m_deserializer;
+    io::basic_deserializer<io::readonly_buffer_view> m_deserializer;
+};
+
+// an out_message after serialization. the payload is immutable and shared, so the same
+// encoded message can be queued for several destinations while being serialized only once.
+struct encoded_message {
+    message_type type;
+    io::shared_buffer payload;
 };
 
 class message_serializer {
@@ -196,23 +332,34 @@ public:
 
     const uint8_t* data() const;
     size_t size() const;
+    // copies the serialized data into a shared buffer, which may be handed off to the io layer.
+    io::shared_buffer share() const;
 
     void reset();
 
+    std::optional<encoded_message> encode(const out_message& message);
+
     bool entry_id_assign(storage::entry_id id, std::string_view name);
     bool entry_created(std::chrono::milliseconds send_time, std::string_view name, const value& value);
     bool entry_updated(std::chrono::milliseconds send_time, storage::entry_id id, const value& value);
     bool entry_deleted(std::chrono::milliseconds send_time, storage::entry_id id);
+    bool entry_id_released(storage::entry_id id);
+    bool entry_published(std::chrono::milliseconds send_time, storage::entry_id id, std::string_view name, const value& value);
     bool time_sync_request(std::chrono::milliseconds send_time);
     bool time_sync_response(std::chrono::milliseconds send_time, std::chrono::milliseconds request_time);
+    bool multicast_info(std::string_view group, uint16_t port, uint16_t client_id);
+    bool subscription(std::string_view path);
+    bool session(uint64_t session, uint64_t sequence);
 private:
+    bool serialize(const out_message& message);
+
     io::linear_buffer m_buffer;
-    io::serializer m_serializer;
+    io::basic_serializer<io::linear_buffer> m_serializer;
 };
 
 class message_queue {
 public:
-    using destination = std::function<bool(uint8_t, const uint8_t*, size_t)>;
+    using destination = std::function<bool(uint8_t, const io::shared_buffer&)>;
     enum {
         flag_immediate = 1 << 0
     };
@@ -225,24 +372,19 @@ public:
     // todo: try and switch to sending only the latest state instead of queueing every change
     //      only relevant if we can't keep up with changes
     void enqueue(const out_message& message, uint8_t flags = 0);
+    void enqueue(const encoded_message& message, uint8_t flags = 0);
     void clear();
 
+    [[nodiscard]] bool empty() const;
     void process();
 
 private:
-    bool write_message(const out_message& message);
-    bool write_entry_created(const out_message& message);
-    bool write_entry_updated(const out_message& message);
-    bool write_entry_deleted(const out_message& message);
-    bool write_entry_id_assigned(const out_message& message);
-    bool write_time_sync_request(const out_message& message);
-    bool write_time_sync_response(const out_message& message);
-    bool write_basic(const out_message& message);
+    bool write_message(const encoded_message& message);
 
     destination m_destination;
 
     message_serializer m_serializer;
-    std::deque<out_message> m_outgoing;
+    std::deque<encoded_message> m_outgoing;
 };
 
 }
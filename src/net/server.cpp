@@ -1,4 +1,6 @@
 
+#include <random>
+
 #include "internal_except.h"
 #include "util/general.h"
 #include "util/time.h"
@@ -12,16 +14,251 @@ namespace obsr::net {
 
 static constexpr auto open_retry_time = std::chrono::milliseconds(1000);
 static constexpr auto update_time = std::chrono::milliseconds(200);
+static constexpr size_t publish_batch_size = 64;
+
+entry_id_set::entry_id_set()
+    : m_ids()
+{}
+
+bool entry_id_set::contains(storage::entry_id id) const {
+    const auto index = storage::id_index(id);
+    return index < m_ids.size() && m_ids[index] == id;
+}
+
+bool entry_id_set::insert(storage::entry_id id) {
+    const auto index = storage::id_index(id);
+    if (index >= m_ids.size()) {
+        m_ids.resize(index + 1, storage::id_not_assigned);
+    } else if (m_ids[index] == id) {
+        return false;
+    }
+
+    m_ids[index] = id;
+    return true;
+}
+
+bool entry_id_set::erase(storage::entry_id id) {
+    if (!contains(id)) {
+        return false;
+    }
+
+    m_ids[storage::id_index(id)] = storage::id_not_assigned;
+    return true;
+}
+
+void entry_id_set::clear() {
+    m_ids.clear();
+}
+
+id_registry::id_registry()
+    : m_mutex()
+    , m_serializer()
+    , m_slots()
+    , m_free_indices()
+    , m_names()
+    , m_retired_count(0)
+{}
+
+storage::entry_id id_registry::assign(std::string_view name, bool& is_new) {
+    std::unique_lock lock(m_mutex);
+
+    auto it = m_names.find(name);
+    if (it != m_names.end()) {
+        auto& slot = m_slots[storage::id_index(it->second)];
+        if (slot.retired_at) {
+            slot.retired_at.reset();
+            m_retired_count--;
+        }
+
+        is_new = false;
+        return it->second;
+    }
+
+    uint32_t index;
+    if (!m_free_indices.empty()) {
+        index = m_free_indices.back();
+        m_free_indices.pop_back();
+    } else if (m_slots.size() <= storage::id_max_index) {
+        index = m_slots.size();
+        m_slots.emplace_back();
+    } else {
+        throw illegal_state_exception("no more entry ids");
+    }
+
+    auto& slot = m_slots[index];
+    auto id = storage::make_entry_id(index, slot.epoch);
+    auto message_opt = m_serializer.encode(out_message::entry_id_assign(id, name));
+    if (!message_opt) {
+        m_free_indices.push_back(index);
+        throw illegal_argument_exception("entry name cannot be serialized");
+    }
+
+    slot.id = id;
+    slot.data = assignment{std::string(name), std::move(message_opt.value())};
+    m_names.emplace(name, id);
+
+    is_new = true;
+    return id;
+}
+
+std::optional<id_registry::assignment> id_registry::get(storage::entry_id id) {
+    std::shared_lock lock(m_mutex);
+
+    const auto slot = find(id);
+    if (slot == nullptr) {
+        return {};
+    }
+
+    return slot->data;
+}
+
+void id_registry::retire(storage::entry_id id, uint64_t sequence) {
+    std::unique_lock lock(m_mutex);
+
+    auto slot = find(id);
+    if (slot == nullptr) {
+        return;
+    }
+
+    if (!slot->retired_at) {
+        m_retired_count++;
+    }
+    slot->retired_at = sequence;
+}
+
+void id_registry::revive(storage::entry_id id) {
+    if (m_retired_count.load() == 0) {
+        // nothing deleted, no need to lock
+        return;
+    }
+
+    std::unique_lock lock(m_mutex);
+
+    auto slot = find(id);
+    if (slot != nullptr && slot->retired_at) {
+        slot->retired_at.reset();
+        m_retired_count--;
+    }
+}
+
+bool id_registry::release(storage::entry_id id, uint64_t sequence) {
+    std::unique_lock lock(m_mutex);
+
+    auto slot = find(id);
+    if (slot == nullptr || slot->retired_at != sequence) {
+        // used again, or deleted again later
+        return false;
+    }
+
+    m_retired_count--;
+    m_names.erase(slot->data.name);
+
+    slot->id = storage::id_not_assigned;
+    slot->data = {};
+    slot->retired_at.reset();
+    slot->epoch++;
+    m_free_indices.push_back(storage::id_index(id));
+
+    return true;
+}
+
+void id_registry::for_each_under(std::string_view path, const assignment_action& action) {
+    // names are sorted, so the entries under the path follow it
+    if (!path.empty() && path.back() == '/') {
+        path.remove_suffix(1);
+    }
+
+    std::shared_lock lock(m_mutex);
 
-server_client::server_client(server_io::client_id id, server_io& parent, const clock_ref& clock)
+    for (auto it = m_names.lower_bound(path); it != m_names.end() && it->first.starts_with(path); ++it) {
+        const auto& name = it->first;
+        if (name.size() > path.size() && name[path.size()] != '/') {
+            // shares a prefix with the path without being under it
+            continue;
+        }
+
+        action(it->second, m_slots[storage::id_index(it->second)].data);
+    }
+}
+
+bool id_registry::collect_under(std::string_view path,
+                                std::string_view after,
+                                size_t limit,
+                                std::vector<std::pair<storage::entry_id, assignment>>& out) {
+    if (!path.empty() && path.back() == '/') {
+        path.remove_suffix(1);
+    }
+
+    std::shared_lock lock(m_mutex);
+
+    auto it = after.empty() ? m_names.lower_bound(path) : m_names.upper_bound(after);
+    for (; it != m_names.end() && it->first.starts_with(path); ++it) {
+        const auto& name = it->first;
+        if (name.size() > path.size() && name[path.size()] != '/') {
+            continue;
+        }
+
+        if (out.size() >= limit) {
+            return true;
+        }
+
+        const auto& slot = m_slots[storage::id_index(it->second)];
+        if (slot.retired_at) {
+            // new clients need not know of deleted entries
+            continue;
+        }
+
+        out.emplace_back(it->second, slot.data);
+    }
+
+    return false;
+}
+
+void id_registry::clear() {
+    std::unique_lock lock(m_mutex);
+
+    m_slots.clear();
+    m_free_indices.clear();
+    m_names.clear();
+    m_retired_count.store(0);
+}
+
+id_registry::slot* id_registry::find(storage::entry_id id) {
+    const auto index = storage::id_index(id);
+    if (index >= m_slots.size() || m_slots[index].id != id) {
+        return nullptr;
+    }
+
+    return &m_slots[index];
+}
+
+server_client::server_client(server_io::client_id id,
+                             server_io& parent,
+                             events::looper* looper,
+                             id_registry& ids,
+                             std::shared_ptr<storage::storage> storage,
+                             const clock_ref& clock)
     : m_id(id)
     , m_parent(parent)
+    , m_ids(ids)
+    , m_storage(std::move(storage))
+    , m_looper(looper)
     , m_clock(clock)
     , m_state(state::connected)
+    , m_parser()
+    , m_serializer()
+    , m_queue()
     , m_published_entries()
-    , m_queue() {
-    m_queue.attach([this](uint8_t type, const uint8_t* buffer, size_t size)->bool {
-        return m_parent.write_to(m_id, type, buffer, size);
+    , m_subscriptions()
+    , m_filtered_entries()
+    , m_resume_request()
+    , m_cursor()
+    , m_transaction_depth(0)
+    , m_transaction_changes()
+    , m_posted()
+    , m_update_scheduled(false) {
+    m_queue.attach([this](uint8_t type, const io::shared_buffer& payload)->bool {
+        return m_parent.write_to(m_id, type, payload);
     });
 }
 
@@ -30,24 +267,143 @@ server_io::client_id server_client::get_id() const {
 }
 
 server_client::state server_client::get_state() const {
-    return m_state;
+    return m_state.load();
 }
 
 void server_client::set_state(state state) {
-    m_state = state;
+    m_state.store(state);
+}
+
+message_parser& server_client::parser() {
+    return m_parser;
+}
+
+message_serializer& server_client::serializer() {
+    return m_serializer;
 }
 
 bool server_client::is_known(storage::entry_id id) const {
-    return m_published_entries.find(id) != m_published_entries.end();
+    return m_published_entries.contains(id);
 }
 
-void server_client::publish(storage::entry_id id, std::string_view name) {
+void server_client::publish(storage::entry_id id, const encoded_message& assign_message) {
     TRACE_DEBUG(LOG_MODULE, "publishing entry for server client %d, entry=%d", m_id, id);
-    enqueue(out_message::entry_id_assign(id, name));
+    m_queue.enqueue(assign_message);
+
+    m_published_entries.insert(id);
+    m_filtered_entries.erase(id);
+}
+
+void server_client::forget(storage::entry_id id) {
+    m_published_entries.erase(id);
+    m_filtered_entries.insert(id);
+}
 
+void server_client::assume_known(storage::entry_id id) {
     m_published_entries.insert(id);
 }
 
+void server_client::set_resume_request(uint64_t session, uint64_t sequence) {
+    m_resume_request = {session, sequence};
+}
+
+std::optional<std::pair<uint64_t, uint64_t>> server_client::resume_request() const {
+    return m_resume_request;
+}
+
+void server_client::begin_transaction() {
+    m_transaction_depth++;
+}
+
+bool server_client::end_transaction() {
+    if (m_transaction_depth == 0) {
+        return false;
+    }
+
+    return --m_transaction_depth == 0;
+}
+
+bool server_client::in_transaction() const {
+    return m_transaction_depth > 0;
+}
+
+void server_client::add_to_transaction(storage::entry_change&& change) {
+    m_transaction_changes.push_back(std::move(change));
+}
+
+std::vector<storage::entry_change> server_client::take_transaction() {
+    return std::exchange(m_transaction_changes, {});
+}
+
+bool server_client::subscribe(std::string_view path) {
+    if (!m_subscriptions.insert(path)) {
+        return false;
+    }
+
+    // some of these may now be matched
+    m_filtered_entries.clear();
+    return true;
+}
+
+bool server_client::unsubscribe(std::string_view path) {
+    return m_subscriptions.erase(path);
+}
+
+bool server_client::is_subscribed(std::string_view path) const {
+    return m_subscriptions.matches(path);
+}
+
+const path_trie& server_client::subscriptions() const {
+    return m_subscriptions;
+}
+
+void server_client::stream_handshake() {
+    publish_cursor cursor{{}, {}, true};
+    m_subscriptions.for_each([&cursor](const std::string& path)->void {
+        cursor.paths.push_back(path);
+    });
+
+    m_cursor = std::move(cursor);
+    request_update();
+}
+
+void server_client::stream_entries(std::string_view path) {
+    if (m_cursor) {
+        m_cursor->paths.emplace_back(path);
+    } else if (get_state() == state::in_use) {
+        m_cursor = publish_cursor{{std::string(path)}, {}, false};
+    } else {
+        // will be sent with the handshake
+        return;
+    }
+
+    request_update();
+}
+
+void server_client::resume(const std::set<storage::entry_id>& changed) {
+    m_subscriptions.for_each([this](const std::string& path)->void {
+        m_ids.for_each_under(path, [this](storage::entry_id id, const id_registry::assignment&)->void {
+            assume_known(id);
+        });
+    });
+
+    // bounded by the size of the session log, so sent in one go
+    std::vector<std::pair<storage::entry_id, id_registry::assignment>> batch;
+    for (auto entry_id : changed) {
+        auto assignment_opt = m_ids.get(entry_id);
+        if (!assignment_opt || !is_subscribed(assignment_opt->name)) {
+            continue;
+        }
+
+        // the entry may have been created while the client was away
+        m_published_entries.erase(entry_id);
+        batch.emplace_back(entry_id, std::move(assignment_opt.value()));
+    }
+
+    publish_batch(batch, true);
+    finish_handshake();
+}
+
 void server_client::enqueue(const out_message& message, uint8_t flags) {
     TRACE_DEBUG(LOG_MODULE, "enqueuing message for server client %d", m_id);
     m_queue.enqueue(message, flags);
@@ -58,7 +414,143 @@ void server_client::clear() {
 }
 
 void server_client::update() {
+    m_update_scheduled.store(false);
+
+    while (auto posted_opt = m_posted.pop()) {
+        auto& posted = posted_opt.value();
+        if (posted.released) {
+            // the id may be given to another entry, under another epoch
+            if (m_published_entries.erase(posted.id)) {
+                m_queue.enqueue(out_message::entry_id_release(posted.id));
+            }
+            m_filtered_entries.erase(posted.id);
+            continue;
+        }
+
+        if (posted.id != storage::id_not_assigned && !is_known(posted.id)) {
+            if (m_filtered_entries.contains(posted.id)) {
+                continue;
+            }
+
+            auto assignment_opt = m_ids.get(posted.id);
+            if (!assignment_opt) {
+                continue;
+            }
+
+            auto& assignment = assignment_opt.value();
+            if (!is_subscribed(assignment.name)) {
+                m_filtered_entries.insert(posted.id);
+                continue;
+            }
+
+            publish(posted.id, assignment.assign_message);
+        }
+
+        if (posted.message.type != message_type::no_type) {
+            m_queue.enqueue(posted.message);
+        }
+    }
+
     m_queue.process();
+    continue_streaming();
+}
+
+void server_client::post(storage::entry_id id, const encoded_message& message) {
+    m_posted.push({id, message});
+    request_update();
+}
+
+void server_client::post_publish(storage::entry_id id) {
+    m_posted.push({id, {message_type::no_type, {}}});
+    request_update();
+}
+
+void server_client::continue_streaming() {
+    // only refilled once everything before was written, the io reports when that happens
+    while (m_cursor && m_queue.empty()) {
+        auto& cursor = m_cursor.value();
+        if (cursor.paths.empty()) {
+            const auto in_handshake = cursor.in_handshake;
+            m_cursor.reset();
+
+            if (in_handshake) {
+                finish_handshake();
+            }
+            break;
+        }
+
+        std::vector<std::pair<storage::entry_id, id_registry::assignment>> batch;
+        if (m_ids.collect_under(cursor.paths.front(), cursor.last_name, publish_batch_size, batch)) {
+            cursor.last_name = batch.back().second.name;
+        } else {
+            cursor.paths.pop_front();
+            cursor.last_name.clear();
+        }
+
+        publish_batch(batch);
+        m_queue.process();
+    }
+}
+
+void server_client::publish_batch(const std::vector<std::pair<storage::entry_id, id_registry::assignment>>& batch, bool resuming) {
+    std::vector<storage::entry_id> ids;
+    std::vector<const id_registry::assignment*> assignments;
+    for (auto& [id, assignment] : batch) {
+        // subscriptions may have changed since the batch was started
+        if (!is_known(id) && is_subscribed(assignment.name)) {
+            ids.push_back(id);
+            assignments.push_back(&assignment);
+        }
+    }
+
+    if (ids.empty()) {
+        return;
+    }
+
+    auto values = m_storage->get_entry_values_from_ids(ids);
+
+    const auto now = m_clock->now();
+    for (size_t i = 0; i < ids.size(); i++) {
+        const auto id = ids[i];
+        auto& value_opt = values[i];
+
+        if (value_opt) {
+            m_queue.enqueue(out_message::entry_publish(now, id, assignments[i]->name, std::move(value_opt.value())));
+        } else {
+            m_queue.enqueue(assignments[i]->assign_message);
+
+            if (resuming && (m_storage->get_entry_flags_from_id(id) & storage::flag_internal_deleted) != 0) {
+                // the client may still hold the entry from before it reconnected
+                m_queue.enqueue(out_message::entry_deleted(now, id));
+            }
+        }
+
+        m_published_entries.insert(id);
+        m_filtered_entries.erase(id);
+    }
+}
+
+void server_client::finish_handshake() {
+    m_queue.enqueue(out_message::handshake_finished());
+    set_state(state::in_use);
+    m_queue.process();
+
+    TRACE_INFO(LOG_MODULE, "finished writing handshake data to server client %d", m_id);
+}
+
+void server_client::post_release(storage::entry_id id) {
+    m_posted.push({id, {message_type::no_type, {}}, true});
+}
+
+void server_client::request_update() {
+    if (m_update_scheduled.exchange(true)) {
+        // already pending
+        return;
+    }
+
+    m_looper->request_execute([client = shared_from_this()](events::looper&)->void {
+        client->update();
+    });
 }
 
 network_server::network_server(clock_ref& clock)
@@ -67,25 +559,33 @@ network_server::network_server(clock_ref& clock)
     , m_clock(clock)
     , m_storage()
     , m_bind_port(0)
+    , m_options()
     , m_looper(nullptr)
     , m_update_timer_handle(empty_handle)
     , m_io()
-    , m_parser()
-    , m_next_entry_id(0)
+    , m_serializer()
+    , m_ids()
+    , m_clients_mutex()
     , m_clients()
-    , m_id_assignments()
+    , m_multicast()
+    , m_multicast_mutex()
+    , m_multicast_entries()
+    , m_changes_mutex()
+    , m_session(0)
+    , m_sequence(0)
+    , m_announced_sequence(0)
+    , m_changes()
+    , m_tombstones()
     , m_open_retry_timer() {
     m_io.on_connect([this](server_io::client_id id)->void {
-        std::unique_lock lock(m_mutex);
-
-        auto client_u = std::make_unique<server_client>(id, m_io, m_clock);
-        auto [it, _] = m_clients.emplace(id, std::move(client_u));
-
-        auto& client = it->second;
+        auto client = std::make_shared<server_client>(id, m_io, m_io.get_looper_for(id), m_ids, m_storage, m_clock);
         client->set_state(server_client::state::in_handshake);
+
+        std::unique_lock lock(m_clients_mutex);
+        m_clients.emplace(id, std::move(client));
     });
     m_io.on_disconnect([this](server_io::client_id id)->void {
-        std::unique_lock lock(m_mutex);
+        std::unique_lock lock(m_clients_mutex);
 
         auto it = m_clients.find(id);
         if (it != m_clients.end()) {
@@ -95,100 +595,26 @@ network_server::network_server(clock_ref& clock)
     m_io.on_close([this]()->void {
         std::unique_lock lock(m_mutex);
 
-        m_clients.clear();
+        {
+            std::unique_lock clients_lock(m_clients_mutex);
+            m_clients.clear();
+        }
 
         m_state = state::opening;
     });
     m_io.on_message([this](server_io::client_id id, const message_header& header, const uint8_t* buffer, size_t size)->void {
-        std::unique_lock lock(m_mutex);
-
-        auto type = static_cast<message_type>(header.type);
-        m_parser.set_data(type, buffer, size);
-        m_parser.process();
-
-        if (m_parser.is_errored()) {
-            TRACE_ERROR(LOG_MODULE, "failed to parse incoming data, parser error=%d", m_parser.error_code());
-            return;
-        } else if (!m_parser.is_finished()) {
-            TRACE_ERROR(LOG_MODULE, "failed to parse incoming data, parser did not finish");
+        // called from the looper of the client, which may differ between clients
+        auto client = get_client(id);
+        if (!client) {
             return;
         }
 
-        TRACE_DEBUG(LOG_MODULE, "received new message from client=%d of m_type=%d", id, type);
-
-        auto parse_data = m_parser.data();
-        switch (type) {
-            case message_type::entry_create: {
-                if (parse_data.id == storage::id_not_assigned) {
-                    parse_data.id = assign_id_to_entry(parse_data.name);
-                }
-
-                auto value = obsr::value(parse_data.value);
-                invoke_sharedptr_nolock<storage::storage, storage::entry_id, std::string_view, const obsr::value&, std::chrono::milliseconds>(
-                        m_storage,
-                        &storage::storage::on_entry_created,
-                        parse_data.id,
-                        parse_data.name,
-                        parse_data.value,
-                        parse_data.send_time);
-
-                publish_and_update_entry_for_clients(
-                        parse_data.id,
-                        parse_data.name,
-                        std::move(value),
-                        parse_data.send_time,
-                        id);
-                break;
-            }
-            case message_type::entry_update: {
-                auto value = obsr::value(parse_data.value);
-
-                invoke_sharedptr_nolock<storage::storage, storage::entry_id, const obsr::value&, std::chrono::milliseconds>(
-                        m_storage,
-                        &storage::storage::on_entry_updated,
-                        parse_data.id,
-                        parse_data.value,
-                        parse_data.send_time);
-
-                auto message_to_others = out_message::entry_update(
-                        parse_data.send_time,
-                        parse_data.id,
-                        std::move(value));
-                enqueue_message_for_clients(message_to_others, id);
-                break;
-            }
-            case message_type::entry_delete: {
-                invoke_sharedptr_nolock<storage::storage, storage::entry_id, std::chrono::milliseconds>(
-                        m_storage,
-                        &storage::storage::on_entry_deleted,
-                        parse_data.id,
-                        parse_data.send_time);
-
-                auto message_to_others = out_message::entry_deleted(
-                        parse_data.send_time,
-                        parse_data.id);
-                enqueue_message_for_clients(message_to_others, id);
-                break;
-            }
-            case message_type::time_sync_request: {
-                const auto now = m_clock->now();
-                enqueue_message_for_client(id,
-                                           out_message::time_sync_response(
-                                                   now,
-                                                   parse_data.send_time),
-                                           message_queue::flag_immediate);
-                break;
-            }
-            case message_type::handshake_ready:
-                handle_do_handshake_for_client(id);
-                break;
-            case message_type::entry_id_assign:
-            case message_type::handshake_finished:
-            case message_type::time_sync_response:
-                // clients should not send this
-            case message_type::no_type:
-            default:
-                break;
+        handle_message(*client, header, buffer, size);
+    });
+    m_io.on_drain([this](server_io::client_id id)->void {
+        auto client = get_client(id);
+        if (client) {
+            client->request_update();
         }
     });
 }
@@ -203,6 +629,16 @@ void network_server::configure_bind(uint16_t bind_port) {
     m_bind_port = bind_port;
 }
 
+void network_server::configure_options(const server_options& options) {
+    std::unique_lock lock(m_mutex);
+
+    if (m_state != state::idle) {
+        throw illegal_state_exception("server running, cannot reconfigure");
+    }
+
+    m_options = options;
+}
+
 void network_server::attach_storage(std::shared_ptr<storage::storage> storage) {
     std::unique_lock lock(m_mutex);
 
@@ -228,20 +664,52 @@ void network_server::start(events::looper* looper) {
         throw illegal_state_exception("server cannot start without binding being configured");
     }
 
-    m_next_entry_id = 0;
-    m_clients.clear();
+    m_ids.clear();
+    {
+        std::unique_lock clients_lock(m_clients_mutex);
+        m_clients.clear();
+    }
+    {
+        std::unique_lock multicast_lock(m_multicast_mutex);
+        m_multicast_entries.clear();
+    }
+    {
+        // ids are reassigned, so sessions of clients from before are of no use
+        std::unique_lock changes_lock(m_changes_mutex);
+
+        std::random_device random;
+        do {
+            m_session = (static_cast<uint64_t>(random()) << 32) | random();
+        } while (m_session == 0);
+
+        m_sequence = 0;
+        m_announced_sequence = 0;
+        m_changes.clear();
+        m_tombstones.clear();
+    }
     m_storage->clear_net_ids();
+    // without ids, entries are published to clients only once sent again. this includes
+    // entries loaded from a snapshot, and those sent before the server was last stopped.
+    m_storage->mark_all_dirty();
 
     m_looper = looper;
 
     m_state = state::opening;
 
     auto update_callback = [this](events::looper&, obsr::handle)->void {
+        std::lock_guard lock(m_mutex);
+
         update();
     };
     m_update_timer_handle = m_looper->create_timer(update_time, update_callback);
 }
 
+network_stats network_server::get_stats() const {
+    network_stats stats;
+    m_io.get_compression_stats().add_to(stats);
+    return stats;
+}
+
 void network_server::stop() {
     std::unique_lock lock(m_mutex);
 
@@ -259,9 +727,15 @@ void network_server::stop() {
         }
 
         m_io.stop();
+        m_multicast.close();
     }, events::looper::execute_type::sync);
     lock.lock();
 
+    {
+        std::unique_lock clients_lock(m_clients_mutex);
+        m_clients.clear();
+    }
+
     m_state = state::idle;
 }
 
@@ -286,9 +760,7 @@ void network_server::update() {
             break;
         }
         case state::in_use:
-            if (!m_clients.empty()) {
-                process_updates();
-            }
+            process_updates();
             break;
         default:
             break;
@@ -296,8 +768,19 @@ void network_server::update() {
 }
 
 bool network_server::do_open() {
+    m_multicast.close();
+    if (!m_options.multicast_group.empty()) {
+        // without multicast, best effort entries are sent like any other entry
+        try {
+            m_multicast.open(m_options.multicast_group, get_multicast_port());
+        } catch (const std::exception& e) {
+            TRACE_ERROR(LOG_MODULE, "error while opening multicast: what=%s", e.what());
+            m_multicast.close();
+        }
+    }
+
     try {
-        m_io.start(m_looper, m_bind_port);
+        m_io.start(m_looper, m_bind_port, m_options);
         m_state = state::in_use;
 
         return true;
@@ -310,7 +793,21 @@ bool network_server::do_open() {
 }
 
 void network_server::process_updates() {
-    m_storage->act_on_dirty_entries([this](const storage::storage_entry& entry) -> bool {
+    {
+        std::shared_lock lock(m_clients_mutex);
+        if (m_clients.empty()) {
+            return;
+        }
+    }
+
+    // entries of a transaction are not multicast, so that clients receive them together
+    bool in_transaction = false;
+    const auto on_transaction = [this, &in_transaction](bool begin)->void {
+        in_transaction = begin;
+        post_transaction_marker(m_serializer, begin);
+    };
+
+    m_storage->act_on_dirty_entries([this, &in_transaction](const storage::storage_entry& entry) -> bool {
         auto id = entry.get_net_id();
 
         if (id == storage::id_not_assigned) {
@@ -318,13 +815,31 @@ void network_server::process_updates() {
         }
 
         auto out_message = out_message::empty();
-        if (entry.has_flags(storage::flag_internal_deleted)) {
+        if (!in_transaction &&
+            !entry.has_flags(storage::flag_internal_deleted) &&
+            entry.has_flags(static_cast<uint16_t>(entry_flag::best_effort)) &&
+            m_multicast.is_open()) {
+            auto value = entry.get_value();
+            out_message = out_message::entry_update(
+                    entry.get_last_update_timestamp(),
+                    id,
+                    std::move(value));
+
+            multicast_message_to_clients(m_serializer, id, out_message);
+            return true;
+        } else if (entry.has_flags(storage::flag_internal_deleted)) {
             // entry deleted
             out_message = out_message::entry_deleted(
                     m_clock->now(),
                     id);
+
+            const auto sequence = fan_out_message_to_clients(m_serializer, id, out_message);
+            retire_id(id, sequence);
+            return true;
         } else {
             // entry updated
+            m_ids.revive(id);
+
             auto value = entry.get_value();
             out_message = out_message::entry_update(
                     entry.get_last_update_timestamp(),
@@ -332,95 +847,437 @@ void network_server::process_updates() {
                     std::move(value));
         }
 
-        for (auto& [client_id, client]: m_clients) {
-            if (!client->is_known(id)) {
-                client->publish(id, entry.get_path());
+        fan_out_message_to_clients(m_serializer, id, out_message);
+
+        return true;
+    }, on_transaction);
+
+    release_expired_ids();
+
+    {
+        // tells the clients how far they got, for when they reconnect. changes made by clients
+        // are announced here as well.
+        std::unique_lock changes_lock(m_changes_mutex);
+        if (m_sequence != m_announced_sequence) {
+            m_announced_sequence = m_sequence;
+
+            auto encoded_opt = m_serializer.encode(out_message::session_info(m_session, m_sequence));
+            if (encoded_opt) {
+                std::shared_lock lock(m_clients_mutex);
+                for (auto& [client_id, client] : m_clients) {
+                    client->post(storage::id_not_assigned, encoded_opt.value());
+                }
             }
+        }
+    }
+
+    // clients flush their queues from their own loopers
+    std::shared_lock lock(m_clients_mutex);
+    for (auto& [client_id, client] : m_clients) {
+        client->request_update();
+    }
+}
 
-            if (out_message.type() != message_type::no_type) {
-                client->enqueue(out_message);
+void network_server::handle_message(server_client& client, const message_header& header, const uint8_t* buffer, size_t size) {
+    auto& parser = client.parser();
+    const auto id = client.get_id();
+
+    auto type = static_cast<message_type>(header.type);
+    parser.set_data(type, buffer, size);
+    parser.process();
+
+    if (parser.is_errored()) {
+        TRACE_ERROR(LOG_MODULE, "failed to parse incoming data, parser error=%d", parser.error_code());
+        return;
+    } else if (!parser.is_finished()) {
+        TRACE_ERROR(LOG_MODULE, "failed to parse incoming data, parser did not finish");
+        return;
+    }
+
+    TRACE_DEBUG(LOG_MODULE, "received new message from client=%d of m_type=%d", id, type);
+
+    auto parse_data = parser.data();
+    switch (type) {
+        case message_type::entry_create: {
+            parse_data.id = assign_id_to_entry(parse_data.name);
+            if (client.in_transaction()) {
+                client.add_to_transaction({parse_data.id, std::move(parse_data.value), parse_data.send_time});
+                break;
             }
+
+            invoke_sharedptr_nolock<storage::storage, storage::entry_id, std::string_view, const obsr::value&, std::chrono::milliseconds>(
+                    m_storage,
+                    &storage::storage::on_entry_created,
+                    parse_data.id,
+                    parse_data.name,
+                    parse_data.value,
+                    parse_data.send_time);
+
+            auto message_to_others = out_message::entry_update(
+                    parse_data.send_time,
+                    parse_data.id,
+                    std::move(parse_data.value));
+            fan_out_message_to_clients(client.serializer(), parse_data.id, message_to_others, id);
+            break;
         }
+        case message_type::entry_update: {
+            if (client.in_transaction()) {
+                client.add_to_transaction({parse_data.id, std::move(parse_data.value), parse_data.send_time});
+                break;
+            }
 
-        return true;
-    });
+            auto value = obsr::value(parse_data.value);
 
-    for (auto& [client_id, client] : m_clients) {
-        client->update();
+            invoke_sharedptr_nolock<storage::storage, storage::entry_id, const obsr::value&, std::chrono::milliseconds>(
+                    m_storage,
+                    &storage::storage::on_entry_updated,
+                    parse_data.id,
+                    parse_data.value,
+                    parse_data.send_time);
+
+            m_ids.revive(parse_data.id);
+
+            auto message_to_others = out_message::entry_update(
+                    parse_data.send_time,
+                    parse_data.id,
+                    std::move(value));
+            if (m_multicast.is_open() && is_best_effort(parse_data.id)) {
+                multicast_message_to_clients(client.serializer(), parse_data.id, message_to_others, id);
+            } else {
+                fan_out_message_to_clients(client.serializer(), parse_data.id, message_to_others, id);
+            }
+            break;
+        }
+        case message_type::entry_delete: {
+            if (client.in_transaction()) {
+                client.add_to_transaction({parse_data.id, std::nullopt, parse_data.send_time});
+                break;
+            }
+
+            invoke_sharedptr_nolock<storage::storage, storage::entry_id, std::chrono::milliseconds>(
+                    m_storage,
+                    &storage::storage::on_entry_deleted,
+                    parse_data.id,
+                    parse_data.send_time);
+
+            auto message_to_others = out_message::entry_deleted(
+                    parse_data.send_time,
+                    parse_data.id);
+            const auto sequence = fan_out_message_to_clients(client.serializer(), parse_data.id, message_to_others, id);
+            retire_id(parse_data.id, sequence);
+            break;
+        }
+        case message_type::time_sync_request: {
+            const auto now = m_clock->now();
+            client.enqueue(out_message::time_sync_response(
+                                   now,
+                                   parse_data.send_time),
+                           message_queue::flag_immediate);
+            break;
+        }
+        case message_type::handshake_ready:
+            handle_do_handshake_for_client(client);
+            break;
+        case message_type::subscribe:
+            handle_subscribe(client, parse_data.name);
+            break;
+        case message_type::unsubscribe:
+            handle_unsubscribe(client, parse_data.name);
+            break;
+        case message_type::session_resume:
+            client.set_resume_request(parse_data.session, parse_data.sequence);
+            break;
+        case message_type::transaction_begin:
+            client.begin_transaction();
+            break;
+        case message_type::transaction_end:
+            if (client.end_transaction()) {
+                handle_transaction(client);
+            }
+            break;
+        case message_type::entry_id_assign:
+        case message_type::entry_id_release:
+        case message_type::entry_publish:
+        case message_type::handshake_finished:
+        case message_type::time_sync_response:
+        case message_type::multicast_info:
+            // clients should not send this
+        case message_type::no_type:
+        default:
+            break;
     }
 }
 
+std::shared_ptr<server_client> network_server::get_client(server_io::client_id id) {
+    std::shared_lock lock(m_clients_mutex);
+
+    auto it = m_clients.find(id);
+    if (it == m_clients.end()) {
+        return nullptr;
+    }
+
+    return it->second;
+}
+
 storage::entry_id network_server::assign_id_to_entry(std::string_view name) {
-    auto id = m_next_entry_id++;
-    m_id_assignments.emplace(id, name);
-    m_storage->on_entry_id_assigned(id, name);
+    bool is_new = false;
+    auto id = m_ids.assign(name, is_new);
+    if (is_new) {
+        m_storage->on_entry_id_assigned(id, name);
+    }
 
     return id;
 }
 
-void network_server::enqueue_message_for_clients(const out_message& message, server_io::client_id id_to_skip) {
+uint64_t network_server::fan_out_message_to_clients(message_serializer& serializer,
+                                                    storage::entry_id entry_id,
+                                                    const out_message& message,
+                                                    server_io::client_id id_to_skip) {
+    // messages are serialized once and shared between all the client queues
+    auto encoded_opt = serializer.encode(message);
+    if (!encoded_opt) {
+        TRACE_ERROR(LOG_MODULE, "failed to serialize message for entry %d", entry_id);
+        return 0;
+    }
+
+    const auto& encoded = encoded_opt.value();
+
+    std::unique_lock changes_lock(m_changes_mutex);
+    record_change(entry_id);
+
+    std::shared_lock lock(m_clients_mutex);
     for (auto& [id, client] : m_clients) {
         if (id == id_to_skip) {
             continue;
         }
 
-        client->enqueue(message);
+        client->post(entry_id, encoded);
     }
+
+    return m_sequence;
 }
 
-void network_server::enqueue_message_for_client(server_io::client_id id, const out_message& message, uint8_t flags) {
-    auto it = m_clients.find(id);
-    if (it == m_clients.end()) {
+void network_server::multicast_message_to_clients(message_serializer& serializer,
+                                                  storage::entry_id entry_id,
+                                                  const out_message& message,
+                                                  server_io::client_id origin) {
+    auto encoded_opt = serializer.encode(message);
+    if (!encoded_opt) {
+        TRACE_ERROR(LOG_MODULE, "failed to serialize message for entry %d", entry_id);
         return;
     }
 
-    it->second->enqueue(message, flags);
+    std::unique_lock changes_lock(m_changes_mutex);
+    record_change(entry_id);
+
+    bool first_time;
+    {
+        std::unique_lock lock(m_multicast_mutex);
+        first_time = m_multicast_entries.insert(entry_id);
+    }
+
+    if (first_time) {
+        // clients learn of the id of the entry from their connection. updates which reach them
+        // before that are dropped. clients which connect later receive all ids in the handshake.
+        std::shared_lock lock(m_clients_mutex);
+        for (auto& [id, client] : m_clients) {
+            client->post_publish(entry_id);
+        }
+    }
+
+    const auto& encoded = encoded_opt.value();
+    if (!m_multicast.send(static_cast<uint8_t>(encoded.type), encoded.payload, origin)) {
+        TRACE_DEBUG(LOG_MODULE, "failed to multicast message for entry %d", entry_id);
+    }
 }
 
-void network_server::publish_and_update_entry_for_clients(
-        storage::entry_id entry_id,
-        const std::string& name,
-        obsr::value&& value,
-        std::chrono::milliseconds value_time,
-        server_io::client_id id_to_skip) {
-    const auto message = out_message::entry_update(value_time, entry_id, std::move(value));
+void network_server::post_transaction_marker(message_serializer& serializer,
+                                             bool begin,
+                                             server_io::client_id id_to_skip) {
+    auto encoded_opt = serializer.encode(begin ? out_message::transaction_begin() : out_message::transaction_end());
+    if (!encoded_opt) {
+        return;
+    }
+
+    std::shared_lock lock(m_clients_mutex);
     for (auto& [id, client] : m_clients) {
         if (id == id_to_skip) {
             continue;
         }
 
-        client->publish(id, name);
-        client->enqueue(message);
+        client->post(storage::id_not_assigned, encoded_opt.value());
     }
 }
 
-void network_server::handle_do_handshake_for_client(server_io::client_id id) {
-    auto it = m_clients.find(id);
-    if (it == m_clients.end()) {
+void network_server::handle_transaction(server_client& client) {
+    const auto changes = client.take_transaction();
+
+    if (!m_storage->on_entries_changed(changes)) {
         return;
     }
 
-    auto& client = it->second;
+    const auto id = client.get_id();
+    auto& serializer = client.serializer();
 
-    const auto now = m_clock->now();
-    for (auto& [entry_id, name] : m_id_assignments) {
-        if (client->is_known(entry_id)) {
+    // sent over tcp even for best effort entries, so that clients apply the changes together
+    post_transaction_marker(serializer, true, id);
+    for (auto& change : changes) {
+        if (change.value) {
+            m_ids.revive(change.id);
+
+            auto value = obsr::value(change.value.value());
+            fan_out_message_to_clients(serializer, change.id, out_message::entry_update(change.timestamp, change.id, std::move(value)), id);
+        } else {
+            const auto sequence = fan_out_message_to_clients(serializer, change.id, out_message::entry_deleted(change.timestamp, change.id), id);
+            retire_id(change.id, sequence);
+        }
+    }
+    post_transaction_marker(serializer, false, id);
+}
+
+bool network_server::is_best_effort(storage::entry_id id) {
+    const auto flags = m_storage->get_entry_flags_from_id(id);
+    return (flags & static_cast<uint16_t>(entry_flag::best_effort)) != 0;
+}
+
+void network_server::retire_id(storage::entry_id id, uint64_t sequence) {
+    if (sequence == 0) {
+        return;
+    }
+
+    m_ids.retire(id, sequence);
+
+    std::unique_lock changes_lock(m_changes_mutex);
+    m_tombstones.emplace_back(sequence, id);
+}
+
+void network_server::release_expired_ids() {
+    std::vector<std::pair<uint64_t, storage::entry_id>> expired;
+    {
+        // a client resuming from before the deletion must still be told of it, under the old id
+        std::unique_lock changes_lock(m_changes_mutex);
+        while (!m_tombstones.empty() &&
+               (m_changes.empty() || m_tombstones.front().first < m_changes.front().first)) {
+            expired.push_back(m_tombstones.front());
+            m_tombstones.pop_front();
+        }
+    }
+
+    for (auto& [sequence, id] : expired) {
+        if ((m_storage->get_entry_flags_from_id(id) & storage::flag_internal_deleted) == 0) {
+            // in use again
+            m_ids.revive(id);
+            continue;
+        }
+
+        if (!m_ids.release(id, sequence)) {
             continue;
         }
 
-        client->publish(entry_id, name);
+        TRACE_DEBUG(LOG_MODULE, "released id %u of deleted entry", id);
+        m_storage->on_entry_id_released(id);
 
-        auto value_opt = m_storage->get_entry_value_from_id(entry_id);
-        if (value_opt) {
-            auto& value = value_opt.value();
-            client->enqueue(out_message::entry_update(now, entry_id, std::move(value)));
+        {
+            std::unique_lock lock(m_multicast_mutex);
+            m_multicast_entries.erase(id);
+        }
+
+        std::shared_lock lock(m_clients_mutex);
+        for (auto& [client_id, client] : m_clients) {
+            client->post_release(id);
         }
     }
+}
 
-    client->enqueue(out_message::handshake_finished());
-    client->set_state(server_client::state::in_use);
+void network_server::record_change(storage::entry_id id) {
+    m_changes.emplace_back(++m_sequence, id);
+    while (m_changes.size() > m_options.session_log_size) {
+        m_changes.pop_front();
+    }
+}
 
-    TRACE_INFO(LOG_MODULE, "finished writing handshake data to server client %d", client->get_id());
+bool network_server::can_resume_from(uint64_t session, uint64_t sequence) const {
+    if (session != m_session || sequence > m_sequence) {
+        return false;
+    }
+
+    // all the changes after the sequence must still be in the log
+    if (m_changes.empty()) {
+        return sequence == m_sequence;
+    }
+
+    return m_changes.front().first <= sequence + 1;
+}
+
+uint16_t network_server::get_multicast_port() const {
+    return m_options.multicast_port != 0 ? m_options.multicast_port : m_bind_port;
+}
+
+void network_server::handle_do_handshake_for_client(server_client& client) {
+    if (m_multicast.is_open()) {
+        // the client joins the group first, so it misses as few updates as possible
+        client.enqueue(out_message::multicast_info(m_options.multicast_group, get_multicast_port(), client.get_id()));
+    }
+
+    uint64_t sequence;
+    bool resume = false;
+    std::set<storage::entry_id> changed;
+    {
+        // anything up to the sequence is in storage, and is sent as part of the handshake
+        std::unique_lock changes_lock(m_changes_mutex);
+        sequence = m_sequence;
+
+        const auto request_opt = client.resume_request();
+        if (request_opt && can_resume_from(request_opt->first, request_opt->second)) {
+            for (auto& [change_sequence, id] : m_changes) {
+                if (change_sequence > request_opt->second) {
+                    changed.insert(id);
+                }
+            }
+
+            resume = true;
+        }
+    }
+
+    // sent first, so the client knows whether its ids are still good before using them
+    client.enqueue(out_message::session_info(m_session, sequence));
+
+    if (resume) {
+        TRACE_INFO(LOG_MODULE, "resuming session of server client %d, %lu entries changed", client.get_id(), changed.size());
+        client.resume(changed);
+        client.request_update();
+    } else {
+        // only the entries the client subscribed to are sent, so the handshake is as big as the subscriptions
+        client.stream_handshake();
+    }
+}
+
+void network_server::handle_subscribe(server_client& client, std::string_view path) {
+    TRACE_DEBUG(LOG_MODULE, "server client %d subscribed to %.*s", client.get_id(), static_cast<int>(path.size()), path.data());
+    if (!client.subscribe(path)) {
+        return;
+    }
+
+    client.stream_entries(path);
+}
+
+void network_server::handle_unsubscribe(server_client& client, std::string_view path) {
+    TRACE_DEBUG(LOG_MODULE, "server client %d unsubscribed from %.*s", client.get_id(), static_cast<int>(path.size()), path.data());
+    if (!client.unsubscribe(path)) {
+        return;
+    }
+
+    // the entries may still be covered by other subscriptions
+    std::vector<storage::entry_id> removed;
+    m_ids.for_each_under(path, [&removed, &client](storage::entry_id id, const id_registry::assignment& assignment)->void {
+        if (client.is_known(id) && !client.is_subscribed(assignment.name)) {
+            removed.push_back(id);
+        }
+    });
+
+    for (auto id : removed) {
+        client.forget(id);
+    }
 }
 
 }
@@ -2,16 +2,89 @@
 
 #include <set>
 #include <deque>
+#include <shared_mutex>
+#include <atomic>
 
 #include "storage/storage.h"
 #include "net/io.h"
 #include "net/serialize.h"
 #include "net/net.h"
 #include "events/events.h"
+#include "util/mpsc_queue.h"
+#include "util/path_trie.h"
 
 namespace obsr::net {
 
-class server_client {
+// set of entry ids, indexed by the index of the id. the ids are assigned densely, so this is
+// a single load per lookup.
+class entry_id_set {
+public:
+    entry_id_set();
+
+    [[nodiscard]] bool contains(storage::entry_id id) const;
+    // each returns false if there was no change
+    bool insert(storage::entry_id id);
+    bool erase(storage::entry_id id);
+    void clear();
+
+private:
+    std::vector<storage::entry_id> m_ids;
+};
+
+// ids assigned by the server to entries. may be used from any thread.
+class id_registry {
+public:
+    struct assignment {
+        std::string name;
+        encoded_message assign_message;
+    };
+    using assignment_action = std::function<void(storage::entry_id, const assignment&)>;
+
+    id_registry();
+
+    // assigns a new id to the entry, or returns the id already assigned to it.
+    storage::entry_id assign(std::string_view name, bool& is_new);
+    std::optional<assignment> get(storage::entry_id id);
+    // the entry was deleted at the given sequence. the id is kept until released, in case the entry is used again.
+    void retire(storage::entry_id id, uint64_t sequence);
+    // the entry is in use again
+    void revive(storage::entry_id id);
+    // frees the index of the id for reuse under a new epoch, if the id was not used since retired at the
+    // given sequence. returns whether it was freed.
+    bool release(storage::entry_id id, uint64_t sequence);
+    // visits the entries at or under the path. the registry is locked during the visit.
+    void for_each_under(std::string_view path, const assignment_action& action);
+    // copies up to limit entries at or under the path, with names after the given name (or from the start if empty).
+    // returns whether there may be more entries after those copied.
+    bool collect_under(std::string_view path,
+                       std::string_view after,
+                       size_t limit,
+                       std::vector<std::pair<storage::entry_id, assignment>>& out);
+    void clear();
+
+private:
+    struct slot {
+        storage::entry_id id = storage::id_not_assigned;
+        // of the next id given with this index
+        uint8_t epoch = 0;
+        assignment data;
+        // sequence of the deletion of the entry
+        std::optional<uint64_t> retired_at;
+    };
+
+    // must be called with the mutex locked. returns nullptr for stale or unknown ids.
+    slot* find(storage::entry_id id);
+
+    std::shared_mutex m_mutex;
+    message_serializer m_serializer;
+    // indexed by the index of the id
+    std::vector<slot> m_slots;
+    std::vector<uint32_t> m_free_indices;
+    std::map<std::string, storage::entry_id, std::less<>> m_names;
+    std::atomic<size_t> m_retired_count;
+};
+
+class server_client : public std::enable_shared_from_this<server_client> {
 public:
     enum class state {
         connected,
@@ -19,30 +92,110 @@ public:
         in_use,
     };
 
-    server_client(server_io::client_id id, server_io& parent, const clock_ref& clock);
+    server_client(server_io::client_id id,
+                  server_io& parent,
+                  events::looper* looper,
+                  id_registry& ids,
+                  std::shared_ptr<storage::storage> storage,
+                  const clock_ref& clock);
 
     server_io::client_id get_id() const;
 
     state get_state() const;
     void set_state(state state);
 
+    message_parser& parser();
+    message_serializer& serializer();
+
+    // following calls must be done from the looper of the client
     bool is_known(storage::entry_id id) const;
+    void publish(storage::entry_id id, const encoded_message& assign_message);
+    // the client is no longer sent anything about the entry, until it is published again
+    void forget(storage::entry_id id);
+
+    // assumes the client already knows of the entry, from a previous connection
+    void assume_known(storage::entry_id id);
 
-    void publish(storage::entry_id id, std::string_view name);
+    // position in the session of the server, up to which the client received everything before reconnecting
+    void set_resume_request(uint64_t session, uint64_t sequence);
+    std::optional<std::pair<uint64_t, uint64_t>> resume_request() const;
+
+    // changes sent by the client within a transaction are held until the outermost transaction ends
+    void begin_transaction();
+    // returns whether the outermost transaction ended
+    bool end_transaction();
+    [[nodiscard]] bool in_transaction() const;
+    void add_to_transaction(storage::entry_change&& change);
+    std::vector<storage::entry_change> take_transaction();
+
+    // the client is only sent entries at or under the paths it is subscribed to.
+    // each returns false if there was no change.
+    bool subscribe(std::string_view path);
+    bool unsubscribe(std::string_view path);
+    bool is_subscribed(std::string_view path) const;
+    const path_trie& subscriptions() const;
+
+    // entries are published in batches, each once the previous was written out, so that large
+    // tables do not pile up in the queue. the handshake is finished once all subscriptions were published.
+    void stream_handshake();
+    // publishes the entries at or under the path which the client does not know yet, once in use
+    void stream_entries(std::string_view path);
+    // publishes only the entries which changed since the client was last connected, and finishes the handshake
+    void resume(const std::set<storage::entry_id>& changed);
 
     void enqueue(const out_message& message, uint8_t flags = 0);
     void clear();
-
     void update();
 
+    // may be called from any thread. the message is sent from the looper of the client
+    // after publishing the entry to the client, if needed.
+    void post(storage::entry_id id, const encoded_message& message);
+    // may be called from any thread. publishes the entry to the client, if needed, without sending anything else.
+    void post_publish(storage::entry_id id);
+    // may be called from any thread. the id was released, and will not be used again.
+    void post_release(storage::entry_id id);
+    // may be called from any thread. schedules update to run in the looper of the client.
+    void request_update();
+
 private:
+    struct posted_message {
+        storage::entry_id id;
+        encoded_message message;
+        bool released = false;
+    };
+    struct publish_cursor {
+        std::deque<std::string> paths;
+        // last entry published under the first path
+        std::string last_name;
+        bool in_handshake;
+    };
+
+    void continue_streaming();
+    void publish_batch(const std::vector<std::pair<storage::entry_id, id_registry::assignment>>& batch, bool resuming = false);
+    void finish_handshake();
+
     server_io::client_id m_id;
     server_io& m_parent;
+    id_registry& m_ids;
+    std::shared_ptr<storage::storage> m_storage;
+    events::looper* m_looper;
     clock_ref m_clock;
-    state m_state;
+    std::atomic<state> m_state;
 
+    message_parser m_parser;
+    message_serializer m_serializer;
     message_queue m_queue;
-    std::set<storage::entry_id> m_published_entries;
+    entry_id_set m_published_entries;
+    path_trie m_subscriptions;
+    // entries found to be outside the subscriptions, to not look them up again on each update
+    entry_id_set m_filtered_entries;
+    std::optional<std::pair<uint64_t, uint64_t>> m_resume_request;
+    std::optional<publish_cursor> m_cursor;
+    uint32_t m_transaction_depth;
+    std::vector<storage::entry_change> m_transaction_changes;
+
+    mpsc_queue<posted_message> m_posted;
+    std::atomic<bool> m_update_scheduled;
 };
 
 class network_server : public network_interface {
@@ -50,11 +203,14 @@ public:
     explicit network_server(clock_ref& clock);
 
     void configure_bind(uint16_t bind_port);
+    void configure_options(const server_options& options);
 
     void attach_storage(std::shared_ptr<storage::storage> storage) override;
     void start(events::looper* looper) override;
     void stop() override;
 
+    network_stats get_stats() const override;
+
 private:
     enum class state {
         idle,
@@ -65,18 +221,40 @@ private:
     void update();
     bool do_open();
     void process_updates();
+    void handle_message(server_client& client, const message_header& header, const uint8_t* buffer, size_t size);
 
+    std::shared_ptr<server_client> get_client(server_io::client_id id);
     storage::entry_id assign_id_to_entry(std::string_view name);
-    void enqueue_message_for_clients(const out_message& message, server_io::client_id id_to_skip = server_io::invalid_client_id);
-    void enqueue_message_for_client(server_io::client_id id, const out_message& message, uint8_t flags = 0);
-    void publish_and_update_entry_for_clients(
-            storage::entry_id entry_id,
-            const std::string& name,
-            obsr::value&& value,
-            std::chrono::milliseconds value_time,
-            server_io::client_id id_to_skip = server_io::invalid_client_id);
+    // returns the sequence of the change, or 0 if it was not sent
+    uint64_t fan_out_message_to_clients(message_serializer& serializer,
+                                        storage::entry_id entry_id,
+                                        const out_message& message,
+                                        server_io::client_id id_to_skip = server_io::invalid_client_id);
+
+    // sends the message once to all clients over multicast, instead of to each client
+    void multicast_message_to_clients(message_serializer& serializer,
+                                      storage::entry_id entry_id,
+                                      const out_message& message,
+                                      server_io::client_id origin = server_io::invalid_client_id);
+    bool is_best_effort(storage::entry_id id);
+    // marks the start or end of a transaction to all clients
+    void post_transaction_marker(message_serializer& serializer,
+                                 bool begin,
+                                 server_io::client_id id_to_skip = server_io::invalid_client_id);
+    void handle_transaction(server_client& client);
 
-    void handle_do_handshake_for_client(server_io::client_id id);
+    // ids of deleted entries are reused once no client may resume from before the deletion
+    void retire_id(storage::entry_id id, uint64_t sequence);
+    void release_expired_ids();
+
+    // following must be called with the changes mutex locked
+    void record_change(storage::entry_id id);
+    bool can_resume_from(uint64_t session, uint64_t sequence) const;
+    uint16_t get_multicast_port() const;
+
+    void handle_do_handshake_for_client(server_client& client);
+    void handle_subscribe(server_client& client, std::string_view path);
+    void handle_unsubscribe(server_client& client, std::string_view path);
 
     std::mutex m_mutex;
     state m_state;
@@ -84,16 +262,33 @@ private:
     clock_ref m_clock;
     std::shared_ptr<storage::storage> m_storage;
     uint16_t m_bind_port;
+    server_options m_options;
 
     events::looper* m_looper;
     obsr::handle m_update_timer_handle;
 
     server_io m_io;
-    message_parser m_parser;
+    message_serializer m_serializer;
+    id_registry m_ids;
+
+    std::shared_mutex m_clients_mutex;
+    std::map<server_io::client_id, std::shared_ptr<server_client>> m_clients;
+
+    multicast_sender m_multicast;
+    std::mutex m_multicast_mutex;
+    // entries which were multicast at least once, and so were published to all clients
+    entry_id_set m_multicast_entries;
 
-    storage::entry_id m_next_entry_id;
-    std::map<server_io::client_id, std::unique_ptr<server_client>> m_clients;
-    std::map<storage::entry_id, std::string> m_id_assignments;
+    // changes are numbered in the order they are posted to clients, which is the order clients
+    // receive them in. guards the posting of changes, and the session state.
+    std::mutex m_changes_mutex;
+    uint64_t m_session;
+    uint64_t m_sequence;
+    uint64_t m_announced_sequence;
+    // recent changes, oldest first
+    std::deque<std::pair<uint64_t, storage::entry_id>> m_changes;
+    // ids of deleted entries, by the sequence of their deletion
+    std::deque<std::pair<uint64_t, storage::entry_id>> m_tombstones;
 
     timer m_open_retry_timer;
 };
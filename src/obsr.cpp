@@ -50,14 +50,34 @@ uint32_t probe(entry entry) {
     return s_instance.probe(entry);
 }
 
+void set_entry_flag(entry entry, entry_flag flag) {
+    s_instance.set_entry_flag(entry, flag);
+}
+
+void clear_entry_flag(entry entry, entry_flag flag) {
+    s_instance.clear_entry_flag(entry, flag);
+}
+
 obsr::value get_value(entry entry) {
     return s_instance.get_value(entry);
 }
 
+std::vector<std::optional<obsr::value>> get_values(std::span<const entry> entries) {
+    return s_instance.get_values(entries);
+}
+
+std::vector<std::pair<entry, obsr::value>> snapshot(object obj) {
+    return s_instance.snapshot(obj);
+}
+
 void set_value(entry entry, const obsr::value& value) {
     s_instance.set_value(entry, value);
 }
 
+void set_values(std::span<const std::pair<entry, obsr::value>> values) {
+    s_instance.set_values(values);
+}
+
 void clear_value(entry entry) {
     s_instance.clear_value(entry);
 }
@@ -74,18 +94,64 @@ void delete_listener(listener listener) {
     s_instance.delete_listener(listener);
 }
 
-void start_server(uint16_t bind_port) {
-    s_instance.start_server(bind_port);
+void start_server(uint16_t bind_port, const server_options& options) {
+    s_instance.start_server(bind_port, options);
+}
+
+void start_client(std::string_view address, uint16_t server_port, const client_options& options) {
+    s_instance.start_client(address, server_port, options);
+}
+
+void subscribe(std::string_view path) {
+    s_instance.subscribe(path);
+}
+
+void unsubscribe(std::string_view path) {
+    s_instance.unsubscribe(path);
 }
 
-void start_client(std::string_view address, uint16_t server_port) {
-    s_instance.start_client(address, server_port);
+network_stats get_network_stats() {
+    return s_instance.get_network_stats();
 }
 
 void stop_network() {
     s_instance.stop_network();
 }
 
+void save_snapshot(std::string_view path) {
+    s_instance.save_snapshot(path);
+}
+
+bool load_snapshot(std::string_view path) {
+    return s_instance.load_snapshot(path);
+}
+
+void start_persistence(std::string_view path, std::chrono::milliseconds save_interval) {
+    persistence_options options;
+    options.save_interval = save_interval;
+    s_instance.start_persistence(path, options);
+}
+
+void start_persistence(std::string_view path, const persistence_options& options) {
+    s_instance.start_persistence(path, options);
+}
+
+void stop_persistence() {
+    s_instance.stop_persistence();
+}
+
+void start_recording(std::string_view path) {
+    s_instance.start_recording(path);
+}
+
+void stop_recording() {
+    s_instance.stop_recording();
+}
+
+size_t replay_recording(std::string_view path, double speed) {
+    return s_instance.replay_recording(path, speed);
+}
+
 }
 
 template<typename t_>
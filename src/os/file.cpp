@@ -0,0 +1,167 @@
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <cerrno>
+
+#include "internal_except.h"
+#include "file.h"
+
+namespace obsr::os {
+
+static void write_all(int fd, std::span<const uint8_t> data) {
+    size_t written = 0;
+    while (written < data.size()) {
+        const auto result = ::write(fd, data.data() + written, data.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            throw io_exception(errno);
+        }
+
+        written += result;
+    }
+}
+
+mapped_file::mapped_file(void* memory, size_t size)
+    : m_memory(memory)
+    , m_size(size)
+{}
+
+mapped_file::~mapped_file() {
+    if (m_memory != nullptr) {
+        ::munmap(m_memory, m_size);
+    }
+}
+
+std::span<const uint8_t> mapped_file::data() const {
+    return {static_cast<const uint8_t*>(m_memory), m_size};
+}
+
+std::unique_ptr<mapped_file> mapped_file::open(const std::string& path) {
+    auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return nullptr;
+        }
+
+        throw io_exception(errno);
+    }
+
+    struct stat file_stat{};
+    if (::fstat(fd, &file_stat)) {
+        const auto error_code = errno;
+        ::close(fd);
+        throw io_exception(error_code);
+    }
+
+    const auto size = static_cast<size_t>(file_stat.st_size);
+    if (size == 0) {
+        // nothing to map
+        ::close(fd);
+        return std::unique_ptr<mapped_file>(new mapped_file(nullptr, 0));
+    }
+
+    // the whole file is read once, front to back
+    auto memory = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    const auto error_code = errno;
+    ::close(fd);
+
+    if (memory == MAP_FAILED) {
+        throw io_exception(error_code);
+    }
+
+    ::madvise(memory, size, MADV_SEQUENTIAL);
+
+    return std::unique_ptr<mapped_file>(new mapped_file(memory, size));
+}
+
+append_file::append_file(int fd, size_t size)
+    : m_fd(fd)
+    , m_size(size)
+{}
+
+append_file::~append_file() {
+    ::close(m_fd);
+}
+
+void append_file::write(std::span<const uint8_t> data) {
+    write_all(m_fd, data);
+    m_size += data.size();
+}
+
+void append_file::sync() {
+    // the size of the file only changes as data is written, so there is no need to sync its metadata
+    if (::fdatasync(m_fd)) {
+        throw io_exception(errno);
+    }
+}
+
+size_t append_file::size() const {
+    return m_size;
+}
+
+std::unique_ptr<append_file> append_file::create(const std::string& path) {
+    auto fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw io_exception(errno);
+    }
+
+    return std::unique_ptr<append_file>(new append_file(fd, 0));
+}
+
+void replace_file(const std::string& path, std::span<const uint8_t> data) {
+    const auto temp_path = path + ".tmp";
+
+    auto fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw io_exception(errno);
+    }
+
+    try {
+        write_all(fd, data);
+    } catch (const io_exception&) {
+        ::close(fd);
+        ::unlink(temp_path.c_str());
+        throw;
+    }
+
+    // the data must reach the disk before the rename does, or a crash may leave an empty file
+    if (::fsync(fd)) {
+        const auto error_code = errno;
+        ::close(fd);
+        ::unlink(temp_path.c_str());
+        throw io_exception(error_code);
+    }
+    ::close(fd);
+
+    if (::rename(temp_path.c_str(), path.c_str())) {
+        const auto error_code = errno;
+        ::unlink(temp_path.c_str());
+        throw io_exception(error_code);
+    }
+}
+
+void rename_file(const std::string& from, const std::string& to) {
+    if (::rename(from.c_str(), to.c_str())) {
+        throw io_exception(errno);
+    }
+}
+
+bool remove_file(const std::string& path) {
+    if (::unlink(path.c_str())) {
+        if (errno == ENOENT) {
+            return false;
+        }
+
+        throw io_exception(errno);
+    }
+
+    return true;
+}
+
+}
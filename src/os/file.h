@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <span>
+
+namespace obsr::os {
+
+// contents of a whole file, mapped into memory for reading
+class mapped_file {
+public:
+    ~mapped_file();
+
+    [[nodiscard]] std::span<const uint8_t> data() const;
+
+    // returns nullptr if there is no file at the path
+    static std::unique_ptr<mapped_file> open(const std::string& path);
+
+private:
+    mapped_file(void* memory, size_t size);
+
+    void* m_memory;
+    size_t m_size;
+};
+
+// a file which is only written at its end, such as a log
+class append_file {
+public:
+    ~append_file();
+
+    // all the data is written, or an io_exception is thrown
+    void write(std::span<const uint8_t> data);
+    // returns once the data written so far reached the disk
+    void sync();
+    [[nodiscard]] size_t size() const;
+
+    // the file is created, or emptied if there is one at the path already
+    static std::unique_ptr<append_file> create(const std::string& path);
+
+private:
+    append_file(int fd, size_t size);
+
+    int m_fd;
+    size_t m_size;
+};
+
+// replaces the contents of the file at the path. the data is written to a temporary file next to it,
+// which is then renamed over it, so that the file is never seen partially written.
+void replace_file(const std::string& path, std::span<const uint8_t> data);
+
+void rename_file(const std::string& from, const std::string& to);
+// returns false if there is no file at the path
+bool remove_file(const std::string& path);
+
+}
@@ -31,6 +31,11 @@ private:
     descriptor m_descriptor;
 };
 
+struct io_vector {
+    const uint8_t* data;
+    size_t size;
+};
+
 class readable {
 public:
     virtual ~readable() = default;
@@ -43,6 +48,11 @@ public:
     virtual size_t write(const uint8_t* buffer, size_t size) = 0;
 };
 
-
+class stream : public readable, public writable {
+public:
+    // writes several buffers in one call, as if they were a single continuous buffer.
+    // returns the amount of bytes written, which may end in the middle of one of the buffers.
+    virtual size_t writev(const io_vector* vectors, size_t count) = 0;
+};
 
 }
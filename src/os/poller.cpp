@@ -5,7 +5,7 @@
 
 namespace obsr::os {
 
-static constexpr size_t events_buffer_size = 20;
+static constexpr size_t initial_events_capacity = 32;
 
 static descriptor create() {
     const auto fd = ::epoll_create1(0);
@@ -30,6 +30,9 @@ static uint32_t events_to_native(events::event_types events) {
     if ((events & events::event_type::event_hung) != 0) {
         r_events |= EPOLLHUP;
     }
+    if ((events & events::event_type::event_edge) != 0) {
+        r_events |= EPOLLET;
+    }
 
     return r_events;
 }
@@ -54,32 +57,33 @@ static events::event_types native_to_events(uint32_t events) {
 
 resource_poller::resource_poller()
     : resource(create())
-    , m_events(new epoll_event[events_buffer_size])
-    , m_data(m_events)
+    , m_events(new epoll_event[initial_events_capacity])
+    , m_events_capacity(initial_events_capacity)
+    , m_data()
 {}
 
 resource_poller::~resource_poller() {
     delete[] reinterpret_cast<epoll_event*>(m_events);
 }
 
-void resource_poller::add(resource& resource, events::event_types events) {
+void resource_poller::add(resource& resource, events::event_types events, void* context) {
     const auto descriptor = resource.get_descriptor();
 
     epoll_event event{};
     event.events = events_to_native(events);
-    event.data.fd = descriptor;
+    event.data.ptr = context;
 
     if (::epoll_ctl(get_descriptor(), EPOLL_CTL_ADD, descriptor, &event)) {
         handle_error();
     }
 }
 
-void resource_poller::set(resource& resource, events::event_types events) {
+void resource_poller::set(resource& resource, events::event_types events, void* context) {
     const auto descriptor = resource.get_descriptor();
 
     epoll_event event{};
     event.events = events_to_native(events);
-    event.data.fd = descriptor;
+    event.data.ptr = context;
 
     if (::epoll_ctl(get_descriptor(), EPOLL_CTL_MOD, descriptor, &event)) {
         handle_error();
@@ -91,7 +95,7 @@ void resource_poller::remove(resource& resource) {
 
     epoll_event event{};
     event.events = 0;
-    event.data.fd = descriptor;
+    event.data.ptr = nullptr;
 
     if (::epoll_ctl(get_descriptor(), EPOLL_CTL_DEL, descriptor, &event)) {
         handle_error();
@@ -99,10 +103,7 @@ void resource_poller::remove(resource& resource) {
 }
 
 events::polled_events resource_poller::poll(size_t max_events, std::chrono::milliseconds timeout) {
-    if (max_events > events_buffer_size) {
-        // todo: dynamically change the circular_buffer size
-        throw illegal_argument_exception("max events requested exceed support size");
-    }
+    ensure_capacity(max_events);
 
     auto events = reinterpret_cast<epoll_event*>(m_events);
     const auto count = ::epoll_wait(get_descriptor(), events, static_cast<int>(max_events), static_cast<int>(timeout.count()));
@@ -110,14 +111,14 @@ events::polled_events resource_poller::poll(size_t max_events, std::chrono::mill
         int error = errno;
         if (error == EINTR) {
             // timeout has occurred
-            m_data.set_count(0);
+            m_data.set(events, 0);
             return events::polled_events{&m_data};
         } else {
             throw io_exception(error);
         }
     }
 
-    m_data.set_count(count);
+    m_data.set(events, count);
     return events::polled_events{&m_data};
 }
 
@@ -126,8 +127,21 @@ void resource_poller::handle_error() {
     throw io_exception(error);
 }
 
-resource_poller::event_data::event_data(void* events)
-    : m_events(events)
+void resource_poller::ensure_capacity(size_t max_events) {
+    if (max_events <= m_events_capacity) {
+        return;
+    }
+
+    delete[] reinterpret_cast<epoll_event*>(m_events);
+    m_events = nullptr;
+    m_data.set(nullptr, 0);
+
+    m_events = new epoll_event[max_events];
+    m_events_capacity = max_events;
+}
+
+resource_poller::event_data::event_data()
+    : m_events(nullptr)
     , m_count(0)
 {}
 
@@ -135,13 +149,14 @@ size_t resource_poller::event_data::count() const {
     return m_count;
 }
 
-void resource_poller::event_data::set_count(size_t count) {
+void resource_poller::event_data::set(void* events, size_t count) {
+    m_events = events;
     m_count = count;
 }
 
-descriptor resource_poller::event_data::get_descriptor(size_t index) const {
+void* resource_poller::event_data::get_context(size_t index) const {
     const auto events = reinterpret_cast<epoll_event*>(m_events);
-    return static_cast<descriptor>(events[index].data.fd);
+    return events[index].data.ptr;
 }
 
 events::event_types resource_poller::event_data::get_events(size_t index) const {
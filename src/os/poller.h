@@ -12,8 +12,8 @@ public:
     resource_poller();
     ~resource_poller() override;
 
-    void add(resource& resource, events::event_types events) override;
-    void set(resource& resource, events::event_types events) override;
+    void add(resource& resource, events::event_types events, void* context) override;
+    void set(resource& resource, events::event_types events, void* context) override;
     void remove(resource& resource) override;
 
     events::polled_events poll(size_t max_events, std::chrono::milliseconds timeout) override;
@@ -21,12 +21,12 @@ public:
 private:
     class event_data : public events::event_data {
     public:
-        explicit event_data(void* events);
+        event_data();
 
         size_t count() const override;
-        void set_count(size_t count);
+        void set(void* events, size_t count);
 
-        descriptor get_descriptor(size_t index) const override;
+        void* get_context(size_t index) const override;
         events::event_types get_events(size_t index) const override;
 
     private:
@@ -35,8 +35,10 @@ private:
     };
 
     void handle_error();
+    void ensure_capacity(size_t max_events);
 
     void* m_events;
+    size_t m_events_capacity;
     event_data m_data;
 };
 
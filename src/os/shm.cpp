@@ -0,0 +1,351 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <cstring>
+#include <cstddef>
+#include <string>
+
+#include "internal_except.h"
+#include "shm.h"
+
+namespace obsr::os {
+
+static constexpr size_t cache_line_size = 64;
+static constexpr size_t ring_capacity = 256 * 1024;
+static constexpr size_t ring_mask = ring_capacity - 1;
+static constexpr size_t stream_descriptors_count = 3;
+static constexpr auto connect_timeout_sec = 1;
+
+static_assert((ring_capacity & ring_mask) == 0, "ring capacity must be a power of 2");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be lock-free");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared atomics must be lock-free");
+
+// single producer, single consumer. positions only ever grow, the index into the data
+// is the position masked by the capacity.
+struct shm_stream::ring {
+    alignas(cache_line_size) std::atomic<uint64_t> write_pos;
+    alignas(cache_line_size) std::atomic<uint64_t> read_pos;
+    alignas(cache_line_size) std::atomic<uint32_t> reader_waiting;
+    std::atomic<uint32_t> writer_waiting;
+    alignas(cache_line_size) uint8_t data[ring_capacity];
+};
+
+// the first ring carries data from the client to the server, the second from the server to the client
+static constexpr size_t region_size = sizeof(shm_stream::ring) * 2;
+
+static void close_descriptors(const descriptor* descriptors, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (descriptors[i] >= 0) {
+            ::close(descriptors[i]);
+        }
+    }
+}
+
+static socklen_t make_address(uint16_t port, sockaddr_un& addr) {
+    // abstract address, which does not exist in the filesystem and goes away with the listener
+    const auto name = std::string("obsr.shm.") + std::to_string(port);
+
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    addr.sun_path[0] = '\0';
+    std::memcpy(addr.sun_path + 1, name.c_str(), name.size());
+
+    return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + name.size());
+}
+
+static descriptor open_listener(uint16_t port) {
+    auto fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw io_exception(errno);
+    }
+
+    sockaddr_un addr{};
+    const auto addr_len = make_address(port, addr);
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), addr_len) || ::listen(fd, SOMAXCONN)) {
+        const auto error_code = errno;
+        ::close(fd);
+        throw io_exception(error_code);
+    }
+
+    return fd;
+}
+
+static void* map_region(descriptor memory_fd) {
+    auto memory = ::mmap(nullptr, region_size, PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0);
+    if (memory == MAP_FAILED) {
+        throw io_exception(errno);
+    }
+
+    return memory;
+}
+
+static void copy_out(const shm_stream::ring& ring, uint64_t position, uint8_t* buffer, size_t size) {
+    const auto offset = position & ring_mask;
+    const auto first = std::min(size, ring_capacity - offset);
+    std::memcpy(buffer, ring.data + offset, first);
+    std::memcpy(buffer + first, ring.data, size - first);
+}
+
+static void copy_in(shm_stream::ring& ring, uint64_t position, const uint8_t* buffer, size_t size) {
+    const auto offset = position & ring_mask;
+    const auto first = std::min(size, ring_capacity - offset);
+    std::memcpy(ring.data + offset, buffer, first);
+    std::memcpy(ring.data, buffer + first, size - first);
+}
+
+shm_stream::shm_stream(descriptor wait_descriptor,
+                       descriptor signal_descriptor,
+                       std::shared_ptr<resource> link,
+                       void* memory,
+                       ring* read_ring,
+                       ring* write_ring)
+    : resource(wait_descriptor)
+    , m_peer_signal(signal_descriptor)
+    , m_link(std::move(link))
+    , m_memory(memory)
+    , m_read_ring(read_ring)
+    , m_write_ring(write_ring)
+{}
+
+shm_stream::~shm_stream() {
+    ::munmap(m_memory, region_size);
+}
+
+std::shared_ptr<resource> shm_stream::get_link() const {
+    return m_link;
+}
+
+size_t shm_stream::read(uint8_t* buffer, size_t buffer_size) {
+    throw_if_closed();
+
+    if (buffer_size == 0) {
+        return 0;
+    }
+
+    auto& ring = *m_read_ring;
+    const auto read_pos = ring.read_pos.load(std::memory_order_relaxed);
+    auto write_pos = ring.write_pos.load(std::memory_order_acquire);
+    if (write_pos == read_pos) {
+        // about to wait for more data. the flag is raised before checking again, so a write
+        // we have missed is sure to see it and signal us.
+        ring.reader_waiting.store(1, std::memory_order_seq_cst);
+        write_pos = ring.write_pos.load(std::memory_order_seq_cst);
+        if (write_pos == read_pos) {
+            return 0;
+        }
+    }
+
+    const auto size = std::min({buffer_size,
+                                static_cast<size_t>(write_pos - read_pos),
+                                ring_capacity});
+    copy_out(ring, read_pos, buffer, size);
+    ring.read_pos.store(read_pos + size, std::memory_order_seq_cst);
+
+    if (ring.writer_waiting.load(std::memory_order_seq_cst) != 0 && ring.writer_waiting.exchange(0) != 0) {
+        signal_peer();
+    }
+
+    return size;
+}
+
+size_t shm_stream::write(const uint8_t* buffer, size_t size) {
+    io_vector vector{buffer, size};
+    return writev(&vector, 1);
+}
+
+size_t shm_stream::writev(const io_vector* vectors, size_t count) {
+    throw_if_closed();
+
+    auto& ring = *m_write_ring;
+    auto write_pos = ring.write_pos.load(std::memory_order_relaxed);
+
+    size_t written = 0;
+    bool waiting = false;
+    bool full = false;
+    for (size_t i = 0; i < count && !full; ++i) {
+        size_t offset = 0;
+        while (offset < vectors[i].size) {
+            const auto used = static_cast<size_t>(write_pos - ring.read_pos.load(std::memory_order_seq_cst));
+            const auto space = ring_capacity - std::min(used, ring_capacity);
+            if (space == 0) {
+                if (waiting) {
+                    // still full, the reader will signal us once it makes room
+                    full = true;
+                    break;
+                }
+
+                // same as the reader, raise the flag and then check again
+                ring.writer_waiting.store(1, std::memory_order_seq_cst);
+                waiting = true;
+                continue;
+            }
+
+            const auto size = std::min(space, vectors[i].size - offset);
+            copy_in(ring, write_pos, vectors[i].data + offset, size);
+            write_pos += size;
+            offset += size;
+            written += size;
+        }
+    }
+
+    if (written > 0) {
+        ring.write_pos.store(write_pos, std::memory_order_seq_cst);
+
+        if (ring.reader_waiting.load(std::memory_order_seq_cst) != 0 && ring.reader_waiting.exchange(0) != 0) {
+            signal_peer();
+        }
+    }
+
+    return written;
+}
+
+std::shared_ptr<shm_stream> shm_stream::connect(uint16_t port) {
+    auto fd = ::socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        throw io_exception(errno);
+    }
+    auto link = std::make_shared<resource>(fd);
+
+    sockaddr_un addr{};
+    const auto addr_len = make_address(port, addr);
+
+    timeval timeout{connect_timeout_sec, 0};
+    if (::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) ||
+        ::connect(fd, reinterpret_cast<sockaddr*>(&addr), addr_len)) {
+        throw io_exception(errno);
+    }
+
+    // the server answers right away with the descriptors of the stream
+    uint8_t data;
+    iovec vector{&data, sizeof(data)};
+    alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(descriptor) * stream_descriptors_count)];
+
+    msghdr message{};
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    const auto result = ::recvmsg(fd, &message, MSG_CMSG_CLOEXEC);
+    if (result < 0) {
+        throw io_exception(errno);
+    } else if (result == 0) {
+        throw eof_exception();
+    }
+
+    descriptor descriptors[stream_descriptors_count] = {-1, -1, -1};
+    auto cmsg = CMSG_FIRSTHDR(&message);
+    if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+        throw io_exception(EPROTO);
+    }
+
+    const auto received = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(descriptor);
+    std::memcpy(descriptors, CMSG_DATA(cmsg), std::min(received, stream_descriptors_count) * sizeof(descriptor));
+    if (received != stream_descriptors_count || (message.msg_flags & MSG_CTRUNC) != 0) {
+        close_descriptors(descriptors, stream_descriptors_count);
+        throw io_exception(EPROTO);
+    }
+
+    const auto [memory_fd, wait_fd, signal_fd] = descriptors;
+
+    void* memory;
+    try {
+        memory = map_region(memory_fd);
+        ::close(memory_fd);
+    } catch (...) {
+        close_descriptors(descriptors, stream_descriptors_count);
+        throw;
+    }
+
+    // the link is only watched for the peer going away, so it must not block the looper
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    auto rings = static_cast<ring*>(memory);
+    return std::shared_ptr<shm_stream>(new shm_stream(wait_fd, signal_fd, std::move(link), memory, &rings[1], &rings[0]));
+}
+
+void shm_stream::signal_peer() {
+    ::eventfd_write(m_peer_signal.get_descriptor(), 1);
+}
+
+shm_listener::shm_listener(uint16_t port)
+    : resource(open_listener(port))
+{}
+
+std::shared_ptr<shm_stream> shm_listener::accept() {
+    throw_if_closed();
+
+    const auto fd = ::accept4(get_descriptor(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        const auto error_code = errno;
+        if (error_code == EAGAIN || error_code == EWOULDBLOCK || error_code == ECONNABORTED) {
+            return nullptr;
+        }
+
+        throw io_exception(error_code);
+    }
+    auto link = std::make_shared<resource>(fd);
+
+    // memory, the eventfd the client waits on, the eventfd the server waits on
+    descriptor descriptors[stream_descriptors_count] = {
+            ::memfd_create("obsr-shm", MFD_CLOEXEC),
+            ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC),
+            ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)
+    };
+    const auto [memory_fd, client_wait_fd, server_wait_fd] = descriptors;
+
+    void* memory = nullptr;
+    try {
+        if (memory_fd < 0 || client_wait_fd < 0 || server_wait_fd < 0 ||
+            ::ftruncate(memory_fd, region_size)) {
+            throw io_exception(errno);
+        }
+
+        memory = map_region(memory_fd);
+        auto rings = static_cast<shm_stream::ring*>(memory);
+        for (auto i = 0; i < 2; ++i) {
+            auto ring = new (&rings[i]) shm_stream::ring;
+            // readers have not looked at the rings yet, so the first write must wake them
+            ring->reader_waiting.store(1);
+        }
+
+        uint8_t data = 0;
+        iovec vector{&data, sizeof(data)};
+        alignas(cmsghdr) uint8_t control[CMSG_SPACE(sizeof(descriptors))] = {};
+
+        msghdr message{};
+        message.msg_iov = &vector;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        auto cmsg = CMSG_FIRSTHDR(&message);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(descriptors));
+        std::memcpy(CMSG_DATA(cmsg), descriptors, sizeof(descriptors));
+
+        // the socket was just created, so there is space for the message
+        if (::sendmsg(fd, &message, MSG_NOSIGNAL) < 0) {
+            throw io_exception(errno);
+        }
+    } catch (...) {
+        if (memory != nullptr) {
+            ::munmap(memory, region_size);
+        }
+        close_descriptors(descriptors, stream_descriptors_count);
+        throw;
+    }
+
+    // the memory stays mapped after closing
+    ::close(memory_fd);
+
+    auto rings = static_cast<shm_stream::ring*>(memory);
+    return std::shared_ptr<shm_stream>(new shm_stream(server_wait_fd, client_wait_fd, std::move(link), memory, &rings[0], &rings[1]));
+}
+
+}
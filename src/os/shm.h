@@ -0,0 +1,60 @@
+#pragma once
+
+#include <memory>
+#include <atomic>
+
+#include "os/io.h"
+
+namespace obsr::os {
+
+// byte stream between two processes on the same host, over a pair of rings in shared memory.
+// the descriptor of the stream is an eventfd signalled by the peer whenever it writes data
+// for us or makes room for our data. it is always writable, so when registered edge-triggered
+// each signal reports both in and out.
+// the link is the socket through which the stream was set up. nothing is sent over it, but it
+// is kept open to detect the peer going away.
+class shm_stream : public resource, public stream {
+public:
+    struct ring;
+
+    ~shm_stream() override;
+
+    [[nodiscard]] std::shared_ptr<resource> get_link() const;
+
+    size_t read(uint8_t* buffer, size_t buffer_size) override;
+    size_t write(const uint8_t* buffer, size_t size) override;
+    size_t writev(const io_vector* vectors, size_t count) override;
+
+    // attaches to the stream offered by the server listening at the given port.
+    static std::shared_ptr<shm_stream> connect(uint16_t port);
+
+private:
+    friend class shm_listener;
+
+    shm_stream(descriptor wait_descriptor,
+               descriptor signal_descriptor,
+               std::shared_ptr<resource> link,
+               void* memory,
+               ring* read_ring,
+               ring* write_ring);
+
+    void signal_peer();
+
+    resource m_peer_signal;
+    std::shared_ptr<resource> m_link;
+    void* m_memory;
+    ring* m_read_ring;
+    ring* m_write_ring;
+};
+
+// accepts same-host peers which wish to communicate over shared memory. the listener is found
+// by peers through the port, so there may be only one listener per port on the host.
+class shm_listener : public resource {
+public:
+    explicit shm_listener(uint16_t port);
+
+    // non-blocking. returns nullptr if there are no more pending peers.
+    std::shared_ptr<shm_stream> accept();
+};
+
+}
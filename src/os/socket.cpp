@@ -1,10 +1,16 @@
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
 #include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <fcntl.h>
 
 #include <cstring>
+#include <cstddef>
 
 #include "util/time.h"
 #include "internal_except.h"
@@ -13,25 +19,49 @@
 
 namespace obsr::os {
 
+static constexpr size_t max_io_vectors = 64;
+
+static socklen_t make_local_address(std::string_view path, sockaddr_un& addr) {
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        throw illegal_argument_exception("bad unix socket path");
+    }
+
+    std::memcpy(addr.sun_path, path.data(), path.size());
+    return static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size() + 1);
+}
+
 struct {
     int level;
     int opt;
 } sockopt_natives[] = {
         {SOL_SOCKET, SO_REUSEPORT},
-        {SOL_SOCKET, SO_KEEPALIVE}
+        {SOL_SOCKET, SO_KEEPALIVE},
+        {IPPROTO_TCP, TCP_NODELAY},
+        {IPPROTO_TCP, TCP_QUICKACK},
+        {SOL_SOCKET, SO_SNDBUF},
+        {SOL_SOCKET, SO_RCVBUF},
+        {SOL_SOCKET, SO_BUSY_POLL}
 };
 
-base_socket::base_socket()
-    : resource(open_socket())
+base_socket::base_socket(socket_domain domain)
+    : resource(open_socket(domain))
+    , m_domain(domain)
     , m_disabled(false)
     , m_is_blocking(true) {
     configure_blocking(true);
 }
 
-base_socket::base_socket(descriptor socket_descriptor)
+base_socket::base_socket(descriptor socket_descriptor, bool is_blocking, socket_domain domain)
     : resource(socket_descriptor)
+    , m_domain(domain)
     , m_disabled(false)
-    , m_is_blocking(true) {
+    , m_is_blocking(is_blocking) {
+}
+
+socket_domain base_socket::get_domain() const {
+    return m_domain;
 }
 
 void base_socket::setoption(sockopt_type opt, void* value, size_t size) {
@@ -48,6 +78,10 @@ void base_socket::setoption(sockopt_type opt, void* value, size_t size) {
 void base_socket::configure_blocking(bool blocking) {
     throw_if_disabled();
 
+    if (blocking == m_is_blocking) {
+        return;
+    }
+
     auto fd = this->get_descriptor();
     auto flags = fcntl(fd, F_GETFL, 0);
     if (flags == -1) {
@@ -90,6 +124,18 @@ void base_socket::bind(uint16_t port) {
     }
 }
 
+void base_socket::bind_local(std::string_view path) {
+    throw_if_closed();
+    throw_if_disabled();
+
+    sockaddr_un addr{};
+    const auto addr_len = make_local_address(path, addr);
+
+    if (::bind(get_descriptor(), reinterpret_cast<sockaddr*>(&addr), addr_len)) {
+        handle_call_error();
+    }
+}
+
 base_socket::error_code_t base_socket::get_call_error() const {
     return errno;
 }
@@ -133,8 +179,9 @@ void base_socket::throw_if_disabled() {
     }
 }
 
-int base_socket::open_socket() {
-    int m_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+int base_socket::open_socket(socket_domain domain) {
+    const auto family = domain == socket_domain::local ? AF_UNIX : AF_INET;
+    int m_fd = ::socket(family, SOCK_STREAM, 0);
     if (m_fd < 0) {
         throw io_exception(errno);
     }
@@ -142,10 +189,30 @@ int base_socket::open_socket() {
     return m_fd;
 }
 
-server_socket::server_socket()
-    : base_socket()
+server_socket::server_socket(socket_domain domain)
+    : base_socket(domain)
+    , m_local_path()
 {}
 
+server_socket::~server_socket() {
+    if (!m_local_path.empty()) {
+        ::unlink(m_local_path.c_str());
+    }
+}
+
+void server_socket::bind_local(std::string_view path) {
+    std::string path_c(path);
+
+    // only ever remove sockets, anything else at the path is left for bind to fail on
+    struct stat path_stat{};
+    if (::stat(path_c.c_str(), &path_stat) == 0 && S_ISSOCK(path_stat.st_mode)) {
+        ::unlink(path_c.c_str());
+    }
+
+    base_socket::bind_local(path);
+    m_local_path = std::move(path_c);
+}
+
 void server_socket::listen(size_t backlog_size) {
     throw_if_closed();
     throw_if_disabled();
@@ -159,24 +226,32 @@ std::unique_ptr<socket> server_socket::accept() {
     throw_if_closed();
     throw_if_disabled();
 
-    sockaddr_in addr{};
+    sockaddr_storage addr{};
     socklen_t addr_len = sizeof(addr);
 
-    const auto new_fd = ::accept(get_descriptor(), reinterpret_cast<sockaddr*>(&addr), &addr_len);
+    const auto new_fd = ::accept4(get_descriptor(), reinterpret_cast<sockaddr*>(&addr), &addr_len,
+                                  SOCK_NONBLOCK | SOCK_CLOEXEC);
     if (new_fd < 0) {
-        handle_call_error();
+        const auto error_code = get_call_error();
+        if ((error_code == EAGAIN || error_code == EWOULDBLOCK || error_code == ECONNABORTED) && !is_blocking()) {
+            // no more pending connections, or the pending connection was reset before
+            // we got to it.
+            return nullptr;
+        } else {
+            handle_call_error(error_code);
+        }
     }
 
-    return std::make_unique<socket>(new_fd);
+    return std::make_unique<socket>(new_fd, false, get_domain());
 }
 
-socket::socket()
-    : base_socket()
+socket::socket(socket_domain domain)
+    : base_socket(domain)
     , m_waiting_connection(false)
 {}
 
-socket::socket(descriptor socket_descriptor)
-    : base_socket(socket_descriptor)
+socket::socket(descriptor socket_descriptor, bool is_blocking, socket_domain domain)
+    : base_socket(socket_descriptor, is_blocking, domain)
     , m_waiting_connection(false)
 {}
 
@@ -208,6 +283,24 @@ void socket::connect(std::string_view ip, uint16_t port) {
     }
 }
 
+void socket::connect_local(std::string_view path) {
+    throw_if_closed();
+    throw_if_disabled();
+
+    sockaddr_un addr{};
+    const auto addr_len = make_local_address(path, addr);
+
+    if (::connect(get_descriptor(), reinterpret_cast<sockaddr*>(&addr), addr_len)) {
+        const auto error_code = get_call_error();
+        if (error_code == EINPROGRESS && !is_blocking()) {
+            m_waiting_connection = true;
+            disable();
+        } else {
+            handle_call_error(error_code);
+        }
+    }
+}
+
 void socket::finalize_connect() {
     throw_if_closed();
 
@@ -259,4 +352,143 @@ size_t socket::write(const uint8_t* buffer, size_t size) {
     return result;
 }
 
+size_t socket::writev(const io_vector* vectors, size_t count) {
+    throw_if_closed();
+    throw_if_disabled();
+
+    if (count > max_io_vectors) {
+        count = max_io_vectors;
+    }
+
+    iovec native_vectors[max_io_vectors];
+    for (size_t i = 0; i < count; ++i) {
+        native_vectors[i].iov_base = const_cast<uint8_t*>(vectors[i].data);
+        native_vectors[i].iov_len = vectors[i].size;
+    }
+
+    msghdr message{};
+    message.msg_iov = native_vectors;
+    message.msg_iovlen = count;
+
+    const auto result = ::sendmsg(get_descriptor(), &message, MSG_NOSIGNAL);
+    if (result < 0) {
+        const auto error_code = get_call_error();
+        if ((error_code == EAGAIN || error_code == EWOULDBLOCK) && !is_blocking()) {
+            // socket send buffer is full, try again when it is writable
+            return 0;
+        } else {
+            handle_call_error(error_code);
+        }
+    }
+
+    return result;
+}
+
+static int open_datagram_socket() {
+    int fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        throw io_exception(errno);
+    }
+
+    return fd;
+}
+
+datagram_socket::datagram_socket()
+    : base_socket(open_datagram_socket())
+{}
+
+void datagram_socket::join_multicast_group(std::string_view group) {
+    throw_if_closed();
+    throw_if_disabled();
+
+    std::string group_c(group);
+
+    ip_mreq request{};
+    if (::inet_pton(AF_INET, group_c.c_str(), &request.imr_multiaddr) != 1) {
+        throw illegal_argument_exception("bad multicast group address");
+    }
+    request.imr_interface.s_addr = htonl(INADDR_ANY);
+
+    if (::setsockopt(get_descriptor(), IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request))) {
+        handle_call_error();
+    }
+}
+
+void datagram_socket::configure_multicast(uint8_t ttl, bool loop) {
+    throw_if_closed();
+    throw_if_disabled();
+
+    const auto loop_value = static_cast<uint8_t>(loop);
+    if (::setsockopt(get_descriptor(), IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) ||
+        ::setsockopt(get_descriptor(), IPPROTO_IP, IP_MULTICAST_LOOP, &loop_value, sizeof(loop_value))) {
+        handle_call_error();
+    }
+}
+
+void datagram_socket::set_destination(std::string_view ip, uint16_t port) {
+    throw_if_closed();
+    throw_if_disabled();
+
+    std::string ip_c(ip);
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = ::htons(port);
+    if (::inet_pton(AF_INET, ip_c.c_str(), &addr.sin_addr) != 1) {
+        throw illegal_argument_exception("bad destination address");
+    }
+
+    if (::connect(get_descriptor(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr))) {
+        handle_call_error();
+    }
+}
+
+size_t datagram_socket::send(const io_vector* vectors, size_t count) {
+    throw_if_closed();
+    throw_if_disabled();
+
+    if (count > max_io_vectors) {
+        count = max_io_vectors;
+    }
+
+    iovec native_vectors[max_io_vectors];
+    for (size_t i = 0; i < count; ++i) {
+        native_vectors[i].iov_base = const_cast<uint8_t*>(vectors[i].data);
+        native_vectors[i].iov_len = vectors[i].size;
+    }
+
+    msghdr message{};
+    message.msg_iov = native_vectors;
+    message.msg_iovlen = count;
+
+    const auto result = ::sendmsg(get_descriptor(), &message, MSG_NOSIGNAL);
+    if (result < 0) {
+        const auto error_code = get_call_error();
+        if ((error_code == EAGAIN || error_code == EWOULDBLOCK) && !is_blocking()) {
+            return 0;
+        } else {
+            handle_call_error(error_code);
+        }
+    }
+
+    return result;
+}
+
+size_t datagram_socket::receive(uint8_t* buffer, size_t buffer_size) {
+    throw_if_closed();
+    throw_if_disabled();
+
+    const auto result = ::recv(get_descriptor(), buffer, buffer_size, 0);
+    if (result < 0) {
+        const auto error_code = get_call_error();
+        if ((error_code == EAGAIN || error_code == EWOULDBLOCK) && !is_blocking()) {
+            return 0;
+        } else {
+            handle_call_error(error_code);
+        }
+    }
+
+    return result;
+}
+
 }
@@ -9,7 +9,12 @@ namespace obsr::os {
 
 enum class sockopt_type : size_t {
     reuse_port,
-    keep_alive
+    keep_alive,
+    no_delay,
+    quick_ack,
+    send_buffer_size,
+    receive_buffer_size,
+    busy_poll
 };
 
 template<sockopt_type opt_, typename type_>
@@ -27,13 +32,31 @@ struct _sockopt_hack : public std::false_type {};
 
 define_sockopt(reuseport, sockopt_type::reuse_port, bool);
 define_sockopt(keepalive, sockopt_type::keep_alive, bool);
+define_sockopt(nodelay, sockopt_type::no_delay, bool);
+// not sticky, the kernel may return to delaying acks after it is set
+define_sockopt(quickack, sockopt_type::quick_ack, bool);
+define_sockopt(sndbuf, sockopt_type::send_buffer_size, int);
+define_sockopt(rcvbuf, sockopt_type::receive_buffer_size, int);
+// in microseconds
+define_sockopt(busypoll, sockopt_type::busy_poll, int);
+
+enum class socket_domain {
+    // tcp over ipv4
+    inet,
+    // unix domain stream socket, addressed by a filesystem path
+    local
+};
 
 class base_socket : public resource {
 public:
     using error_code_t = int;
 
-    base_socket();
-    explicit base_socket(descriptor socket_descriptor);
+    explicit base_socket(socket_domain domain = socket_domain::inet);
+    base_socket(descriptor socket_descriptor,
+                bool is_blocking = true,
+                socket_domain domain = socket_domain::inet);
+
+    [[nodiscard]] socket_domain get_domain() const;
 
     void setoption(sockopt_type opt, void* value, size_t size);
 
@@ -55,6 +78,7 @@ public:
 
     void bind(const std::string& ip, uint16_t port);
     void bind(uint16_t port);
+    void bind_local(std::string_view path);
 
     error_code_t get_internal_error();
 
@@ -82,7 +106,8 @@ protected:
 
     void throw_if_disabled();
 private:
-    static int open_socket();
+    static int open_socket(socket_domain domain);
+    socket_domain m_domain;
     bool m_is_blocking;
     bool m_disabled;
 };
@@ -92,26 +117,58 @@ class socket;
 
 class server_socket : public base_socket {
 public:
-    server_socket();
+    explicit server_socket(socket_domain domain = socket_domain::inet);
+    ~server_socket() override;
 
+    // a stale socket file left at the path by a previous listener is replaced.
+    // the file is removed once the server socket is destroyed.
+    void bind_local(std::string_view path);
     void listen(size_t backlog_size);
+    // accepted sockets are non-blocking. in non-blocking mode, returns nullptr
+    // if there are no more pending connections.
     std::unique_ptr<socket> accept();
+
+private:
+    std::string m_local_path;
 };
 
-class socket : public base_socket, public readable, public writable {
+class socket : public base_socket, public stream {
 public:
-    socket();
-    explicit socket(descriptor socket_descriptor);
+    explicit socket(socket_domain domain = socket_domain::inet);
+    socket(descriptor socket_descriptor,
+           bool is_blocking = true,
+           socket_domain domain = socket_domain::inet);
 
     bool is_connecting() const;
     void connect(std::string_view ip, uint16_t port);
+    void connect_local(std::string_view path);
     void finalize_connect();
 
     size_t read(uint8_t* buffer, size_t buffer_size) override;
     size_t write(const uint8_t* buffer, size_t size) override;
+    size_t writev(const io_vector* vectors, size_t count) override;
 
 private:
     bool m_waiting_connection;
 };
 
+// udp over ipv4
+class datagram_socket : public base_socket {
+public:
+    datagram_socket();
+
+    // receive datagrams sent to the group, on the default interface for multicast
+    void join_multicast_group(std::string_view group);
+    void configure_multicast(uint8_t ttl, bool loop);
+
+    // datagrams are sent to the destination, which may be a multicast group
+    void set_destination(std::string_view ip, uint16_t port);
+    // sends the buffers together as a single datagram. returns 0 if the datagram could not be
+    // sent at the moment in non-blocking mode.
+    size_t send(const io_vector* vectors, size_t count);
+    // receives a single datagram, truncated to the buffer size. returns 0 if there are no
+    // pending datagrams in non-blocking mode.
+    size_t receive(uint8_t* buffer, size_t buffer_size);
+};
+
 }
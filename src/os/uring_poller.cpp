@@ -0,0 +1,378 @@
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "internal_except.h"
+#include "uring_poller.h"
+
+namespace obsr::os {
+
+static constexpr unsigned ring_entries = 256;
+
+struct uring_poller::ring {
+    io_uring_params params;
+
+    void* sq_ptr;
+    size_t sq_size;
+    void* cq_ptr;
+    size_t cq_size;
+    io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    io_uring_cqe* cqes;
+};
+
+static descriptor setup(io_uring_params& params) {
+    ::memset(&params, 0, sizeof(params));
+
+    const auto fd = static_cast<descriptor>(::syscall(__NR_io_uring_setup, ring_entries, &params));
+    if (fd < 0) {
+        throw io_exception(errno);
+    }
+
+    return fd;
+}
+
+static int enter(descriptor fd, unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, size_t arg_size) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size));
+}
+
+static uint32_t events_to_native(events::event_types events) {
+    uint32_t r_events = 0;
+    if ((events & events::event_type::event_in) != 0) {
+        r_events |= EPOLLIN;
+    }
+    if ((events & events::event_type::event_out) != 0) {
+        r_events |= EPOLLOUT;
+    }
+    if ((events & events::event_type::event_error) != 0) {
+        r_events |= EPOLLERR;
+    }
+    if ((events & events::event_type::event_hung) != 0) {
+        r_events |= EPOLLHUP;
+    }
+    if ((events & events::event_type::event_edge) != 0) {
+        r_events |= EPOLLET;
+    }
+
+    return r_events;
+}
+
+static events::event_types native_to_events(uint32_t events) {
+    events::event_types r_events = 0;
+    if ((events & EPOLLIN) != 0) {
+        r_events |= events::event_type::event_in;
+    }
+    if ((events & EPOLLOUT) != 0) {
+        r_events |= events::event_type::event_out;
+    }
+    if ((events & EPOLLERR) != 0) {
+        r_events |= events::event_type::event_error;
+    }
+    if ((events & EPOLLHUP) != 0) {
+        r_events |= events::event_type::event_hung;
+    }
+
+    return r_events;
+}
+
+uring_poller::uring_poller()
+    : uring_poller(std::make_unique<ring>())
+{}
+
+uring_poller::uring_poller(std::unique_ptr<ring>&& ring)
+    : resource(setup(ring->params))
+    , m_mutex()
+    , m_ring(std::move(ring))
+    , m_registrations()
+    , m_removed()
+    , m_events()
+    , m_data(m_events) {
+    auto& params = m_ring->params;
+    if ((params.features & IORING_FEAT_SINGLE_MMAP) == 0 ||
+        (params.features & IORING_FEAT_EXT_ARG) == 0) {
+        throw io_exception(ENOSYS);
+    }
+
+    // with single mmap, both rings share the same mapping
+    m_ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    m_ring->sq_size = std::max(m_ring->sq_size, m_ring->cq_size);
+    m_ring->cq_size = m_ring->sq_size;
+
+    m_ring->sq_ptr = ::mmap(nullptr, m_ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            get_descriptor(), IORING_OFF_SQ_RING);
+    if (m_ring->sq_ptr == MAP_FAILED) {
+        throw io_exception(errno);
+    }
+    m_ring->cq_ptr = m_ring->sq_ptr;
+
+    m_ring->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    auto sqes = ::mmap(nullptr, m_ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       get_descriptor(), IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        const auto error = errno;
+        ::munmap(m_ring->sq_ptr, m_ring->sq_size);
+        throw io_exception(error);
+    }
+    m_ring->sqes = reinterpret_cast<io_uring_sqe*>(sqes);
+
+    auto sq_ptr = reinterpret_cast<uint8_t*>(m_ring->sq_ptr);
+    m_ring->sq_head = reinterpret_cast<unsigned*>(sq_ptr + params.sq_off.head);
+    m_ring->sq_tail = reinterpret_cast<unsigned*>(sq_ptr + params.sq_off.tail);
+    m_ring->sq_mask = reinterpret_cast<unsigned*>(sq_ptr + params.sq_off.ring_mask);
+    m_ring->sq_array = reinterpret_cast<unsigned*>(sq_ptr + params.sq_off.array);
+
+    auto cq_ptr = reinterpret_cast<uint8_t*>(m_ring->cq_ptr);
+    m_ring->cq_head = reinterpret_cast<unsigned*>(cq_ptr + params.cq_off.head);
+    m_ring->cq_tail = reinterpret_cast<unsigned*>(cq_ptr + params.cq_off.tail);
+    m_ring->cq_mask = reinterpret_cast<unsigned*>(cq_ptr + params.cq_off.ring_mask);
+    m_ring->cqes = reinterpret_cast<io_uring_cqe*>(cq_ptr + params.cq_off.cqes);
+}
+
+uring_poller::~uring_poller() {
+    // closing the ring (done by resource) cancels anything still in flight
+    ::munmap(m_ring->sqes, m_ring->sqes_size);
+    ::munmap(m_ring->sq_ptr, m_ring->sq_size);
+}
+
+void uring_poller::add(resource& resource, events::event_types events, void* context) {
+    std::unique_lock lock(m_mutex);
+
+    const auto descriptor = resource.get_descriptor();
+
+    auto it = m_registrations.find(descriptor);
+    if (it != m_registrations.end()) {
+        throw io_exception(EEXIST);
+    }
+
+    register_new(descriptor, events, context);
+}
+
+void uring_poller::register_new(descriptor descriptor, events::event_types events, void* context) {
+    auto registration = std::make_unique<uring_poller::registration>();
+    registration->fd = descriptor;
+    registration->events = events;
+    registration->context = context;
+    registration->in_flight = 0;
+    registration->removed = false;
+
+    queue_poll_add(registration.get());
+    m_registrations.emplace(descriptor, std::move(registration));
+}
+
+void uring_poller::set(resource& resource, events::event_types events, void* context) {
+    std::unique_lock lock(m_mutex);
+
+    const auto descriptor = resource.get_descriptor();
+
+    auto it = m_registrations.find(descriptor);
+    if (it == m_registrations.end()) {
+        throw io_exception(ENOENT);
+    }
+
+    if (it->second->events == events && it->second->context == context) {
+        return;
+    }
+
+    // replace the poll, the cancelled one is ignored when it completes
+    release(std::move(it->second));
+    m_registrations.erase(it);
+
+    register_new(descriptor, events, context);
+}
+
+void uring_poller::remove(resource& resource) {
+    std::unique_lock lock(m_mutex);
+
+    const auto descriptor = resource.get_descriptor();
+
+    auto it = m_registrations.find(descriptor);
+    if (it == m_registrations.end()) {
+        throw io_exception(ENOENT);
+    }
+
+    release(std::move(it->second));
+    m_registrations.erase(it);
+}
+
+events::polled_events uring_poller::poll(size_t max_events, std::chrono::milliseconds timeout) {
+    std::unique_lock lock(m_mutex);
+
+    if (m_events.size() < max_events) {
+        m_events.resize(max_events);
+    }
+
+    m_data.set_count(0);
+
+    // events left from the previous poll are handled before waiting
+    auto count = reap(0, max_events);
+    if (count > 0) {
+        timeout = std::chrono::milliseconds(0);
+    }
+
+    __kernel_timespec ts{};
+    ts.tv_sec = timeout.count() / 1000;
+    ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+
+    io_uring_getevents_arg arg{};
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+    const auto to_submit = *m_ring->sq_tail - __atomic_load_n(m_ring->sq_head, __ATOMIC_ACQUIRE);
+    const auto min_complete = count > 0 ? 0 : 1;
+
+    lock.unlock();
+    const auto result = enter(get_descriptor(), to_submit, min_complete,
+                              IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                              &arg, sizeof(arg));
+    if (result < 0) {
+        const auto error = errno;
+        if (error != ETIME && error != EINTR && error != EBUSY && error != EAGAIN) {
+            throw io_exception(error);
+        }
+    }
+    lock.lock();
+
+    count = reap(count, max_events);
+    m_data.set_count(count);
+
+    return events::polled_events{&m_data};
+}
+
+void uring_poller::queue_poll_add(registration* registration) {
+    auto tail = *m_ring->sq_tail;
+    if (tail - __atomic_load_n(m_ring->sq_head, __ATOMIC_ACQUIRE) >= m_ring->params.sq_entries) {
+        // ring is full, submit what we have to make room
+        if (enter(get_descriptor(), tail - *m_ring->sq_head, 0, 0, nullptr, 0) < 0) {
+            throw io_exception(errno);
+        }
+    }
+
+    const auto index = tail & *m_ring->sq_mask;
+    auto sqe = &m_ring->sqes[index];
+    ::memset(sqe, 0, sizeof(*sqe));
+
+    sqe->fd = registration->fd;
+    sqe->user_data = reinterpret_cast<uint64_t>(registration);
+    sqe->poll32_events = events_to_native(registration->events);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    if ((registration->events & events::event_edge) != 0) {
+        // edge-triggered polls stay armed, others are re-armed after each event
+        sqe->len = IORING_POLL_ADD_MULTI;
+    }
+
+    m_ring->sq_array[index] = index;
+    __atomic_store_n(m_ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    registration->in_flight++;
+}
+
+void uring_poller::queue_poll_remove(registration* registration) {
+    auto tail = *m_ring->sq_tail;
+    if (tail - __atomic_load_n(m_ring->sq_head, __ATOMIC_ACQUIRE) >= m_ring->params.sq_entries) {
+        if (enter(get_descriptor(), tail - *m_ring->sq_head, 0, 0, nullptr, 0) < 0) {
+            throw io_exception(errno);
+        }
+    }
+
+    const auto index = tail & *m_ring->sq_mask;
+    auto sqe = &m_ring->sqes[index];
+    ::memset(sqe, 0, sizeof(*sqe));
+
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(registration);
+    // completion of the removal itself is of no interest
+    sqe->user_data = 0;
+
+    m_ring->sq_array[index] = index;
+    __atomic_store_n(m_ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+void uring_poller::release(std::unique_ptr<registration>&& registration) {
+    registration->removed = true;
+    if (registration->in_flight < 1) {
+        return;
+    }
+
+    queue_poll_remove(registration.get());
+
+    auto ptr = registration.get();
+    m_removed.emplace(ptr, std::move(registration));
+}
+
+size_t uring_poller::reap(size_t count, size_t max_events) {
+    auto head = *m_ring->cq_head;
+    const auto tail = __atomic_load_n(m_ring->cq_tail, __ATOMIC_ACQUIRE);
+    while (head != tail && count < max_events) {
+        const auto& cqe = m_ring->cqes[head & *m_ring->cq_mask];
+        head++;
+
+        auto registration = reinterpret_cast<uring_poller::registration*>(cqe.user_data);
+        if (registration == nullptr) {
+            continue;
+        }
+
+        const auto finished = (cqe.flags & IORING_CQE_F_MORE) == 0;
+        if (finished) {
+            registration->in_flight--;
+        }
+
+        if (registration->removed) {
+            if (registration->in_flight < 1) {
+                m_removed.erase(registration);
+            }
+            continue;
+        }
+
+        if (cqe.res < 0) {
+            m_events[count++] = {registration->context, events::event_error};
+        } else {
+            m_events[count++] = {registration->context, native_to_events(static_cast<uint32_t>(cqe.res))};
+        }
+
+        if (finished) {
+            // level-triggered polls (and multishot polls the kernel stopped) must be armed again
+            queue_poll_add(registration);
+        }
+    }
+
+    __atomic_store_n(m_ring->cq_head, head, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+uring_poller::event_data::event_data(const std::vector<polled_event>& events)
+    : m_events(events)
+    , m_count(0)
+{}
+
+size_t uring_poller::event_data::count() const {
+    return m_count;
+}
+
+void uring_poller::event_data::set_count(size_t count) {
+    m_count = count;
+}
+
+void* uring_poller::event_data::get_context(size_t index) const {
+    return m_events[index].context;
+}
+
+events::event_types uring_poller::event_data::get_events(size_t index) const {
+    return m_events[index].events;
+}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "os/io.h"
+#include "events/events.h"
+
+namespace obsr::os {
+
+// poller over io_uring. changes to registrations are queued in the ring and submitted
+// together with the wait for new events, so each poll is a single system call.
+class uring_poller : resource, public events::poller {
+public:
+    uring_poller();
+    ~uring_poller() override;
+
+    void add(resource& resource, events::event_types events, void* context) override;
+    void set(resource& resource, events::event_types events, void* context) override;
+    void remove(resource& resource) override;
+
+    events::polled_events poll(size_t max_events, std::chrono::milliseconds timeout) override;
+
+private:
+    struct ring;
+    struct registration {
+        descriptor fd;
+        events::event_types events;
+        void* context;
+        // polls submitted for this registration which have not finished yet
+        size_t in_flight;
+        bool removed;
+    };
+    struct polled_event {
+        void* context;
+        events::event_types events;
+    };
+
+    explicit uring_poller(std::unique_ptr<ring>&& ring);
+
+    class event_data : public events::event_data {
+    public:
+        explicit event_data(const std::vector<polled_event>& events);
+
+        size_t count() const override;
+        void set_count(size_t count);
+
+        void* get_context(size_t index) const override;
+        events::event_types get_events(size_t index) const override;
+
+    private:
+        const std::vector<polled_event>& m_events;
+        size_t m_count;
+    };
+
+    void register_new(descriptor descriptor, events::event_types events, void* context);
+    void queue_poll_add(registration* registration);
+    void queue_poll_remove(registration* registration);
+    void release(std::unique_ptr<registration>&& registration);
+    // collects finished polls into the events buffer, starting at count. returns the new count.
+    size_t reap(size_t count, size_t max_events);
+
+    // the ring is not thread-safe, while resources may be removed from any thread
+    std::mutex m_mutex;
+    std::unique_ptr<ring> m_ring;
+    std::unordered_map<descriptor, std::unique_ptr<registration>> m_registrations;
+    // removed registrations are kept until the kernel is done with them
+    std::unordered_map<registration*, std::unique_ptr<registration>> m_removed;
+    std::vector<polled_event> m_events;
+    event_data m_data;
+};
+
+}
@@ -46,6 +46,7 @@ listener_storage::listener_storage(clock_ref  clock)
     , m_mutex()
     , m_has_events()
     , m_pending_events()
+    , m_dispatch_observer()
     , m_thread(&listener_storage::thread_main, this) {
 
 }
@@ -56,6 +57,12 @@ listener_storage::~listener_storage() {
     m_thread.join();
 }
 
+void listener_storage::set_dispatch_observer(dispatch_observer observer) {
+    std::unique_lock guard(m_mutex);
+
+    m_dispatch_observer = std::move(observer);
+}
+
 void listener_storage::on_clock_resync() {
     std::unique_lock guard(m_mutex);
 
@@ -110,6 +117,19 @@ void listener_storage::notify(event_type type, const std::string_view& path, obs
     notify(event);
 }
 
+void listener_storage::notify(std::vector<event>&& events) {
+    if (events.empty()) {
+        return;
+    }
+
+    std::unique_lock guard(m_mutex);
+
+    for (auto& event : events) {
+        m_pending_events.push_back(std::move(event));
+    }
+    m_has_events.notify_all();
+}
+
 void listener_storage::notify(const event& event) {
     std::unique_lock guard(m_mutex);
 
@@ -132,6 +152,10 @@ void listener_storage::thread_main() {
         while (!m_pending_events.empty()) {
             auto& event = m_pending_events.front();
 
+            if (m_dispatch_observer) {
+                m_dispatch_observer(event);
+            }
+
             for (auto [handle, listener] : m_listeners) {
                 lock.unlock();
                 try {
@@ -6,10 +6,12 @@
 #include <condition_variable>
 #include <deque>
 #include <atomic>
+#include <vector>
 
 #include "obsr_types.h"
 #include "obsr_internal.h"
 #include "util/handles.h"
+#include "util/time.h"
 
 
 namespace obsr::storage {
@@ -33,9 +35,16 @@ private:
 
 class listener_storage {
 public:
+    // called from the thread delivering events, with each event before it is delivered. events are
+    // held back meanwhile, so it should return quickly.
+    using dispatch_observer = std::function<void(const event&)>;
+
     listener_storage(clock_ref  clock);
     ~listener_storage();
 
+    // an empty observer stops the calls. once this returns, the previous observer is no longer called.
+    void set_dispatch_observer(dispatch_observer observer);
+
     void on_clock_resync();
 
     listener create_listener(const listener_callback& callback, const std::string_view& prefix);
@@ -45,6 +54,8 @@ public:
     void notify(event_type type, const std::string_view& path, obsr::entry entry);
     void notify(event_type type, const std::string_view& path, obsr::entry entry,
                 const value& old_value, const value& new_value);
+    // queues the events together, so no other event is delivered between them
+    void notify(std::vector<event>&& events);
 
 private:
     void notify(const event& event);
@@ -57,6 +68,7 @@ private:
     std::mutex m_mutex;
     std::condition_variable m_has_events;
     std::deque<event> m_pending_events;
+    dispatch_observer m_dispatch_observer;
 
     std::thread m_thread;
 };
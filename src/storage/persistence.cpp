@@ -0,0 +1,533 @@
+
+#include "internal_except.h"
+#include "os/file.h"
+#include "debug.h"
+
+#include "persistence.h"
+
+namespace obsr::storage {
+
+#define LOG_MODULE "persistence"
+
+static constexpr uint8_t snapshot_magic[] = {'O', 'B', 'S', 'R'};
+static constexpr uint8_t snapshot_version = 1;
+// magic, version and count of entries
+static constexpr size_t snapshot_header_size = sizeof(snapshot_magic) + sizeof(uint8_t) + sizeof(uint32_t);
+// fits the largest record: time, path and value, each within the size limits
+static constexpr size_t record_buffer_size = 4096;
+
+static constexpr uint8_t log_magic[] = {'O', 'B', 'S', 'L'};
+static constexpr uint8_t log_version = 1;
+static constexpr uint8_t log_header[] = {log_magic[0], log_magic[1], log_magic[2], log_magic[3], log_version};
+
+enum change_kind : uint8_t {
+    change_kind_update = 1,
+    change_kind_delete = 2
+};
+
+static std::string log_path(const std::string& path) {
+    return path + ".log";
+}
+
+static std::string old_log_path(const std::string& path) {
+    return path + ".log.old";
+}
+
+snapshot_writer::snapshot_writer()
+    : m_data(snapshot_header_size)
+    , m_count(0)
+    , m_record(record_buffer_size)
+    , m_serializer(&m_record) {
+    memcpy(m_data.data(), snapshot_magic, sizeof(snapshot_magic));
+    m_data[sizeof(snapshot_magic)] = snapshot_version;
+}
+
+bool snapshot_writer::add(const snapshot_entry& entry) {
+    m_record.reset();
+
+    if (!m_serializer.write64(entry.timestamp.count())) {
+        return false;
+    }
+
+    if (!m_serializer.write_str(entry.path)) {
+        return false;
+    }
+
+    if (!m_serializer.write_value_type(entry.value.get_type())) {
+        return false;
+    }
+
+    if (!m_serializer.write_value(entry.value)) {
+        return false;
+    }
+
+    m_data.insert(m_data.end(), m_record.data(), m_record.data() + m_record.pos());
+    m_count++;
+
+    return true;
+}
+
+std::span<const uint8_t> snapshot_writer::data() {
+    const auto count = obsr::bits::net32(m_count);
+    memcpy(m_data.data() + sizeof(snapshot_magic) + sizeof(uint8_t), &count, sizeof(count));
+
+    return m_data;
+}
+
+snapshot_reader::snapshot_reader(std::span<const uint8_t> data)
+    : m_buffer()
+    , m_deserializer(&m_buffer) {
+    m_buffer.reset(data.data(), data.size());
+}
+
+std::optional<std::vector<snapshot_entry>> snapshot_reader::read() {
+    const auto magic = m_buffer.consume(sizeof(snapshot_magic));
+    if (magic == nullptr || memcmp(magic, snapshot_magic, sizeof(snapshot_magic)) != 0) {
+        return {};
+    }
+
+    const auto version_opt = m_deserializer.read8();
+    if (!version_opt || version_opt.value() != snapshot_version) {
+        return {};
+    }
+
+    const auto count_opt = m_deserializer.read32();
+    if (!count_opt) {
+        return {};
+    }
+
+    std::vector<snapshot_entry> entries;
+    entries.reserve(count_opt.value());
+
+    for (uint32_t i = 0; i < count_opt.value(); i++) {
+        const auto timestamp_opt = m_deserializer.read64();
+        if (!timestamp_opt) {
+            return {};
+        }
+
+        const auto path_opt = m_deserializer.read_str();
+        if (!path_opt) {
+            return {};
+        }
+
+        auto value_opt = m_deserializer.read_typed_value();
+        if (!value_opt) {
+            return {};
+        }
+
+        entries.push_back({
+            path_opt.value(),
+            std::move(value_opt.value()),
+            std::chrono::milliseconds(timestamp_opt.value())
+        });
+    }
+
+    return entries;
+}
+
+change_log_writer::change_log_writer()
+    : m_data()
+    , m_record(record_buffer_size)
+    , m_serializer(&m_record) {
+}
+
+std::span<const uint8_t> change_log_writer::header() {
+    return log_header;
+}
+
+bool change_log_writer::add(const logged_change& change) {
+    m_record.reset();
+
+    if (!m_serializer.write8(change.value ? change_kind_update : change_kind_delete)) {
+        return false;
+    }
+
+    if (!m_serializer.write64(change.timestamp.count())) {
+        return false;
+    }
+
+    if (!m_serializer.write_str(change.path)) {
+        return false;
+    }
+
+    if (change.value) {
+        if (!m_serializer.write_value_type(change.value->get_type())) {
+            return false;
+        }
+
+        if (!m_serializer.write_value(change.value.value())) {
+            return false;
+        }
+    }
+
+    m_data.insert(m_data.end(), m_record.data(), m_record.data() + m_record.pos());
+
+    return true;
+}
+
+std::vector<uint8_t> change_log_writer::take() {
+    std::vector<uint8_t> data;
+    data.swap(m_data);
+
+    return data;
+}
+
+change_log_reader::change_log_reader(std::span<const uint8_t> data)
+    : m_buffer()
+    , m_deserializer(&m_buffer)
+    , m_whole(true) {
+    m_buffer.reset(data.data(), data.size());
+}
+
+std::optional<std::vector<logged_change>> change_log_reader::read() {
+    std::vector<logged_change> changes;
+
+    if (m_buffer.remaining() < sizeof(log_header)) {
+        // a crash right after the log was created
+        m_whole = m_buffer.remaining() == 0;
+        return changes;
+    }
+
+    const auto header = m_buffer.consume(sizeof(log_header));
+    if (memcmp(header, log_header, sizeof(log_header)) != 0) {
+        return {};
+    }
+
+    while (m_buffer.remaining() > 0) {
+        const auto kind_opt = m_deserializer.read8();
+        if (!kind_opt || (kind_opt.value() != change_kind_update && kind_opt.value() != change_kind_delete)) {
+            m_whole = false;
+            break;
+        }
+
+        const auto timestamp_opt = m_deserializer.read64();
+        if (!timestamp_opt) {
+            m_whole = false;
+            break;
+        }
+
+        const auto path_opt = m_deserializer.read_str();
+        if (!path_opt) {
+            m_whole = false;
+            break;
+        }
+
+        std::optional<obsr::value> value;
+        if (kind_opt.value() == change_kind_update) {
+            value = m_deserializer.read_typed_value();
+            if (!value) {
+                m_whole = false;
+                break;
+            }
+        }
+
+        changes.push_back({
+            path_opt.value(),
+            std::move(value),
+            std::chrono::milliseconds(timestamp_opt.value())
+        });
+    }
+
+    return changes;
+}
+
+bool change_log_reader::is_whole() const {
+    return m_whole;
+}
+
+persistence::persistence(std::shared_ptr<storage> storage)
+    : m_mutex()
+    , m_storage(std::move(storage))
+    , m_running(false)
+    , m_path()
+    , m_options()
+    , m_looper(nullptr)
+    , m_timer_handle(empty_handle)
+    , m_saved_change_count(0)
+    , m_log_mutex()
+    , m_log_condition()
+    , m_log_writer()
+    , m_log_run(false)
+    , m_log_thread()
+    , m_log_file()
+    , m_old_log_kept(false) {
+}
+
+void persistence::start(events::looper* looper, std::string_view path, const persistence_options& options) {
+    std::unique_lock lock(m_mutex);
+
+    if (m_running) {
+        throw illegal_state_exception("already running");
+    }
+
+    m_path = path;
+    m_options = options;
+
+    load_snapshot(m_path);
+    // the previous log, if kept, has changes older than those of the current one
+    const auto old_log_found = replay_log(old_log_path(m_path));
+    const auto log_found = replay_log(log_path(m_path));
+
+    if (m_options.log_changes) {
+        // changes made from here on are logged, even those made while the logs are compacted
+        m_log_run = true;
+        m_old_log_kept = false;
+        m_storage->set_change_observer([this](const logged_change& change)->void {
+            append_to_log(change);
+        });
+    }
+
+    if (old_log_found || log_found) {
+        // the snapshot then has all the changes of the logs, so a new log may replace them
+        try {
+            save_snapshot(m_path);
+            os::remove_file(old_log_path(m_path));
+            os::remove_file(log_path(m_path));
+        } catch (...) {
+            m_storage->set_change_observer({});
+            m_log_run = false;
+            m_log_writer.take();
+            throw;
+        }
+    }
+
+    if (m_options.log_changes) {
+        m_log_thread = std::thread(&persistence::log_thread_main, this);
+    } else {
+        m_saved_change_count = m_storage->get_change_count();
+
+        m_looper = looper;
+        m_timer_handle = m_looper->create_timer(m_options.save_interval, [this](events::looper&, obsr::handle)->void {
+            save_if_changed();
+        });
+    }
+
+    m_running = true;
+}
+
+void persistence::stop() {
+    std::unique_lock lock(m_mutex);
+
+    if (!m_running) {
+        throw illegal_state_exception("not running");
+    }
+
+    if (m_options.log_changes) {
+        stop_log();
+    } else {
+        const auto timer_handle = m_timer_handle;
+        lock.unlock();
+        m_looper->request_execute([this, timer_handle](events::looper&)->void {
+            m_looper->stop_timer(timer_handle);
+        }, events::looper::execute_type::sync);
+
+        // the last changes are kept as well
+        save_if_changed();
+
+        lock.lock();
+        m_looper = nullptr;
+        m_timer_handle = empty_handle;
+    }
+
+    m_running = false;
+}
+
+bool persistence::is_running() {
+    std::unique_lock lock(m_mutex);
+    return m_running;
+}
+
+void persistence::save(const std::string& path) {
+    save_snapshot(path);
+
+    {
+        std::unique_lock lock(m_mutex);
+        if (m_running && m_options.log_changes && m_path == path) {
+            return;
+        }
+    }
+
+    os::remove_file(old_log_path(path));
+    os::remove_file(log_path(path));
+}
+
+bool persistence::load(const std::string& path) {
+    const auto snapshot_found = load_snapshot(path);
+    const auto old_log_found = replay_log(old_log_path(path));
+    const auto log_found = replay_log(log_path(path));
+
+    return snapshot_found || old_log_found || log_found;
+}
+
+void persistence::save_snapshot(const std::string& path) {
+    snapshot_writer writer;
+    m_storage->act_on_entries_for_snapshot([&writer](const snapshot_entry& entry)->void {
+        if (!writer.add(entry)) {
+            TRACE_ERROR(LOG_MODULE, "entry %.*s cannot be saved, skipping it",
+                        static_cast<int>(entry.path.size()), entry.path.data());
+        }
+    });
+
+    // written out of the lock of the storage
+    os::replace_file(path, writer.data());
+}
+
+bool persistence::load_snapshot(const std::string& path) {
+    auto file = os::mapped_file::open(path);
+    if (!file) {
+        TRACE_INFO(LOG_MODULE, "no snapshot at %s", path.c_str());
+        return false;
+    }
+
+    snapshot_reader reader(file->data());
+    auto entries_opt = reader.read();
+    if (!entries_opt) {
+        throw invalid_snapshot_exception(path);
+    }
+
+    [[maybe_unused]] const auto loaded = m_storage->load_snapshot(entries_opt.value());
+    TRACE_INFO(LOG_MODULE, "loaded %lu of %lu entries from snapshot at %s",
+               loaded, entries_opt->size(), path.c_str());
+
+    return true;
+}
+
+bool persistence::replay_log(const std::string& path) {
+    auto file = os::mapped_file::open(path);
+    if (!file) {
+        return false;
+    }
+
+    change_log_reader reader(file->data());
+    auto changes_opt = reader.read();
+    if (!changes_opt) {
+        throw invalid_change_log_exception(path);
+    }
+
+    if (!reader.is_whole()) {
+        TRACE_INFO(LOG_MODULE, "log at %s ends with a change which was not fully written, ignoring it", path.c_str());
+    }
+
+    [[maybe_unused]] const auto applied = m_storage->replay_changes(changes_opt.value());
+    TRACE_INFO(LOG_MODULE, "replayed %lu of %lu changes from log at %s",
+               applied, changes_opt->size(), path.c_str());
+
+    return true;
+}
+
+void persistence::save_if_changed() {
+    std::string path;
+    {
+        std::unique_lock lock(m_mutex);
+
+        const auto change_count = m_storage->get_change_count();
+        if (change_count == m_saved_change_count) {
+            return;
+        }
+
+        m_saved_change_count = change_count;
+        path = m_path;
+    }
+
+    try {
+        save(path);
+    } catch (const std::exception& e) {
+        TRACE_ERROR(LOG_MODULE, "error while saving snapshot to %s: what=%s", path.c_str(), e.what());
+    }
+}
+
+void persistence::append_to_log(const logged_change& change) {
+    // only copied here. the caller never waits for the disk.
+    std::unique_lock lock(m_log_mutex);
+
+    if (!m_log_writer.add(change)) {
+        TRACE_ERROR(LOG_MODULE, "change to entry %.*s cannot be logged, skipping it",
+                    static_cast<int>(change.path.size()), change.path.data());
+    }
+}
+
+void persistence::stop_log() {
+    // once this returns, no more changes are added
+    m_storage->set_change_observer({});
+
+    {
+        std::unique_lock lock(m_log_mutex);
+        m_log_run = false;
+    }
+
+    m_log_condition.notify_all();
+    m_log_thread.join();
+}
+
+void persistence::log_thread_main() {
+    std::unique_lock lock(m_log_mutex);
+
+    bool run = true;
+    while (run) {
+        // changes made during the interval are written and synced together
+        m_log_condition.wait_for(lock, m_options.log_sync_interval, [this]()->bool {
+            return !m_log_run;
+        });
+        run = m_log_run;
+
+        const auto data = m_log_writer.take();
+        lock.unlock();
+
+        try {
+            // written even when stopping, in case saving the snapshot fails
+            write_log(data);
+
+            if (!run) {
+                save_last_and_remove_logs();
+            } else if (m_log_file && m_log_file->size() >= m_options.log_compact_size) {
+                compact_log();
+            }
+        } catch (const std::exception& e) {
+            TRACE_ERROR(LOG_MODULE, "error while writing log of %s: what=%s", m_path.c_str(), e.what());
+        }
+
+        lock.lock();
+    }
+}
+
+void persistence::write_log(std::span<const uint8_t> data) {
+    if (data.empty()) {
+        return;
+    }
+
+    if (!m_log_file) {
+        m_log_file = os::append_file::create(log_path(m_path));
+        m_log_file->write(change_log_writer::header());
+    }
+
+    m_log_file->write(data);
+    m_log_file->sync();
+}
+
+void persistence::compact_log() {
+    if (!m_old_log_kept) {
+        // changes made from here on go to a new log, and the snapshot saved next has all those of this one.
+        // should saving it fail, this log is kept until another is saved.
+        os::rename_file(log_path(m_path), old_log_path(m_path));
+        m_log_file.reset();
+        m_old_log_kept = true;
+    }
+
+    save_snapshot(m_path);
+    os::remove_file(old_log_path(m_path));
+    m_old_log_kept = false;
+
+    TRACE_INFO(LOG_MODULE, "compacted log into snapshot at %s", m_path.c_str());
+}
+
+void persistence::save_last_and_remove_logs() {
+    // changes are no longer added, so the snapshot has all of them, and the logs are no longer needed
+    save_snapshot(m_path);
+
+    m_log_file.reset();
+    os::remove_file(old_log_path(m_path));
+    os::remove_file(log_path(m_path));
+    m_old_log_kept = false;
+}
+
+}
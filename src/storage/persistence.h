@@ -0,0 +1,142 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <string>
+#include <vector>
+#include <span>
+#include <optional>
+
+#include "obsr_types.h"
+#include "io/buffer.h"
+#include "io/serialize.h"
+#include "events/events.h"
+#include "os/file.h"
+#include "storage.h"
+
+namespace obsr::storage {
+
+// snapshot files start with a header, followed by a record for each entry: the time of its last update,
+// its path and its value. fields are encoded as they are sent over the network.
+class snapshot_writer {
+public:
+    snapshot_writer();
+
+    // returns false if the entry cannot be written, such as if its path is too long
+    bool add(const snapshot_entry& entry);
+    // valid until the next add
+    std::span<const uint8_t> data();
+
+private:
+    std::vector<uint8_t> m_data;
+    uint32_t m_count;
+    io::linear_buffer m_record;
+    io::basic_serializer<io::linear_buffer> m_serializer;
+};
+
+class snapshot_reader {
+public:
+    // the data must outlive the entries read, as their paths point into it
+    explicit snapshot_reader(std::span<const uint8_t> data);
+
+    // returns nothing if the data is not a valid snapshot
+    std::optional<std::vector<snapshot_entry>> read();
+
+private:
+    io::readonly_buffer_view m_buffer;
+    io::basic_deserializer<io::readonly_buffer_view> m_deserializer;
+};
+
+// change logs start with a header, followed by a record for each change: its kind, its time, the path of
+// the entry and, unless it was deleted, its value. records are only ever appended, so a crash may leave the
+// last of them partially written. reading stops at the first record which is not whole.
+class change_log_writer {
+public:
+    change_log_writer();
+
+    // written once, at the start of the log
+    static std::span<const uint8_t> header();
+
+    // returns false if the change cannot be written, such as if its path is too long
+    bool add(const logged_change& change);
+    // the records added since the last call
+    std::vector<uint8_t> take();
+
+private:
+    std::vector<uint8_t> m_data;
+    io::linear_buffer m_record;
+    io::basic_serializer<io::linear_buffer> m_serializer;
+};
+
+class change_log_reader {
+public:
+    // the data must outlive the changes read, as their paths point into it
+    explicit change_log_reader(std::span<const uint8_t> data);
+
+    // returns nothing if the data is not a change log
+    std::optional<std::vector<logged_change>> read();
+    // false if the data ended with a record which is not whole
+    [[nodiscard]] bool is_whole() const;
+
+private:
+    io::readonly_buffer_view m_buffer;
+    io::basic_deserializer<io::readonly_buffer_view> m_deserializer;
+    bool m_whole;
+};
+
+// keeps the entries of the storage in a snapshot file, so they may be loaded when starting again.
+// changes may also be appended to a log next to it, which is replayed after the snapshot is loaded.
+// once the log grows too big, it is compacted: it is set aside for a new one, a snapshot with all of its
+// changes is saved, and it is removed.
+class persistence {
+public:
+    explicit persistence(std::shared_ptr<storage> storage);
+
+    // loads the snapshot and its logs, if there are any. then keeps saving the entries as configured,
+    // and saves them once more when stopped.
+    void start(events::looper* looper, std::string_view path, const persistence_options& options);
+    void stop();
+    [[nodiscard]] bool is_running();
+
+    // logs at the path are removed after, as the snapshot has all of their changes. unless changes are
+    // logged to them at the moment, in which case they are kept.
+    void save(const std::string& path);
+    // loads the snapshot and replays its logs after. returns false if there are neither.
+    bool load(const std::string& path);
+
+private:
+    void save_snapshot(const std::string& path);
+    bool load_snapshot(const std::string& path);
+    bool replay_log(const std::string& path);
+    void save_if_changed();
+
+    void append_to_log(const logged_change& change);
+    void stop_log();
+    void log_thread_main();
+    void write_log(std::span<const uint8_t> data);
+    void compact_log();
+    void save_last_and_remove_logs();
+
+    std::mutex m_mutex;
+    std::shared_ptr<storage> m_storage;
+    bool m_running;
+    std::string m_path;
+    persistence_options m_options;
+    events::looper* m_looper;
+    obsr::handle m_timer_handle;
+    uint64_t m_saved_change_count;
+
+    // changes are added from whichever thread made them, and written to the file from the log thread
+    std::mutex m_log_mutex;
+    std::condition_variable m_log_condition;
+    change_log_writer m_log_writer;
+    bool m_log_run;
+    std::thread m_log_thread;
+    // only used from the log thread. opened once there is something to write.
+    std::unique_ptr<os::append_file> m_log_file;
+    // the previous log, kept until a snapshot with all of its changes is saved
+    bool m_old_log_kept;
+};
+
+}
@@ -0,0 +1,299 @@
+
+#include "internal_except.h"
+#include "debug.h"
+
+#include "recording.h"
+
+namespace obsr::storage {
+
+#define LOG_MODULE "recording"
+
+static constexpr uint8_t recording_magic[] = {'O', 'B', 'S', 'E'};
+static constexpr uint8_t recording_version = 1;
+static constexpr uint8_t recording_header[] = {
+        recording_magic[0], recording_magic[1], recording_magic[2], recording_magic[3], recording_version};
+// fits the largest record: type, time, path and value, each within the size limits
+static constexpr size_t record_buffer_size = 4096;
+// records are written to the file once this much of them was gathered, or there are no more to write
+static constexpr size_t write_batch_size = 64 * 1024;
+// time the writing thread waits for more events, once it wrote all there were
+static constexpr auto write_poll_interval = std::chrono::milliseconds(10);
+
+recording_writer::recording_writer()
+    : m_data()
+    , m_record(record_buffer_size)
+    , m_serializer(&m_record) {
+}
+
+std::span<const uint8_t> recording_writer::header() {
+    return recording_header;
+}
+
+bool recording_writer::add(const recorded_event& event) {
+    m_record.reset();
+
+    if (!m_serializer.write8(static_cast<uint8_t>(event.type))) {
+        return false;
+    }
+
+    if (!m_serializer.write64(event.timestamp.count())) {
+        return false;
+    }
+
+    if (!m_serializer.write_str(event.path)) {
+        return false;
+    }
+
+    if (event.type == event_type::value_changed) {
+        if (!m_serializer.write_value_type(event.value.get_type())) {
+            return false;
+        }
+
+        if (!m_serializer.write_value(event.value)) {
+            return false;
+        }
+    }
+
+    m_data.insert(m_data.end(), m_record.data(), m_record.data() + m_record.pos());
+
+    return true;
+}
+
+std::span<const uint8_t> recording_writer::data() const {
+    return m_data;
+}
+
+void recording_writer::clear() {
+    m_data.clear();
+}
+
+recording_reader::recording_reader(std::span<const uint8_t> data)
+    : m_buffer()
+    , m_deserializer(&m_buffer) {
+    m_buffer.reset(data.data(), data.size());
+}
+
+bool recording_reader::read_header() {
+    const auto header = m_buffer.consume(sizeof(recording_header));
+    return header != nullptr && memcmp(header, recording_header, sizeof(recording_header)) == 0;
+}
+
+std::optional<recorded_event> recording_reader::next() {
+    const auto type_opt = m_deserializer.read8();
+    if (!type_opt) {
+        return {};
+    }
+
+    const auto type = static_cast<event_type>(type_opt.value());
+    if (type != event_type::created && type != event_type::deleted && type != event_type::value_changed) {
+        return {};
+    }
+
+    const auto timestamp_opt = m_deserializer.read64();
+    if (!timestamp_opt) {
+        return {};
+    }
+
+    const auto path_opt = m_deserializer.read_str();
+    if (!path_opt) {
+        return {};
+    }
+
+    auto value = value::make();
+    if (type == event_type::value_changed) {
+        auto value_opt = m_deserializer.read_typed_value();
+        if (!value_opt) {
+            return {};
+        }
+
+        value = std::move(value_opt.value());
+    }
+
+    return recorded_event{
+        type,
+        path_opt.value(),
+        std::move(value),
+        std::chrono::milliseconds(timestamp_opt.value())
+    };
+}
+
+recorder::recorder(listener_storage_ref listener_storage)
+    : m_mutex()
+    , m_listener_storage(std::move(listener_storage))
+    , m_running(false)
+    , m_path()
+    , m_ring(ring_capacity)
+    , m_dropped(0)
+    , m_thread_run(false)
+    , m_thread()
+    , m_file()
+    , m_writer() {
+}
+
+void recorder::start(std::string_view path) {
+    std::unique_lock lock(m_mutex);
+
+    if (m_running) {
+        throw illegal_state_exception("already running");
+    }
+
+    m_path = path;
+    m_file = os::append_file::create(m_path);
+    m_file->write(recording_writer::header());
+
+    m_dropped = 0;
+    m_thread_run.store(true);
+    m_thread = std::thread(&recorder::thread_main, this);
+
+    m_listener_storage->set_dispatch_observer([this](const event& event)->void {
+        on_event(event);
+    });
+
+    m_running = true;
+}
+
+void recorder::stop() {
+    std::unique_lock lock(m_mutex);
+
+    if (!m_running) {
+        throw illegal_state_exception("not running");
+    }
+
+    // once this returns, no more events are added to the ring
+    m_listener_storage->set_dispatch_observer({});
+
+    m_thread_run.store(false);
+    m_thread.join();
+    m_file.reset();
+
+    if (m_dropped > 0) {
+        TRACE_ERROR(LOG_MODULE, "%lu events were not recorded to %s, as writing fell behind",
+                    m_dropped, m_path.c_str());
+    }
+
+    m_running = false;
+}
+
+bool recorder::is_running() {
+    std::unique_lock lock(m_mutex);
+    return m_running;
+}
+
+void recorder::on_event(const event& event) {
+    auto slot = m_ring.claim();
+    if (slot == nullptr) {
+        m_dropped++;
+        return;
+    }
+
+    // the slot keeps the memory of its path, so it is only allocated once the ring wraps
+    // around to a slot with a shorter one
+    slot->type = event.get_type();
+    slot->path.assign(event.get_path());
+    slot->value = event.get_type() == event_type::value_changed ? event.get_value() : value::make();
+    slot->timestamp = event.get_timestamp();
+
+    m_ring.commit();
+}
+
+void recorder::thread_main() {
+    while (m_thread_run.load()) {
+        if (!write_events()) {
+            std::this_thread::sleep_for(write_poll_interval);
+        }
+    }
+
+    // events added before stopping
+    write_events();
+}
+
+bool recorder::write_events() {
+    bool wrote_any = false;
+
+    try {
+        slot* slot;
+        while ((slot = m_ring.front()) != nullptr) {
+            if (!m_writer.add({slot->type, slot->path, slot->value, slot->timestamp})) {
+                TRACE_ERROR(LOG_MODULE, "event of entry %s cannot be recorded, skipping it", slot->path.c_str());
+            }
+
+            // the ring should not keep the data of values alive
+            slot->value = value::make();
+            m_ring.release();
+            wrote_any = true;
+
+            if (m_writer.data().size() >= write_batch_size) {
+                m_file->write(m_writer.data());
+                m_writer.clear();
+            }
+        }
+
+        if (!m_writer.data().empty()) {
+            m_file->write(m_writer.data());
+            m_writer.clear();
+        }
+    } catch (const std::exception& e) {
+        TRACE_ERROR(LOG_MODULE, "error while writing recording to %s: what=%s", m_path.c_str(), e.what());
+        m_writer.clear();
+    }
+
+    return wrote_any;
+}
+
+size_t replay_recording(storage& storage, const std::string& path, double speed) {
+    auto file = os::mapped_file::open(path);
+    if (!file) {
+        throw io_exception(ENOENT);
+    }
+
+    recording_reader reader(file->data());
+    if (!reader.read_header()) {
+        throw invalid_recording_exception(path);
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    std::optional<std::chrono::milliseconds> first_timestamp;
+    size_t applied = 0;
+
+    std::optional<recorded_event> event_opt;
+    while ((event_opt = reader.next())) {
+        auto& event = event_opt.value();
+
+        if (speed > 0) {
+            if (!first_timestamp) {
+                first_timestamp = event.timestamp;
+            }
+
+            const auto since_first = std::chrono::duration<double, std::milli>(event.timestamp - first_timestamp.value());
+            std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(since_first / speed));
+        }
+
+        const auto entry = storage.get_or_create_entry(event.path);
+        try {
+            switch (event.type) {
+                case event_type::created:
+                    // the value follows with its own event
+                    break;
+                case event_type::deleted:
+                    storage.delete_entry(entry);
+                    break;
+                case event_type::value_changed:
+                    if (event.value.get_type() == value_type::empty) {
+                        storage.clear_entry(entry);
+                    } else {
+                        storage.set_entry_value(entry, event.value);
+                    }
+                    break;
+            }
+
+            applied++;
+        } catch (const entry_type_mismatch_exception&) {
+            TRACE_ERROR(LOG_MODULE, "entry %.*s in recording is of another type, skipping event",
+                        static_cast<int>(event.path.size()), event.path.data());
+        }
+    }
+
+    return applied;
+}
+
+}
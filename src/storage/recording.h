@@ -0,0 +1,113 @@
+#pragma once
+
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <span>
+#include <optional>
+
+#include "obsr_types.h"
+#include "io/buffer.h"
+#include "io/serialize.h"
+#include "os/file.h"
+#include "util/spsc_ring.h"
+#include "listener_storage.h"
+#include "storage.h"
+
+namespace obsr::storage {
+
+// an event as written to or read from a recording. the path is only valid while the data of
+// the recording it was read from is.
+struct recorded_event {
+    event_type type;
+    std::string_view path;
+    // empty unless the value of the entry changed
+    obsr::value value;
+    std::chrono::milliseconds timestamp;
+};
+
+// recordings start with a header, followed by a record for each event: its type, its time, the path
+// of the entry and, for changes of value, the new value. fields are encoded as they are sent over the network.
+class recording_writer {
+public:
+    recording_writer();
+
+    // written once, at the start of the recording
+    static std::span<const uint8_t> header();
+
+    // returns false if the event cannot be written, such as if its path is too long
+    bool add(const recorded_event& event);
+    [[nodiscard]] std::span<const uint8_t> data() const;
+    void clear();
+
+private:
+    std::vector<uint8_t> m_data;
+    io::linear_buffer m_record;
+    io::basic_serializer<io::linear_buffer> m_serializer;
+};
+
+class recording_reader {
+public:
+    // the data must outlive the events read, as their paths point into it
+    explicit recording_reader(std::span<const uint8_t> data);
+
+    // returns false if the data is not a recording
+    bool read_header();
+    // returns nothing once there are no more events. a recording which was not stopped may end with
+    // a record which is not whole, which is not read.
+    std::optional<recorded_event> next();
+
+private:
+    io::readonly_buffer_view m_buffer;
+    io::basic_deserializer<io::readonly_buffer_view> m_deserializer;
+};
+
+// records the events delivered to listeners to a file. events are copied into a ring as they are
+// delivered, and written from a thread of its own, so that recording does not hold them back.
+// if the writing falls behind and the ring fills up, events are dropped.
+class recorder {
+public:
+    static constexpr size_t ring_capacity = 16384;
+
+    explicit recorder(listener_storage_ref listener_storage);
+
+    void start(std::string_view path);
+    void stop();
+    [[nodiscard]] bool is_running();
+
+private:
+    struct slot {
+        event_type type = event_type::created;
+        std::string path;
+        obsr::value value = obsr::value::make();
+        std::chrono::milliseconds timestamp{0};
+    };
+
+    void on_event(const event& event);
+    void thread_main();
+    bool write_events();
+
+    std::mutex m_mutex;
+    listener_storage_ref m_listener_storage;
+    bool m_running;
+    std::string m_path;
+
+    spsc_ring<slot> m_ring;
+    // only used from the thread delivering events
+    uint64_t m_dropped;
+
+    std::atomic<bool> m_thread_run;
+    std::thread m_thread;
+    // only used from the writing thread
+    std::unique_ptr<os::append_file> m_file;
+    recording_writer m_writer;
+};
+
+// applies the events of the recording at the path to the storage, in the order they were recorded, and
+// spaced by the time between them divided by the speed. with a speed of 0, they are applied as fast as possible.
+// returns the amount of events applied.
+size_t replay_recording(storage& storage, const std::string& path, double speed);
+
+}
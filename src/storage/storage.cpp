@@ -14,6 +14,11 @@ static inline bool does_entry_have_value(const storage_entry* entry) {
     return !entry->has_flags(flag_internal_created) && !entry->has_flags(flag_internal_deleted);
 }
 
+// same check as done by storage_entry::set_value, for the type the entry will have by then
+static inline bool can_take_type(value_type current_type, value_type new_type) {
+    return current_type == value_type::empty || current_type == new_type;
+}
+
 storage_entry::storage_entry(entry handle, const std::string_view& path)
     : m_handle(handle)
     , m_path(path)
@@ -97,7 +102,11 @@ storage::storage(listener_storage_ref& listener_storage, const clock_ref& clock)
     , m_mutex()
     , m_entries()
     , m_paths()
-    , m_ids() {
+    , m_ids()
+    , m_transaction_entries()
+    , m_event_batch()
+    , m_change_count(0)
+    , m_change_observer() {
 }
 
 entry storage::get_or_create_entry(const std::string_view& path) {
@@ -144,6 +153,20 @@ uint32_t storage::probe(entry entry) {
     return data->get_flags() & ~flag_internal_mask;
 }
 
+void storage::add_entry_flags(entry entry, uint16_t flags) {
+    std::unique_lock guard(m_mutex);
+
+    auto data = m_entries[entry];
+    data->add_flags(flags & ~flag_internal_mask);
+}
+
+void storage::remove_entry_flags(entry entry, uint16_t flags) {
+    std::unique_lock guard(m_mutex);
+
+    auto data = m_entries[entry];
+    data->remove_flags(flags & ~flag_internal_mask);
+}
+
 std::string storage::get_entry_path(entry entry) {
     std::unique_lock guard(m_mutex);
 
@@ -166,6 +189,53 @@ std::optional<obsr::value> storage::get_entry_value(entry entry) {
     return data->get_value();
 }
 
+std::vector<std::optional<obsr::value>> storage::get_entry_values(std::span<const entry> entries) {
+    std::unique_lock guard(m_mutex);
+
+    std::vector<std::optional<obsr::value>> values;
+    values.reserve(entries.size());
+
+    for (const auto entry : entries) {
+        if (!m_entries.has(entry)) {
+            values.emplace_back();
+            continue;
+        }
+
+        auto data = m_entries[entry];
+        if (does_entry_have_value(data)) {
+            values.emplace_back(data->get_value());
+        } else {
+            values.emplace_back();
+        }
+    }
+
+    return values;
+}
+
+std::vector<std::pair<entry, obsr::value>> storage::get_entry_values_under(std::string_view path) {
+    std::unique_lock guard(m_mutex);
+
+    std::string prefix(path);
+    prefix.push_back('/');
+
+    // paths are sorted, so those under the prefix follow each other
+    std::vector<std::pair<entry, obsr::value>> values;
+    for (auto it = m_paths.lower_bound(prefix); it != m_paths.end() && it->first.starts_with(prefix); ++it) {
+        const auto entry = it->second;
+        if (!m_entries.has(entry)) {
+            continue;
+        }
+
+        auto data = m_entries[entry];
+        if (does_entry_have_value(data)) {
+            // values do not change their data once made, only share it, so this does not copy arrays
+            values.emplace_back(entry, data->get_value());
+        }
+    }
+
+    return values;
+}
+
 void storage::set_entry_value(entry entry, const obsr::value& value) {
     std::unique_lock guard(m_mutex);
 
@@ -178,9 +248,66 @@ void storage::clear_entry(entry entry) {
     set_entry_internal(entry, value::make(), true);
 }
 
-void storage::act_on_dirty_entries(const entry_action& action) {
+void storage::set_entry_values(std::span<const std::pair<entry, obsr::value>> values) {
+    std::unique_lock guard(m_mutex);
+
+    // checked before changing anything. an entry may appear more than once.
+    std::map<entry, value_type> types;
+    for (auto& [entry, value] : values) {
+        auto data = m_entries[entry];
+
+        auto it = types.find(entry);
+        if (it == types.end()) {
+            it = types.emplace(entry, data->get_value().get_type()).first;
+        }
+
+        if (!can_take_type(it->second, value.get_type())) {
+            throw entry_type_mismatch_exception(entry, it->second, value.get_type());
+        }
+        it->second = value.get_type();
+    }
+
+    event_batch batch(*this);
+    for (auto& [entry, value] : values) {
+        set_entry_internal(entry, value);
+
+        auto data = m_entries[entry];
+        if (!data->has_flags(flag_internal_transaction)) {
+            data->add_flags(flag_internal_transaction);
+            m_transaction_entries.push_back(entry);
+        }
+    }
+}
+
+void storage::act_on_dirty_entries(const entry_action& action, const transaction_action& transaction) {
     std::unique_lock guard(m_mutex);
 
+    if (!m_transaction_entries.empty()) {
+        if (transaction) {
+            transaction(true);
+        }
+
+        for (auto entry : m_transaction_entries) {
+            if (!m_entries.has(entry)) {
+                continue;
+            }
+
+            auto data = m_entries[entry];
+            data->remove_flags(flag_internal_transaction);
+            if (!data->is_dirty()) {
+                continue;
+            }
+
+            action(*data);
+            data->clear_dirty();
+        }
+        m_transaction_entries.clear();
+
+        if (transaction) {
+            transaction(false);
+        }
+    }
+
     for (auto [handle, data] : m_entries) {
         if (!data.has_flags(flag_internal_dirty)) {
             continue;
@@ -197,6 +324,140 @@ void storage::act_on_dirty_entries(const entry_action& action) {
     }
 }
 
+void storage::mark_all_dirty() {
+    std::unique_lock guard(m_mutex);
+
+    for (auto [handle, data] : m_entries) {
+        if (does_entry_have_value(&data)) {
+            data.mark_dirty();
+        }
+    }
+}
+
+void storage::act_on_entries_for_snapshot(const snapshot_action& action) {
+    std::unique_lock guard(m_mutex);
+
+    for (auto& [path, entry] : m_paths) {
+        if (!m_entries.has(entry)) {
+            continue;
+        }
+
+        auto data = m_entries[entry];
+        if (does_entry_have_value(data)) {
+            action({path, data->get_value(), data->get_last_update_timestamp()});
+        }
+    }
+}
+
+size_t storage::load_snapshot(std::span<const snapshot_entry> entries) {
+    std::unique_lock guard(m_mutex);
+
+    size_t loaded = 0;
+    size_t no_space = 0;
+
+    event_batch batch(*this);
+    for (auto& snapshot_entry : entries) {
+        entry entry;
+        auto it = m_paths.find(snapshot_entry.path);
+        if (it != m_paths.end()) {
+            entry = it->second;
+        } else if (m_entries.full()) {
+            no_space++;
+            continue;
+        } else {
+            entry = create_new_entry(snapshot_entry.path);
+        }
+
+        auto data = m_entries[entry];
+        if (!can_take_type(data->get_value().get_type(), snapshot_entry.value.get_type())) {
+            TRACE_ERROR(LOG_MODULE, "entry %.*s in snapshot is of another type, skipping it",
+                        static_cast<int>(snapshot_entry.path.size()), snapshot_entry.path.data());
+            continue;
+        }
+
+        if (!data->has_flags(flag_internal_created) && data->get_last_update_timestamp() >= snapshot_entry.timestamp) {
+            // changed or deleted since the snapshot was taken
+            continue;
+        }
+
+        // as if received from the network. what is newer remotely replaces it once connected.
+        set_entry_internal(entry, snapshot_entry.value, false, id_not_assigned, false, snapshot_entry.timestamp);
+        loaded++;
+    }
+
+    if (no_space > 0) {
+        TRACE_ERROR(LOG_MODULE, "storage is full, %lu entries in snapshot were skipped", no_space);
+    }
+
+    return loaded;
+}
+
+uint64_t storage::get_change_count() {
+    std::unique_lock guard(m_mutex);
+
+    return m_change_count;
+}
+
+void storage::set_change_observer(change_observer observer) {
+    std::unique_lock guard(m_mutex);
+
+    m_change_observer = std::move(observer);
+}
+
+size_t storage::replay_changes(std::span<const logged_change> changes) {
+    std::unique_lock guard(m_mutex);
+
+    size_t applied = 0;
+    size_t no_space = 0;
+
+    event_batch batch(*this);
+    for (auto& change : changes) {
+        entry entry;
+        auto it = m_paths.find(change.path);
+        if (it != m_paths.end()) {
+            entry = it->second;
+        } else if (change.value && m_entries.full()) {
+            no_space++;
+            continue;
+        } else if (change.value) {
+            entry = create_new_entry(change.path);
+        } else {
+            // deleted before anything else knew of it
+            continue;
+        }
+
+        auto data = m_entries[entry];
+        if (!data->has_flags(flag_internal_created) && data->get_last_update_timestamp() > change.timestamp) {
+            // changed since, either later in the log or locally
+            continue;
+        }
+
+        if (!change.value) {
+            delete_entry_internal(entry, false, change.timestamp);
+            applied++;
+            continue;
+        }
+
+        // an empty value is that of a cleared entry, which may take any type after
+        const auto clear = change.value->get_type() == value_type::empty;
+        if (!clear && !can_take_type(data->get_value().get_type(), change.value->get_type())) {
+            TRACE_ERROR(LOG_MODULE, "entry %.*s in log is of another type, skipping it",
+                        static_cast<int>(change.path.size()), change.path.data());
+            continue;
+        }
+
+        // as with snapshots, these are applied as if received from the network
+        set_entry_internal(entry, change.value.value(), clear, id_not_assigned, false, change.timestamp);
+        applied++;
+    }
+
+    if (no_space > 0) {
+        TRACE_ERROR(LOG_MODULE, "storage is full, %lu changes in log were skipped", no_space);
+    }
+
+    return applied;
+}
+
 void storage::clear_net_ids() {
     std::unique_lock guard(m_mutex);
 
@@ -226,17 +487,23 @@ void storage::remove_listener(listener listener) {
     m_listener_storage->destroy_listener(listener);
 }
 
-std::optional<obsr::value> storage::get_entry_value_from_id(entry_id id) {
+uint16_t storage::get_entry_flags_from_id(entry_id id) {
     std::unique_lock guard(m_mutex);
 
-    auto it = m_ids.find(id);
-    if (it == m_ids.end()) {
-        // no such id
-        return {};
+    const auto entry = find_entry_by_id(id);
+    if (!m_entries.has(entry)) {
+        return 0;
     }
 
-    const auto entry = it->second;
+    return m_entries[entry]->get_flags();
+}
+
+std::optional<obsr::value> storage::get_entry_value_from_id(entry_id id) {
+    std::unique_lock guard(m_mutex);
+
+    const auto entry = find_entry_by_id(id);
     if (!m_entries.has(entry)) {
+        // no such id
         return {};
     }
 
@@ -248,6 +515,30 @@ std::optional<obsr::value> storage::get_entry_value_from_id(entry_id id) {
     return {};
 }
 
+std::vector<std::optional<obsr::value>> storage::get_entry_values_from_ids(std::span<const entry_id> ids) {
+    std::unique_lock guard(m_mutex);
+
+    std::vector<std::optional<obsr::value>> values;
+    values.reserve(ids.size());
+
+    for (const auto id : ids) {
+        const auto entry = find_entry_by_id(id);
+        if (!m_entries.has(entry)) {
+            values.emplace_back();
+            continue;
+        }
+
+        auto data = m_entries[entry];
+        if (does_entry_have_value(data)) {
+            values.emplace_back(data->get_value());
+        } else {
+            values.emplace_back();
+        }
+    }
+
+    return values;
+}
+
 void storage::on_clock_resync() {
     std::unique_lock guard(m_mutex);
 
@@ -285,8 +576,7 @@ void storage::on_entry_created(entry_id id,
         entry = create_new_entry(path);
     }
 
-    m_ids.emplace(id, entry);
-
+    assign_id_internal(entry, id);
     set_entry_internal(entry, value, false, id, false, timestamp);
 }
 
@@ -295,25 +585,67 @@ void storage::on_entry_updated(entry_id id,
                                std::chrono::milliseconds timestamp) {
     std::unique_lock guard(m_mutex);
 
-    auto it = m_ids.find(id);
-    if (it == m_ids.end()) {
-        // no such id, what?
+    const auto entry = find_entry_by_id(id);
+    if (entry == empty_handle) {
+        // no such id, or a stale one
         return;
     }
 
-    set_entry_internal(it->second, value, false, id, false, timestamp);
+    set_entry_internal(entry, value, false, id, false, timestamp);
 }
 
 void storage::on_entry_deleted(entry_id id, std::chrono::milliseconds timestamp) {
     std::unique_lock guard(m_mutex);
 
-    auto it = m_ids.find(id);
-    if (it == m_ids.end()) {
-        // no such id, what?
+    const auto entry = find_entry_by_id(id);
+    if (entry == empty_handle) {
+        // no such id, or a stale one
         return;
     }
 
-    delete_entry_internal(it->second, false, timestamp);
+    delete_entry_internal(entry, false, timestamp);
+}
+
+bool storage::on_entries_changed(std::span<const entry_change> changes) {
+    std::unique_lock guard(m_mutex);
+
+    std::map<entry, value_type> types;
+    for (auto& change : changes) {
+        const auto entry = find_entry_by_id(change.id);
+        if (entry == empty_handle || !change.value) {
+            // unknown ids are skipped, as with single updates
+            continue;
+        }
+
+        auto it = types.find(entry);
+        if (it == types.end()) {
+            it = types.emplace(entry, m_entries[entry]->get_value().get_type()).first;
+        }
+
+        const auto new_type = change.value->get_type();
+        if (!can_take_type(it->second, new_type)) {
+            TRACE_ERROR(LOG_MODULE, "transaction changes type of entry %d from %d to %d, dropping it",
+                        change.id, it->second, new_type);
+            return false;
+        }
+        it->second = new_type;
+    }
+
+    event_batch batch(*this);
+    for (auto& change : changes) {
+        const auto entry = find_entry_by_id(change.id);
+        if (entry == empty_handle) {
+            continue;
+        }
+
+        if (change.value) {
+            set_entry_internal(entry, change.value.value(), false, change.id, false, change.timestamp);
+        } else {
+            delete_entry_internal(entry, false, change.timestamp);
+        }
+    }
+
+    return true;
 }
 
 void storage::on_entry_id_assigned(entry_id id,
@@ -330,10 +662,63 @@ void storage::on_entry_id_assigned(entry_id id,
         entry = create_new_entry(path);
     }
 
+    assign_id_internal(entry, id);
+}
+
+void storage::on_entry_id_released(entry_id id) {
+    std::unique_lock guard(m_mutex);
+
+    const auto entry = find_entry_by_id(id);
+    if (entry == empty_handle) {
+        return;
+    }
+
+    m_ids[id_index(id)] = {id_not_assigned, empty_handle};
+
+    if (m_entries.has(entry)) {
+        auto data = m_entries[entry];
+        if (data->get_net_id() == id) {
+            // given a new id if it is used again
+            data->clear_net_id();
+        }
+    }
+}
+
+void storage::assign_id_internal(entry entry, entry_id id) {
+    const auto index = id_index(id);
+    if (index >= m_ids.size()) {
+        m_ids.resize(index + 1, {id_not_assigned, empty_handle});
+    }
+
+    auto& slot = m_ids[index];
+    if (slot.handle != empty_handle && slot.handle != entry && m_entries.has(slot.handle)) {
+        // the index was reused, the entry which had it no longer has an id
+        auto previous = m_entries[slot.handle];
+        if (previous->get_net_id() == slot.id) {
+            previous->clear_net_id();
+        }
+    }
+
     auto data = m_entries[entry];
+    const auto old_id = data->get_net_id();
+    if (old_id != id_not_assigned && old_id != id) {
+        const auto old_index = id_index(old_id);
+        if (old_index < m_ids.size() && m_ids[old_index].id == old_id) {
+            m_ids[old_index] = {id_not_assigned, empty_handle};
+        }
+    }
+
     data->set_net_id(id);
+    slot = {id, entry};
+}
+
+entry storage::find_entry_by_id(entry_id id) const {
+    const auto index = id_index(id);
+    if (index >= m_ids.size() || m_ids[index].id != id) {
+        return empty_handle;
+    }
 
-    m_ids.emplace(id, entry);
+    return m_ids[index].handle;
 }
 
 entry storage::create_new_entry(const std::string_view& path) {
@@ -380,10 +765,7 @@ void storage::set_entry_internal(entry entry,
     }
 
     if (just_created) {
-        m_listener_storage->notify(
-                event_type::created,
-                data->get_path(),
-                entry);
+        notify(event_type::created, data, entry);
     }
 
     if (id != id_not_assigned) {
@@ -407,13 +789,13 @@ void storage::set_entry_internal(entry entry,
         timestamp = m_clock->now();
     }
     data->set_last_update_timestamp(timestamp);
+    m_change_count++;
 
-    m_listener_storage->notify(
-            event_type::value_changed,
-            data->get_path(),
-            entry,
-            old_value,
-            value);
+    if (m_change_observer) {
+        m_change_observer({data->get_path(), data->get_value(), timestamp});
+    }
+
+    notify(event_type::value_changed, data, entry, old_value, value);
 }
 
 void storage::delete_entry_internal(entry entry,
@@ -449,11 +831,45 @@ void storage::delete_entry_internal(entry entry,
         timestamp = m_clock->now();
     }
     data->set_last_update_timestamp(timestamp);
+    m_change_count++;
+
+    if (m_change_observer) {
+        m_change_observer({data->get_path(), std::nullopt, timestamp});
+    }
+
+    notify(event_type::deleted, data, entry);
+}
 
-    m_listener_storage->notify(
-            event_type::deleted,
-            data->get_path(),
-            entry);
+storage::event_batch::event_batch(storage& storage)
+    : m_storage(storage) {
+    m_storage.m_event_batch.emplace();
+}
+
+storage::event_batch::~event_batch() {
+    auto events = std::move(m_storage.m_event_batch.value());
+    m_storage.m_event_batch.reset();
+
+    try {
+        m_storage.m_listener_storage->notify(std::move(events));
+    } catch (const std::exception& e) {
+        TRACE_ERROR(LOG_MODULE, "error while delivering batch of events: what=%s", e.what());
+    }
+}
+
+void storage::notify(event_type type, const storage_entry* data, entry entry) {
+    if (m_event_batch) {
+        m_event_batch->emplace_back(m_clock->now(), type, data->get_path(), entry);
+    } else {
+        m_listener_storage->notify(type, data->get_path(), entry);
+    }
+}
+
+void storage::notify(event_type type, const storage_entry* data, entry entry, const value& old_value, const value& new_value) {
+    if (m_event_batch) {
+        m_event_batch->emplace_back(m_clock->now(), type, data->get_path(), entry, old_value, new_value);
+    } else {
+        m_listener_storage->notify(type, data->get_path(), entry, old_value, new_value);
+    }
 }
 
 }
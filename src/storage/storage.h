@@ -5,6 +5,7 @@
 #include <string>
 #include <mutex>
 #include <optional>
+#include <span>
 
 #include "obsr_types.h"
 #include "obsr_internal.h"
@@ -17,13 +18,42 @@ namespace obsr::storage {
 static constexpr uint16_t flag_internal_shift_start = 8;
 static constexpr uint16_t flag_internal_mask = static_cast<uint8_t>(-1) << flag_internal_shift_start;
 
-using entry_id = uint16_t;
+// ids are made of an index, which is reused once the entry using it is deleted, and an epoch
+// which changes each time it is reused. a stale id thus never matches the entry now using its index.
+using entry_id = uint32_t;
 constexpr entry_id id_not_assigned = static_cast<entry_id>(-1);
 
+constexpr uint32_t id_index_bits = 24;
+constexpr uint32_t id_index_mask = (1u << id_index_bits) - 1;
+// the last index is never used, as it is part of id_not_assigned
+constexpr uint32_t id_max_index = id_index_mask - 1;
+
+constexpr uint32_t id_index(entry_id id) {
+    return id & id_index_mask;
+}
+
+constexpr uint8_t id_epoch(entry_id id) {
+    return static_cast<uint8_t>(id >> id_index_bits);
+}
+
+constexpr entry_id make_entry_id(uint32_t index, uint8_t epoch) {
+    return (static_cast<uint32_t>(epoch) << id_index_bits) | (index & id_index_mask);
+}
+
 enum entry_internal_flag : uint16_t {
     flag_internal_dirty = (1 << flag_internal_shift_start),
     flag_internal_deleted = (1 << (flag_internal_shift_start + 1)),
-    flag_internal_created = (1 << (flag_internal_shift_start + 2))
+    flag_internal_created = (1 << (flag_internal_shift_start + 2)),
+    // changed as part of a transaction which was not yet sent
+    flag_internal_transaction = (1 << (flag_internal_shift_start + 3))
+};
+
+// a change received from the network
+struct entry_change {
+    entry_id id;
+    // empty if the entry was deleted
+    std::optional<obsr::value> value;
+    std::chrono::milliseconds timestamp;
 };
 
 struct storage_entry {
@@ -68,9 +98,31 @@ private:
     uint16_t m_flags;
 };
 
+// an entry as written to or read from a snapshot file. the path is only valid while the entry
+// is visited, or while the data of the snapshot it was read from is.
+struct snapshot_entry {
+    std::string_view path;
+    obsr::value value;
+    std::chrono::milliseconds timestamp;
+};
+
+// a change to an entry, as written to or read from a change log. the path is only valid during the call
+// to the observer, or while the data of the log it was read from is.
+struct logged_change {
+    std::string_view path;
+    // empty if the entry was deleted
+    std::optional<obsr::value> value;
+    std::chrono::milliseconds timestamp;
+};
+
 class storage {
 public:
     using entry_action = std::function<bool(const storage_entry&)>;
+    // called with true before the entries of a transaction are visited, and with false after
+    using transaction_action = std::function<void(bool)>;
+    using snapshot_action = std::function<void(const snapshot_entry&)>;
+    // called under the lock of the storage, so it must not call back into it
+    using change_observer = std::function<void(const logged_change&)>;
 
     explicit storage(listener_storage_ref& listener_storage, const clock_ref& clock);
 
@@ -79,20 +131,52 @@ public:
     void delete_entries(const std::string_view& path);
 
     uint32_t probe(entry entry);
+    // only flags outside of the internal range may be changed
+    void add_entry_flags(entry entry, uint16_t flags);
+    void remove_entry_flags(entry entry, uint16_t flags);
     std::string get_entry_path(entry entry);
     std::optional<obsr::value> get_entry_value(entry entry);
+    // same as calling get_entry_value for each entry, but under a single lock
+    std::vector<std::optional<obsr::value>> get_entry_values(std::span<const entry> entries);
+    // values of all the entries under the path which have one, under a single lock
+    std::vector<std::pair<entry, obsr::value>> get_entry_values_under(std::string_view path);
     void set_entry_value(entry entry, const obsr::value& value);
     void clear_entry(entry entry);
-
-    void act_on_dirty_entries(const entry_action& action);
+    // either all values are set or, if any of them cannot be, none are. the events of the
+    // changes are delivered together, and the changes are sent as one transaction.
+    void set_entry_values(std::span<const std::pair<entry, obsr::value>> values);
+
+    // entries changed in transactions are visited first, grouped by the transaction action.
+    // the entries of a transaction are all visited, even if the action asks to stop in the middle.
+    void act_on_dirty_entries(const entry_action& action, const transaction_action& transaction = {});
+    // entries which have a value are sent again, as if they were just set
+    void mark_all_dirty();
     void clear_net_ids();
 
+    // visits the entries which have a value, under a single lock
+    void act_on_entries_for_snapshot(const snapshot_action& action);
+    // entries updated after the snapshot was taken keep their values, and entries which do not fit in storage
+    // are skipped. returns the amount of entries loaded.
+    size_t load_snapshot(std::span<const snapshot_entry> entries);
+    // grows on each change to an entry
+    uint64_t get_change_count();
+    // the observer is called with each change to an entry, in the order they are made. an empty one stops
+    // the calls; once this returns, the previous observer is no longer called.
+    void set_change_observer(change_observer observer);
+    // applies changes read from a log, in order. changes older than the entries they are made to are skipped, as are
+    // changes to new entries which do not fit in storage.
+    // returns the amount of changes applied.
+    size_t replay_changes(std::span<const logged_change> changes);
+
     listener listen(entry entry, const listener_callback& callback);
     listener listen(const std::string_view& prefix, const listener_callback& callback);
     void remove_listener(listener listener);
 
     // should be used from network code
     std::optional<obsr::value> get_entry_value_from_id(entry_id id);
+    // same as calling get_entry_value_from_id for each id, but under a single lock
+    std::vector<std::optional<obsr::value>> get_entry_values_from_ids(std::span<const entry_id> ids);
+    uint16_t get_entry_flags_from_id(entry_id id);
     void on_clock_resync();
 
     void on_entry_created(entry_id id,
@@ -104,10 +188,22 @@ public:
                           std::chrono::milliseconds timestamp);
     void on_entry_deleted(entry_id id,
                           std::chrono::milliseconds timestamp);
+    // applies a transaction received from the network. if any of the changes cannot be applied,
+    // none are. returns false in that case.
+    bool on_entries_changed(std::span<const entry_change> changes);
     void on_entry_id_assigned(entry_id id,
                               std::string_view path);
+    // the id is no longer used for the entry, and may be given to another
+    void on_entry_id_released(entry_id id);
 
 private:
+    struct id_slot {
+        entry_id id;
+        entry handle;
+    };
+
+    entry find_entry_by_id(entry_id id) const;
+    void assign_id_internal(entry entry, entry_id id);
     entry create_new_entry(const std::string_view& path);
 
     void set_entry_internal(entry entry,
@@ -120,13 +216,36 @@ private:
                                bool mark_dirty = true,
                                std::chrono::milliseconds timestamp = std::chrono::milliseconds(0));
 
+    // while one is alive, events are held back and delivered together once it is destroyed,
+    // including when leaving its scope because of an exception
+    class event_batch {
+    public:
+        explicit event_batch(storage& storage);
+        ~event_batch();
+
+        event_batch(const event_batch&) = delete;
+        event_batch& operator=(const event_batch&) = delete;
+
+    private:
+        storage& m_storage;
+    };
+
+    void notify(event_type type, const storage_entry* data, entry entry);
+    void notify(event_type type, const storage_entry* data, entry entry, const value& old_value, const value& new_value);
+
     listener_storage_ref m_listener_storage;
     clock_ref m_clock;
 
     std::recursive_mutex m_mutex; // todo: switch to regular
     handle_table<storage_entry, 256> m_entries;
     std::map<std::string, entry, std::less<>> m_paths;
-    std::map<entry_id, entry> m_ids;
+    // indexed by the index of the id
+    std::vector<id_slot> m_ids;
+    // entries changed in transactions since last sent. transactions made in between are sent as one.
+    std::vector<entry> m_transaction_entries;
+    std::optional<std::vector<event>> m_event_batch;
+    uint64_t m_change_count;
+    change_observer m_change_observer;
 };
 
 }
@@ -0,0 +1,91 @@
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define OBSR_X86_SIMD 1
+#endif
+
+#include "bits.h"
+
+namespace obsr::bits {
+
+using swap_copy_func = void(*)(const uint8_t* src, uint8_t* dst, size_t count);
+
+template<typename t_>
+static void swap_copy_scalar(const uint8_t* src, uint8_t* dst, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        t_ value;
+        memcpy(&value, src + i * sizeof(t_), sizeof(t_));
+        if constexpr (sizeof(t_) == sizeof(uint32_t)) {
+            value = __builtin_bswap32(value);
+        } else {
+            value = __builtin_bswap64(value);
+        }
+        memcpy(dst + i * sizeof(t_), &value, sizeof(t_));
+    }
+}
+
+#ifdef OBSR_X86_SIMD
+// shuffle masks reversing each 4 or 8 byte lane of a 16 byte vector
+static inline __m128i swap_mask128(size_t size) {
+    return size == sizeof(uint32_t) ?
+           _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12) :
+           _mm_setr_epi8(7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+}
+
+template<typename t_>
+__attribute__((target("ssse3")))
+static void swap_copy_ssse3(const uint8_t* src, uint8_t* dst, size_t count) {
+    constexpr size_t per_vector = sizeof(__m128i) / sizeof(t_);
+    const auto mask = swap_mask128(sizeof(t_));
+
+    size_t i = 0;
+    for (; i + per_vector <= count; i += per_vector) {
+        const auto value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * sizeof(t_)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * sizeof(t_)), _mm_shuffle_epi8(value, mask));
+    }
+
+    swap_copy_scalar<t_>(src + i * sizeof(t_), dst + i * sizeof(t_), count - i);
+}
+
+template<typename t_>
+__attribute__((target("avx2")))
+static void swap_copy_avx2(const uint8_t* src, uint8_t* dst, size_t count) {
+    constexpr size_t per_vector = sizeof(__m256i) / sizeof(t_);
+    // the shuffle works within each 16 byte half
+    const auto mask = _mm256_broadcastsi128_si256(swap_mask128(sizeof(t_)));
+
+    size_t i = 0;
+    for (; i + per_vector <= count; i += per_vector) {
+        const auto value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * sizeof(t_)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * sizeof(t_)), _mm256_shuffle_epi8(value, mask));
+    }
+
+    swap_copy_ssse3<t_>(src + i * sizeof(t_), dst + i * sizeof(t_), count - i);
+}
+#endif
+
+template<typename t_>
+static swap_copy_func select_swap_copy() {
+#ifdef OBSR_X86_SIMD
+    if (__builtin_cpu_supports("avx2")) {
+        return swap_copy_avx2<t_>;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return swap_copy_ssse3<t_>;
+    }
+#endif
+
+    return swap_copy_scalar<t_>;
+}
+
+void swap_copy32(const void* src, void* dst, size_t count) {
+    static const auto func = select_swap_copy<uint32_t>();
+    func(static_cast<const uint8_t*>(src), static_cast<uint8_t*>(dst), count);
+}
+
+void swap_copy64(const void* src, void* dst, size_t count) {
+    static const auto func = select_swap_copy<uint64_t>();
+    func(static_cast<const uint8_t*>(src), static_cast<uint8_t*>(dst), count);
+}
+
+}
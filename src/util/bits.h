@@ -3,6 +3,7 @@
 #include <endian.h>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 namespace obsr::bits {
 
@@ -30,4 +31,90 @@ static inline uint64_t host64(uint64_t value) {
     return be64toh(value);
 }
 
+// copy count values of 32 or 64 bits, reversing the bytes of each. src and dst may be the same,
+// but must not otherwise overlap. uses simd shuffles where the cpu has them.
+void swap_copy32(const void* src, void* dst, size_t count);
+void swap_copy64(const void* src, void* dst, size_t count);
+
+// copy count values, converting between host order and big endian (network) order
+static inline void net_copy32(const void* src, void* dst, size_t count) {
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    swap_copy32(src, dst, count);
+#else
+    if (src != dst) {
+        memcpy(dst, src, count * sizeof(uint32_t));
+    }
+#endif
+}
+
+static inline void net_copy64(const void* src, void* dst, size_t count) {
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    swap_copy64(src, dst, count);
+#else
+    if (src != dst) {
+        memcpy(dst, src, count * sizeof(uint64_t));
+    }
+#endif
+}
+
+// copy count values, converting between host order and little endian order
+static inline void le_copy32(const void* src, void* dst, size_t count) {
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    if (src != dst) {
+        memcpy(dst, src, count * sizeof(uint32_t));
+    }
+#else
+    swap_copy32(src, dst, count);
+#endif
+}
+
+static inline void le_copy64(const void* src, void* dst, size_t count) {
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+    if (src != dst) {
+        memcpy(dst, src, count * sizeof(uint64_t));
+    }
+#else
+    swap_copy64(src, dst, count);
+#endif
+}
+
+static constexpr size_t max_varint_size = 10;
+
+// variable length, 7 bits per byte, least significant first. returns the amount of bytes written.
+static inline size_t encode_varint(uint64_t value, uint8_t* out) {
+    size_t size = 0;
+    do {
+        out[size] = value & 0x7f;
+        value >>= 7;
+        if (value != 0) {
+            out[size] |= 0x80;
+        }
+        size++;
+    } while (value != 0);
+
+    return size;
+}
+
+// returns the amount of bytes read, or 0 if the data ends before the varint does
+static inline size_t decode_varint(const uint8_t* data, size_t size, uint64_t& value) {
+    value = 0;
+    for (size_t i = 0; i < size && i < max_varint_size; i++) {
+        value |= static_cast<uint64_t>(data[i] & 0x7f) << (7 * i);
+        if ((data[i] & 0x80) == 0) {
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+// maps signed values to unsigned ones such that small magnitudes stay small
+static inline uint64_t zigzag_encode(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static inline int64_t zigzag_decode(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
 }
@@ -72,6 +72,14 @@ public:
         return m_count < 1;
     }
 
+    size_t size() const {
+        return m_count;
+    }
+
+    bool full() const {
+        return m_count >= capacity_;
+    }
+
     const type_* operator[](handle handle) const {
         if (!has(handle)) {
             throw no_such_handle_exception(handle);
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <optional>
+
+namespace obsr {
+
+// lock-free, unbounded queue for multiple producers and a single consumer.
+// push may be called from any thread, while pop and empty may only be called by the consumer.
+template<typename type_>
+class mpsc_queue {
+public:
+    mpsc_queue()
+        : m_head(new node())
+        , m_tail(m_head.load()) {
+    }
+    ~mpsc_queue() {
+        while (pop());
+        delete m_tail;
+    }
+
+    mpsc_queue(const mpsc_queue&) = delete;
+    mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+    void push(type_ value) {
+        auto new_node = new node();
+        new_node->value.emplace(std::move(value));
+
+        auto previous = m_head.exchange(new_node, std::memory_order_acq_rel);
+        previous->next.store(new_node, std::memory_order_release);
+    }
+
+    // a push which has not finished linking its node may not yet be visible,
+    // in which case the queue appears empty.
+    std::optional<type_> pop() {
+        auto tail = m_tail;
+        auto next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr) {
+            return {};
+        }
+
+        m_tail = next;
+        std::optional<type_> value(std::move(next->value));
+        next->value.reset();
+
+        delete tail;
+        return value;
+    }
+
+    bool empty() const {
+        return m_tail->next.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    struct node {
+        std::atomic<node*> next = nullptr;
+        std::optional<type_> value;
+    };
+
+    std::atomic<node*> m_head;
+    node* m_tail;
+};
+
+}
@@ -0,0 +1,130 @@
+
+#include "path_trie.h"
+
+namespace obsr {
+
+// returns the first component of the path, and removes it from the path
+static std::string_view next_component(std::string_view& path) {
+    while (!path.empty() && path.front() == '/') {
+        path.remove_prefix(1);
+    }
+
+    const auto index = path.find('/');
+    const auto component = path.substr(0, index);
+    path.remove_prefix(index == std::string_view::npos ? path.size() : index);
+
+    return component;
+}
+
+path_trie::path_trie()
+    : m_root()
+{}
+
+bool path_trie::insert(std::string_view path) {
+    auto current = &m_root;
+    for (auto component = next_component(path); !component.empty(); component = next_component(path)) {
+        auto it = current->children.find(component);
+        if (it == current->children.end()) {
+            it = current->children.emplace(std::string(component), std::make_unique<node>()).first;
+        }
+
+        current = it->second.get();
+    }
+
+    if (current->terminal) {
+        return false;
+    }
+
+    current->terminal = true;
+    return true;
+}
+
+bool path_trie::erase(std::string_view path) {
+    return erase(m_root, path);
+}
+
+void path_trie::clear() {
+    m_root.children.clear();
+    m_root.terminal = false;
+}
+
+bool path_trie::empty() const {
+    return !m_root.terminal && m_root.children.empty();
+}
+
+bool path_trie::matches(std::string_view path) const {
+    auto current = &m_root;
+    for (auto component = next_component(path); !current->terminal; component = next_component(path)) {
+        if (component.empty()) {
+            // reached the end of the path without passing through any path in the trie
+            return false;
+        }
+
+        auto it = current->children.find(component);
+        if (it == current->children.end()) {
+            return false;
+        }
+
+        current = it->second.get();
+    }
+
+    return true;
+}
+
+void path_trie::for_each(const path_action& action) const {
+    if (m_root.terminal) {
+        action("/");
+        return;
+    }
+
+    std::string path;
+    for_each(m_root, path, action);
+}
+
+bool path_trie::erase(node& current, std::string_view path) {
+    const auto component = next_component(path);
+    if (component.empty()) {
+        if (!current.terminal) {
+            return false;
+        }
+
+        current.terminal = false;
+        return true;
+    }
+
+    auto it = current.children.find(component);
+    if (it == current.children.end()) {
+        return false;
+    }
+
+    if (!erase(*it->second, path)) {
+        return false;
+    }
+
+    // nodes which lead to no path are pruned
+    auto& child = *it->second;
+    if (!child.terminal && child.children.empty()) {
+        current.children.erase(it);
+    }
+
+    return true;
+}
+
+void path_trie::for_each(const node& current, std::string& path, const path_action& action) {
+    for (auto& [name, child] : current.children) {
+        const auto size = path.size();
+        path.push_back('/');
+        path.append(name);
+
+        if (child->terminal) {
+            // anything further down is already covered by this path
+            action(path);
+        } else {
+            for_each(*child, path, action);
+        }
+
+        path.resize(size);
+    }
+}
+
+}
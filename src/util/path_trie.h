@@ -0,0 +1,42 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace obsr {
+
+// set of paths, organized by their components. a path matches the trie if it is one of
+// the paths in it, or is under one of them. "/" (or an empty path) matches any path.
+class path_trie {
+public:
+    using path_action = std::function<void(const std::string&)>;
+
+    path_trie();
+
+    // returns false if the path was already in the trie
+    bool insert(std::string_view path);
+    // returns false if the path was not in the trie
+    bool erase(std::string_view path);
+    void clear();
+
+    [[nodiscard]] bool empty() const;
+    [[nodiscard]] bool matches(std::string_view path) const;
+    // visits the paths which are not under another path in the trie, as "/a/b" or "/" for the root
+    void for_each(const path_action& action) const;
+
+private:
+    struct node {
+        std::map<std::string, std::unique_ptr<node>, std::less<>> children;
+        bool terminal = false;
+    };
+
+    static bool erase(node& current, std::string_view path);
+    static void for_each(const node& current, std::string& path, const path_action& action);
+
+    node m_root;
+};
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+namespace obsr {
+
+// lock-free, bounded ring for a single producer and a single consumer. slots are allocated once and
+// reused, filled in and read in place: the producer claims a slot and commits it once filled, the
+// consumer reads the slot at the front and releases it once done.
+template<typename type_>
+class spsc_ring {
+public:
+    // the capacity is rounded up to a power of two
+    explicit spsc_ring(size_t capacity)
+        : m_slots(round_capacity(capacity))
+        , m_mask(m_slots.size() - 1)
+        , m_head(0)
+        , m_cached_tail(0)
+        , m_tail(0)
+        , m_cached_head(0) {
+    }
+
+    spsc_ring(const spsc_ring&) = delete;
+    spsc_ring& operator=(const spsc_ring&) = delete;
+
+    // producer only. returns nullptr if the ring is full.
+    type_* claim() {
+        const auto head = m_head.load(std::memory_order_relaxed);
+        if (head - m_cached_tail == m_slots.size()) {
+            m_cached_tail = m_tail.load(std::memory_order_acquire);
+            if (head - m_cached_tail == m_slots.size()) {
+                return nullptr;
+            }
+        }
+
+        return &m_slots[head & m_mask];
+    }
+
+    // producer only. makes the claimed slot visible to the consumer.
+    void commit() {
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // consumer only. returns nullptr if the ring is empty.
+    type_* front() {
+        const auto tail = m_tail.load(std::memory_order_relaxed);
+        if (tail == m_cached_head) {
+            m_cached_head = m_head.load(std::memory_order_acquire);
+            if (tail == m_cached_head) {
+                return nullptr;
+            }
+        }
+
+        return &m_slots[tail & m_mask];
+    }
+
+    // consumer only. hands the slot at the front back to the producer.
+    void release() {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    static size_t round_capacity(size_t capacity) {
+        size_t rounded = 1;
+        while (rounded < capacity) {
+            rounded <<= 1;
+        }
+
+        return rounded;
+    }
+
+    std::vector<type_> m_slots;
+    const size_t m_mask;
+
+    // each side writes its own index, and keeps the last index it saw of the other side next to it,
+    // so that the index of the other side is only read once the ring seems full or empty
+    alignas(64) std::atomic<size_t> m_head;
+    size_t m_cached_tail;
+    alignas(64) std::atomic<size_t> m_tail;
+    size_t m_cached_head;
+};
+
+}